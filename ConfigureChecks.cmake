@@ -19,6 +19,7 @@ CHECK_SYMBOL_EXISTS(abort "stdlib.h" HAVE_ABORT)
 
 CHECK_FUNCTION_EXISTS(getcwd HAVE_GETCWD)
 CHECK_FUNCTION_EXISTS(toascii HAVE_TOASCII)
+CHECK_FUNCTION_EXISTS(mmap HAVE_MMAP)
 
 CHECK_LIBRARY_EXISTS(dl dlopen "" HAVE_LIBDL)
 
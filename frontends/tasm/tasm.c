@@ -388,9 +388,13 @@ do_assemble(void)
     yasm_objfmt_output(object, obj?obj:stderr,
                        strcmp(cur_dbgfmt_module->keyword, "null"), errwarns);
 
-    /* Close object file */
-    if (obj)
-        fclose(obj);
+    /* Close object file.  Output is buffered, so write errors may not show
+     * up until here.
+     */
+    if (obj && (ferror(obj) | fclose(obj))) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
 
     /* If we had an error at this point, we also need to delete the output
      * object file (to make sure it's not left newer than the source).
@@ -617,6 +621,7 @@ cleanup(yasm_object *object)
 
         yasm_floatnum_cleanup();
         yasm_intnum_cleanup();
+        yasm__intern_cleanup();
 
         yasm_errwarn_cleanup();
 
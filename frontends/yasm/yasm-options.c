@@ -120,7 +120,8 @@ parse_cmdline(int argc, char **argv, opt_option *options, size_t nopts,
                             param = argv[1];
                             if (argv[0][2] != '\0')
                                 param = &argv[0][2];
-                            else if (param == NULL || *param == '-') {
+                            else if (param == NULL ||
+                                     (param[0] == '-' && param[1] != '\0')) {
                                 print_error(
                                     _("option `-%c' needs an argument!"),
                                     options[i].sopt);
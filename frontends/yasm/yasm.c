@@ -35,6 +35,11 @@
 #include <libgen.h>
 #endif
 
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
 #include "yasm-options.h"
 
 #ifdef CMAKE_BUILD
@@ -50,6 +55,8 @@
 /*@null@*/ /*@only@*/ static char *global_prefix = NULL, *global_suffix = NULL;
 /*@null@*/ /*@only@*/ static char *list_filename = NULL, *map_filename = NULL;
 /*@null@*/ /*@only@*/ static char *machine_name = NULL;
+/*@null@*/ /*@only@*/ static char *opt_trace_filename = NULL;
+static int opt_stats = 0;
 static int special_options = 0;
 /*@null@*/ /*@dependent@*/ static yasm_arch *cur_arch = NULL;
 /*@null@*/ /*@dependent@*/ static const yasm_arch_module *
@@ -98,6 +105,8 @@ static int opt_objfile_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_mapfile_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_machine_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_strict_handler(char *cmd, /*@null@*/ char *param, int extra);
+static int opt_optstats_handler(char *cmd, /*@null@*/ char *param, int extra);
+static int opt_opttrace_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_warning_handler(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_error_file(char *cmd, /*@null@*/ char *param, int extra);
 static int opt_error_stdout(char *cmd, /*@null@*/ char *param, int extra);
@@ -170,6 +179,10 @@ static opt_option options[] =
       N_("select machine (list with -m help)"), N_("machine") },
     { 0, "force-strict", 0, opt_strict_handler, 0,
       N_("treat all sized operands as if `strict' was used"), NULL },
+    { 0, "opt-stats", 0, opt_optstats_handler, 0,
+      N_("print optimizer statistics to stderr"), NULL },
+    { 0, "opt-trace", 1, opt_opttrace_handler, 0,
+      N_("write trace of optimizer span expansions to file"), N_("filename") },
     { 'w', NULL, 0, opt_warning_handler, 1,
       N_("inhibits warning messages"), NULL },
     { 'W', NULL, 0, opt_warning_handler, 0,
@@ -522,19 +535,49 @@ do_assemble(void)
     check_errors(errwarns, object, linemap);
 
     /* Optimize */
-    yasm_object_optimize(object, errwarns);
+    if (opt_stats || opt_trace_filename) {
+        yasm_optimize_stats stats;
+        FILE *trace = NULL;
+
+        if (opt_trace_filename) {
+            trace = open_file(opt_trace_filename, "wt");
+            if (!trace) {
+                cleanup(object);
+                return EXIT_FAILURE;
+            }
+        }
+        yasm_object_optimize_stats(object, errwarns, &stats, trace,
+                                   linemap);
+        if (trace)
+            fclose(trace);
+        if (opt_stats) {
+            fprintf(stderr, "%s:\n", _("Optimizer statistics"));
+            yasm_optimize_stats_print(&stats, linemap, stderr, 2);
+        }
+    } else
+        yasm_object_optimize(object, errwarns);
     check_errors(errwarns, object, linemap);
 
     /* generate any debugging information */
     yasm_dbgfmt_generate(object, linemap, errwarns);
     check_errors(errwarns, object, linemap);
 
-    /* open the object file for output (if not already opened by dbg objfmt) */
+    /* open the object file for output (if not already opened by dbg objfmt).
+     * Object formats write the finished file sequentially, so an object
+     * filename of "-" (stdout) may be a pipe.
+     */
     if (!obj && strcmp(cur_objfmt_module->keyword, "dbg") != 0) {
-        obj = open_file(obj_filename, "wb");
-        if (!obj) {
-            cleanup(object);
-            return EXIT_FAILURE;
+        if (strcmp(obj_filename, "-") == 0) {
+            obj = stdout;
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        } else {
+            obj = open_file(obj_filename, "wb");
+            if (!obj) {
+                cleanup(object);
+                return EXIT_FAILURE;
+            }
         }
     }
 
@@ -542,14 +585,26 @@ do_assemble(void)
     yasm_objfmt_output(object, obj?obj:stderr,
                        strcmp(cur_dbgfmt_module->keyword, "null"), errwarns);
 
-    /* Close object file */
-    if (obj)
-        fclose(obj);
+    /* Close object file.  Output is buffered, so write errors may not show
+     * up until here.
+     */
+    if (obj) {
+        int err = ferror(obj);
+        if (obj == stdout)
+            err |= fflush(obj);
+        else
+            err |= fclose(obj);
+        if (err) {
+            yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+            yasm_errwarn_propagate(errwarns, 0);
+        }
+    }
 
     /* If we had an error at this point, we also need to delete the output
      * object file (to make sure it's not left newer than the source).
      */
-    if (yasm_errwarns_num_errors(errwarns, warning_error) > 0)
+    if (yasm_errwarns_num_errors(errwarns, warning_error) > 0 &&
+        obj != stdout)
         remove(obj_filename);
     check_errors(errwarns, object, linemap);
 
@@ -788,6 +843,7 @@ cleanup(yasm_object *object)
 
         yasm_floatnum_cleanup();
         yasm_intnum_cleanup();
+        yasm__intern_cleanup();
 
         yasm_errwarn_cleanup();
 
@@ -805,6 +861,8 @@ cleanup(yasm_object *object)
             yasm_xfree(map_filename);
         if (machine_name)
             yasm_xfree(machine_name);
+        if (opt_trace_filename)
+            yasm_xfree(opt_trace_filename);
         if (objfmt_keyword)
             yasm_xfree(objfmt_keyword);
     }
@@ -1049,6 +1107,28 @@ opt_strict_handler(/*@unused@*/ char *cmd,
     return 0;
 }
 
+static int
+opt_optstats_handler(/*@unused@*/ char *cmd,
+                     /*@unused@*/ /*@null@*/ char *param,
+                     /*@unused@*/ int extra)
+{
+    opt_stats = 1;
+    return 0;
+}
+
+static int
+opt_opttrace_handler(/*@unused@*/ char *cmd, char *param,
+                     /*@unused@*/ int extra)
+{
+    if (opt_trace_filename)
+        yasm_xfree(opt_trace_filename);
+
+    assert(param != NULL);
+    opt_trace_filename = yasm__xstrdup(param);
+
+    return 0;
+}
+
 static int
 opt_warning_handler(char *cmd, /*@unused@*/ char *param, int extra)
 {
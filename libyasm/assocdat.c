@@ -30,27 +30,136 @@
 #include "assocdat.h"
 
 
-typedef struct assoc_data_item {
-    const yasm_assoc_data_callback *callback;
-    void *data;
-} assoc_data_item;
-
+/* Data is indexed by callback slot (minus one); NULL for unused slots. */
 struct yasm__assoc_data {
-    assoc_data_item *vector;
-    size_t size;
+    void **vector;
     size_t alloc;
 };
 
+/* Registry of callbacks that have been given slots.  Slots are assigned when
+ * a callback is registered, or the first time it is used to add data, and
+ * are never reused, so stale data left under an unregistered callback can't
+ * be mistaken for data of a later callback.
+ */
+
+/* Callbacks indexed by slot (minus one); NULL once unregistered. */
+static /*@only@*/ /*@null@*/ const yasm_assoc_data_callback **
+    assoc_data_callbacks = NULL;
+static unsigned int assoc_data_num_slots = 0;
+
+/* Open-addressed (linear probing) hash table from callback pointer to slot.
+ * The size is always a power of 2 and kept at least twice the count.
+ */
+typedef struct assoc_data_reg {
+    /*@dependent@*/ /*@null@*/ const yasm_assoc_data_callback *callback;
+    unsigned int slot;
+} assoc_data_reg;
+
+static /*@only@*/ /*@null@*/ assoc_data_reg *assoc_data_index = NULL;
+static unsigned long assoc_data_index_size = 0;
+
+static unsigned long
+assoc_data_hash(const yasm_assoc_data_callback *callback)
+{
+    return ((unsigned long)(size_t)callback >> 3) * 2654435761UL;
+}
+
+static /*@dependent@*/ assoc_data_reg *
+assoc_data_find_reg(const yasm_assoc_data_callback *callback)
+{
+    unsigned long mask = assoc_data_index_size-1;
+    unsigned long i = assoc_data_hash(callback) & mask;
+
+    while (assoc_data_index[i].callback
+           && assoc_data_index[i].callback != callback)
+        i = (i+1) & mask;
+    return &assoc_data_index[i];
+}
+
+/* (Re)build the index from the slot table, making sure it has room for one
+ * more entry.
+ */
+static void
+assoc_data_rebuild_index(void)
+{
+    unsigned long i;
+    unsigned int slot;
+
+    if (assoc_data_index)
+        yasm_xfree(assoc_data_index);
+    if (assoc_data_index_size == 0)
+        assoc_data_index_size = 16;
+    while (assoc_data_index_size < 2*(assoc_data_num_slots+1))
+        assoc_data_index_size *= 2;
+    assoc_data_index =
+        yasm_xmalloc(assoc_data_index_size*sizeof(assoc_data_reg));
+    for (i=0; i<assoc_data_index_size; i++) {
+        assoc_data_index[i].callback = NULL;
+        assoc_data_index[i].slot = 0;
+    }
+
+    for (slot=1; slot<=assoc_data_num_slots; slot++) {
+        const yasm_assoc_data_callback *callback =
+            assoc_data_callbacks[slot-1];
+        if (callback) {
+            assoc_data_reg *reg = assoc_data_find_reg(callback);
+            reg->callback = callback;
+            reg->slot = slot;
+        }
+    }
+}
+
+/* Get the slot of a callback; 0 if it has none. */
+static unsigned int
+assoc_data_find_slot(const yasm_assoc_data_callback *callback)
+{
+    if (!assoc_data_index)
+        return 0;
+    return assoc_data_find_reg(callback)->slot;
+}
+
+unsigned int
+yasm_assoc_data_register(const yasm_assoc_data_callback *callback)
+{
+    assoc_data_reg *reg;
+
+    if (2*(assoc_data_num_slots+1) > assoc_data_index_size)
+        assoc_data_rebuild_index();
+
+    reg = assoc_data_find_reg(callback);
+    if (reg->callback)
+        return reg->slot;
+
+    assoc_data_callbacks =
+        yasm_xrealloc(assoc_data_callbacks, (assoc_data_num_slots+1) *
+                      sizeof(const yasm_assoc_data_callback *));
+    assoc_data_callbacks[assoc_data_num_slots++] = callback;
+    reg->callback = callback;
+    reg->slot = assoc_data_num_slots;
+    return reg->slot;
+}
+
+void
+yasm__assoc_data_unregister(const yasm_assoc_data_callback *callback)
+{
+    unsigned int slot = assoc_data_find_slot(callback);
+
+    if (slot == 0)
+        return;
+    assoc_data_callbacks[slot-1] = NULL;
+    assoc_data_rebuild_index();
+}
 
 yasm__assoc_data *
 yasm__assoc_data_create(void)
 {
     yasm__assoc_data *assoc_data = yasm_xmalloc(sizeof(yasm__assoc_data));
+    size_t i;
 
-    assoc_data->size = 0;
-    assoc_data->alloc = 2;
-    assoc_data->vector = yasm_xmalloc(assoc_data->alloc *
-                                      sizeof(assoc_data_item));
+    assoc_data->alloc = assoc_data_num_slots > 2 ? assoc_data_num_slots : 2;
+    assoc_data->vector = yasm_xmalloc(assoc_data->alloc * sizeof(void *));
+    for (i=0; i<assoc_data->alloc; i++)
+        assoc_data->vector[i] = NULL;
 
     return assoc_data;
 }
@@ -59,16 +168,18 @@ void *
 yasm__assoc_data_get(yasm__assoc_data *assoc_data,
                      const yasm_assoc_data_callback *callback)
 {
-    size_t i;
-
     if (!assoc_data)
         return NULL;
+    return yasm__assoc_data_get_slot(assoc_data,
+                                     assoc_data_find_slot(callback));
+}
 
-    for (i=0; i<assoc_data->size; i++) {
-        if (assoc_data->vector[i].callback == callback)
-            return assoc_data->vector[i].data;
-    }
-    return NULL;
+void *
+yasm__assoc_data_get_slot(yasm__assoc_data *assoc_data, unsigned int slot)
+{
+    if (!assoc_data || slot == 0 || slot > assoc_data->alloc)
+        return NULL;
+    return assoc_data->vector[slot-1];
 }
 
 yasm__assoc_data *
@@ -76,8 +187,8 @@ yasm__assoc_data_add(yasm__assoc_data *assoc_data_arg,
                      const yasm_assoc_data_callback *callback, void *data)
 {
     yasm__assoc_data *assoc_data;
-    assoc_data_item *item = NULL;
-    size_t i;
+    unsigned int slot = yasm_assoc_data_register(callback);
+    void **item;
 
     /* Create a new assoc_data if necessary */
     if (assoc_data_arg)
@@ -85,33 +196,23 @@ yasm__assoc_data_add(yasm__assoc_data *assoc_data_arg,
     else
         assoc_data = yasm__assoc_data_create();
 
-    /* See if there's already assocated data for this callback */
-    for (i=0; i<assoc_data->size; i++) {
-        if (assoc_data->vector[i].callback == callback) {
-            item = &assoc_data->vector[i];
-            break;
-        }
+    /* Make room for the slot */
+    if (slot > assoc_data->alloc) {
+        size_t i, old_alloc = assoc_data->alloc;
+        assoc_data->alloc = assoc_data_num_slots;
+        assoc_data->vector = yasm_xrealloc(assoc_data->vector,
+                                           assoc_data->alloc * sizeof(void *));
+        for (i=old_alloc; i<assoc_data->alloc; i++)
+            assoc_data->vector[i] = NULL;
     }
 
-    /* No?  Then append a new one */
-    if (!item) {
-        assoc_data->size++;
-        if (assoc_data->size > assoc_data->alloc) {
-            assoc_data->alloc *= 2;
-            assoc_data->vector =
-                yasm_xrealloc(assoc_data->vector,
-                              assoc_data->alloc * sizeof(assoc_data_item));
-        }
-        item = &assoc_data->vector[assoc_data->size-1];
-        item->callback = callback;
-        item->data = NULL;
-    }
+    item = &assoc_data->vector[slot-1];
 
     /* Delete existing data (if any) */
-    if (item->data && item->data != data)
-        item->callback->destroy(item->data);
+    if (*item && *item != data)
+        callback->destroy(*item);
 
-    item->data = data;
+    *item = data;
 
     return assoc_data;
 }
@@ -124,8 +225,11 @@ yasm__assoc_data_destroy(yasm__assoc_data *assoc_data)
     if (!assoc_data)
         return;
 
-    for (i=0; i<assoc_data->size; i++)
-        assoc_data->vector[i].callback->destroy(assoc_data->vector[i].data);
+    for (i=0; i<assoc_data->alloc; i++) {
+        /* Data left under an unregistered callback can't be destroyed */
+        if (assoc_data->vector[i] && assoc_data_callbacks[i])
+            assoc_data_callbacks[i]->destroy(assoc_data->vector[i]);
+    }
     yasm_xfree(assoc_data->vector);
     yasm_xfree(assoc_data);
 }
@@ -37,6 +37,14 @@
 /** Associated data container. */
 typedef struct yasm__assoc_data yasm__assoc_data;
 
+/** Unregister a data callback.  Must be called before the callback structure
+ * is freed if it was ever used to add data.  Any data still associated using
+ * the callback is not destroyed.
+ * \param callback      callback
+ */
+YASM_LIB_DECL
+void yasm__assoc_data_unregister(const yasm_assoc_data_callback *callback);
+
 /** Create an associated data container. */
 YASM_LIB_DECL
 /*@only@*/ yasm__assoc_data *yasm__assoc_data_create(void);
@@ -51,6 +59,15 @@ YASM_LIB_DECL
     (/*@null@*/ yasm__assoc_data *assoc_data,
      const yasm_assoc_data_callback *callback);
 
+/** Get associated data for a data callback slot.
+ * \param assoc_data    container of associated data
+ * \param slot          slot from yasm_assoc_data_register()
+ * \return Associated data (NULL if none).
+ */
+YASM_LIB_DECL
+/*@dependent@*/ /*@null@*/ void *yasm__assoc_data_get_slot
+    (/*@null@*/ yasm__assoc_data *assoc_data, unsigned int slot);
+
 /** Add associated data to a associated data container.
  * \attention Deletes any existing associated data for that data callback.
  * \param assoc_data    container of associated data
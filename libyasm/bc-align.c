@@ -70,7 +70,8 @@ static const yasm_bytecode_callback bc_align_callback = {
     bc_align_calc_len,
     bc_align_expand,
     bc_align_tobytes,
-    YASM_BC_SPECIAL_OFFSET
+    YASM_BC_SPECIAL_OFFSET,
+    NULL
 };
 
 
@@ -243,3 +244,31 @@ yasm_bc_create_align(yasm_expr *boundary, yasm_expr *fill,
 
     return yasm_bc_create_common(&bc_align_callback, align, line);
 }
+
+int
+yasm_bc_get_code_align(yasm_bytecode *bc, unsigned long *boundary,
+                       unsigned long *maxskip)
+{
+    bytecode_align *align;
+    /*@dependent@*/ /*@null@*/ const yasm_intnum *intn;
+
+    if (bc->callback != &bc_align_callback)
+        return 0;
+    align = (bytecode_align *)bc->contents;
+    if (align->fill || !align->code_fill)
+        return 0;
+
+    intn = yasm_expr_get_intnum(&align->boundary, 0);
+    if (!intn)
+        return 0;
+    *boundary = yasm_intnum_get_uint(intn);
+
+    *maxskip = *boundary;
+    if (align->maxskip) {
+        intn = yasm_expr_get_intnum(&align->maxskip, 0);
+        if (!intn)
+            return 0;
+        *maxskip = yasm_intnum_get_uint(intn);
+    }
+    return 1;
+}
@@ -82,7 +82,8 @@ static const yasm_bytecode_callback bc_data_callback = {
     bc_data_calc_len,
     yasm_bc_expand_common,
     bc_data_tobytes,
-    0
+    0,
+    NULL
 };
 
 
@@ -41,10 +41,27 @@
 #include "file.h"
 
 
+/* Contents of an included file.  These are shared by all incbins that name
+ * the same file from the same source file, so each file is only looked up
+ * and mapped once.
+ */
+typedef struct incbin_file {
+    /*@null@*/ /*@owned@*/ struct incbin_file *next;
+    /*@only@*/ char *filename;          /* file as named by the incbin */
+    /*@only@*/ /*@null@*/ char *from;   /* filename of what contained incbin */
+    /*@only@*/ yasm_mapfile *contents;
+    unsigned long refcount;
+} incbin_file;
+
+static /*@null@*/ /*@owned@*/ incbin_file *incbin_files = NULL;
+
 typedef struct bytecode_incbin {
     /*@only@*/ char *filename;          /* file to include data from */
     const char *from;           /* filename of what contained incbin */
 
+    /* contents of file (NULL=not yet opened) */
+    /*@null@*/ /*@dependent@*/ incbin_file *file;
+
     /* starting offset to read from (NULL=0) */
     /*@only@*/ /*@null@*/ yasm_expr *start;
 
@@ -61,6 +78,7 @@ static int bc_incbin_tobytes(yasm_bytecode *bc, unsigned char **bufp,
                              unsigned char *bufstart, void *d,
                              yasm_output_value_func output_value,
                              /*@null@*/ yasm_output_reloc_func output_reloc);
+static /*@null@*/ const unsigned char *bc_incbin_get_bytes(yasm_bytecode *bc);
 
 static const yasm_bytecode_callback bc_incbin_callback = {
     bc_incbin_destroy,
@@ -70,14 +88,77 @@ static const yasm_bytecode_callback bc_incbin_callback = {
     bc_incbin_calc_len,
     yasm_bc_expand_common,
     bc_incbin_tobytes,
-    0
+    0,
+    bc_incbin_get_bytes
 };
 
 
+/* Find and map the file for an incbin, or get the already mapped contents.
+ * Returns 1 (and sets an error) if the file can't be found or read.
+ */
+static int
+incbin_file_open(bytecode_incbin *incbin)
+{
+    incbin_file *file;
+    yasm_mapfile *contents;
+
+    if (incbin->file)
+        return 0;
+
+    for (file = incbin_files; file; file = file->next) {
+        if (strcmp(file->filename, incbin->filename) == 0
+            && (file->from == incbin->from ||
+                (file->from && incbin->from
+                 && strcmp(file->from, incbin->from) == 0))) {
+            file->refcount++;
+            incbin->file = file;
+            return 0;
+        }
+    }
+
+    contents = yasm_mapfile_create_include(incbin->filename, incbin->from,
+                                           NULL);
+    if (!contents) {
+        yasm_error_set(YASM_ERROR_IO,
+                       N_("`incbin': unable to open file `%s'"),
+                       incbin->filename);
+        return 1;
+    }
+
+    file = yasm_xmalloc(sizeof(incbin_file));
+    file->filename = yasm__xstrdup(incbin->filename);
+    file->from = incbin->from ? yasm__xstrdup(incbin->from) : NULL;
+    file->contents = contents;
+    file->refcount = 1;
+    file->next = incbin_files;
+    incbin_files = file;
+    incbin->file = file;
+    return 0;
+}
+
+static void
+incbin_file_release(incbin_file *file)
+{
+    incbin_file **prev;
+
+    if (--file->refcount > 0)
+        return;
+    for (prev = &incbin_files; *prev != file; prev = &(*prev)->next)
+        ;
+    *prev = file->next;
+    yasm_mapfile_destroy(file->contents);
+    yasm_xfree(file->filename);
+    if (file->from)
+        yasm_xfree(file->from);
+    yasm_xfree(file);
+}
+
 static void
 bc_incbin_destroy(void *contents)
 {
     bytecode_incbin *incbin = (bytecode_incbin *)contents;
+    if (incbin->file)
+        incbin_file_release(incbin->file);
     yasm_xfree(incbin->filename);
     yasm_expr_destroy(incbin->start);
     yasm_expr_destroy(incbin->maxlen);
@@ -132,7 +213,6 @@ bc_incbin_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
                    void *add_span_data)
 {
     bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
-    FILE *f;
     /*@dependent@*/ /*@null@*/ const yasm_intnum *num;
     unsigned long start = 0, maxlen = 0xFFFFFFFFUL, flen;
 
@@ -163,21 +243,9 @@ bc_incbin_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
     }
 
     /* Open file and determine its length */
-    f = yasm_fopen_include(incbin->filename, incbin->from, "rb", NULL);
-    if (!f) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to open file `%s'"),
-                       incbin->filename);
-        return -1;
-    }
-    if (fseek(f, 0L, SEEK_END) < 0) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to seek on file `%s'"),
-                       incbin->filename);
+    if (incbin_file_open(incbin))
         return -1;
-    }
-    flen = (unsigned long)ftell(f);
-    fclose(f);
+    flen = yasm_mapfile_size(incbin->file->contents);
 
     /* Compute length of incbin from start, maxlen, and len */
     if (start > flen) {
@@ -194,16 +262,16 @@ bc_incbin_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
     return 0;
 }
 
-static int
-bc_incbin_tobytes(yasm_bytecode *bc, unsigned char **bufp,
-                  unsigned char *bufstart, void *d,
-                  yasm_output_value_func output_value,
-                  /*@unused@*/ yasm_output_reloc_func output_reloc)
+/* Get the bc->len bytes of file data the incbin outputs.  Returns NULL if
+ * the file is too short to provide them; calc_len has already warned if
+ * start is past the end.
+ */
+static /*@null@*/ const unsigned char *
+incbin_data(yasm_bytecode *bc)
 {
     bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
-    FILE *f;
     /*@dependent@*/ /*@null@*/ const yasm_intnum *num;
-    unsigned long start = 0;
+    unsigned long start = 0, flen;
 
     /* Convert start to integer value */
     if (incbin->start) {
@@ -214,37 +282,51 @@ bc_incbin_tobytes(yasm_bytecode *bc, unsigned char **bufp,
         start = yasm_intnum_get_uint(num);
     }
 
-    /* Open file */
-    f = yasm_fopen_include(incbin->filename, incbin->from, "rb", NULL);
-    if (!f) {
-        yasm_error_set(YASM_ERROR_IO, N_("`incbin': unable to open file `%s'"),
-                       incbin->filename);
-        return 1;
-    }
+    flen = yasm_mapfile_size(incbin->file->contents);
+    if (start > flen)
+        start = flen;
+    if (bc->len > flen - start)
+        return NULL;
+    return yasm_mapfile_data(incbin->file->contents) + start;
+}
 
-    /* Seek to start of data */
-    if (fseek(f, (long)start, SEEK_SET) < 0) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("`incbin': unable to seek on file `%s'"),
-                       incbin->filename);
-        fclose(f);
+static int
+bc_incbin_tobytes(yasm_bytecode *bc, unsigned char **bufp,
+                  unsigned char *bufstart, void *d,
+                  yasm_output_value_func output_value,
+                  /*@unused@*/ yasm_output_reloc_func output_reloc)
+{
+    bytecode_incbin *incbin = (bytecode_incbin *)bc->contents;
+    /*@null@*/ const unsigned char *data;
+
+    if (bc->len == 0)
+        return 0;
+
+    /* Open file (normally already done by calc_len) */
+    if (incbin_file_open(incbin))
         return 1;
-    }
 
-    /* Read len bytes */
-    if (fread(*bufp, 1, (size_t)bc->len, f) < (size_t)bc->len) {
+    data = incbin_data(bc);
+    if (!data) {
         yasm_error_set(YASM_ERROR_IO,
                        N_("`incbin': unable to read %lu bytes from file `%s'"),
                        bc->len, incbin->filename);
-        fclose(f);
         return 1;
     }
-
+    memcpy(*bufp, data, (size_t)bc->len);
     *bufp += bc->len;
-    fclose(f);
     return 0;
 }
 
+/* Output the data straight from the file mapping where possible. */
+static const unsigned char *
+bc_incbin_get_bytes(yasm_bytecode *bc)
+{
+    if (!((bytecode_incbin *)bc->contents)->file)
+        return NULL;
+    return incbin_data(bc);
+}
+
 yasm_bytecode *
 yasm_bc_create_incbin(char *filename, yasm_expr *start, yasm_expr *maxlen,
                       yasm_linemap *linemap, unsigned long line)
@@ -257,6 +339,7 @@ yasm_bc_create_incbin(char *filename, yasm_expr *start, yasm_expr *maxlen,
 
     /*@-mustfree@*/
     incbin->filename = filename;
+    incbin->file = NULL;
     incbin->start = start;
     incbin->maxlen = maxlen;
     /*@=mustfree@*/
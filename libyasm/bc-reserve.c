@@ -62,7 +62,8 @@ static const yasm_bytecode_callback bc_reserve_callback = {
     bc_reserve_calc_len,
     yasm_bc_expand_common,
     bc_reserve_tobytes,
-    YASM_BC_SPECIAL_RESERVE
+    YASM_BC_SPECIAL_RESERVE,
+    NULL
 };
 
 
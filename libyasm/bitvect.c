@@ -122,6 +122,9 @@ static N_word LONGBITS; /* = # of bits in unsigned long                      */
 static N_word LOG10;    /* = logarithm to base 10 of BITS - 1                */
 static N_word EXP10;    /* = largest possible power of 10 in signed int      */
 
+static N_word HALFBITS; /* = BITS / 2 (# of bits in a half-word "digit")     */
+static N_word HALFMASK; /* = mask for the lower half of a machine word       */
+
     /********************************************************************/
     /* global bit mask table for fast access (set by "BitVector_Boot"): */
     /********************************************************************/
@@ -224,6 +227,107 @@ static void BIT_VECTOR_del_words(wordptr addr, N_word total, N_word count,
     }
 }
 
+/* Index of the highest/lowest set bit of a non-zero machine word. */
+
+static N_word BIT_VECTOR_msb_index(N_word c)
+{
+#if defined(__GNUC__) && ((__GNUC__ > 3) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return(MODMASK - (N_word) __builtin_clz(c));
+#else
+    N_word i = 0;
+    N_word half = BITS >> 1;
+
+    while (half > 0)
+    {
+        if (c >> half) { c >>= half; i += half; }
+        half >>= 1;
+    }
+    return(i);
+#endif
+}
+
+static N_word BIT_VECTOR_lsb_index(N_word c)
+{
+#if defined(__GNUC__) && ((__GNUC__ > 3) || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return((N_word) __builtin_ctz(c));
+#else
+    N_word i = 0;
+    N_word half = BITS >> 1;
+
+    while (half > 0)
+    {
+        if (not (c AND ((LSB << half) - 1))) { c >>= half; i += half; }
+        half >>= 1;
+    }
+    return(i);
+#endif
+}
+
+/* Full (double-word) product of two machine words, built from half-words */
+/* so that no partial product exceeds a single machine word.              */
+
+static void BIT_VECTOR_mul_word(N_word a, N_word b, N_word *hi, N_word *lo)
+{
+    N_word al = a AND HALFMASK;
+    N_word ah = a >> HALFBITS;
+    N_word bl = b AND HALFMASK;
+    N_word bh = b >> HALFBITS;
+    N_word ll = al * bl;
+    N_word lh = al * bh;
+    N_word hl = ah * bl;
+    N_word mid;
+
+    mid = (ll >> HALFBITS) + (lh AND HALFMASK) + (hl AND HALFMASK);
+    *lo = (ll AND HALFMASK) | (mid << HALFBITS);
+    *hi = ah * bh + (lh >> HALFBITS) + (hl >> HALFBITS) + (mid >> HALFBITS);
+}
+
+/* X = Y * Z, word by word; returns FALSE (with X undefined) if the      */
+/* product does not fit into "bits_(X)" bits (or, if "strict", if it     */
+/* would set the sign bit).  Y and Z are preserved.                      */
+
+static boolean BIT_VECTOR_mul_words(wordptr X, wordptr Y, wordptr Z,
+                                    N_word zsize, boolean strict)
+{
+    N_word  size = size_(X);
+    N_word  mask = mask_(X);
+    N_word  i;
+    N_word  j;
+    N_word  k;
+    N_word  hi;
+    N_word  lo;
+    N_word  carry;
+    N_word  sum;
+
+    BIT_VECTOR_zro_words(X,size);
+    for ( i = 0; i < zsize; i++ )
+    {
+        if (Z[i] == 0) continue;
+        carry = 0;
+        for ( j = 0; j < size; j++ )
+        {
+            if ((Y[j] == 0) and (carry == 0)) continue;
+            BIT_VECTOR_mul_word(Y[j],Z[i],&hi,&lo);
+            k = i + j;
+            if (k >= size)
+            {
+                if (hi or lo or carry) return(FALSE);
+                continue;
+            }
+            lo += carry;
+            if (lo < carry) hi++;
+            sum = X[k] + lo;
+            if (sum < lo) hi++;
+            X[k] = sum;
+            carry = hi;
+        }
+        if (carry) return(FALSE);
+    }
+    if (X[size-1] AND NOT mask) return(FALSE);
+    if (strict and (X[size-1] AND (mask AND NOT (mask >> 1)))) return(FALSE);
+    return(TRUE);
+}
+
 static void BIT_VECTOR_reverse(charptr string, N_word length)
 {
     charptr last;
@@ -379,6 +483,9 @@ ErrCode BitVector_Boot(void)
     LOG10 = (N_word) (MODMASK * 0.30103); /* = (BITS - 1) * ( ln 2 / ln 10 ) */
     EXP10 = power10(LOG10);
 
+    HALFBITS = BITS >> 1;
+    HALFMASK = (LSB << HALFBITS) - 1;
+
     return(ErrCode_Ok);
 }
 
@@ -2708,6 +2815,11 @@ ErrCode BitVector_Mul_Pos(wordptr X, wordptr Y, wordptr Z, boolean strict)
     sign = Y + size_(Y) - 1;
     mask = mask_(Y);
     *sign &= mask;
+    /* Compute the product a word at a time; only if it overflows, redo  */
+    /* it bit by bit so the partial result left in X stays the same.     */
+    if (BIT_VECTOR_mul_words(X,Y,Z,(limit >> LOGBITS) + 1,strict))
+        return(ErrCode_Ok);
+    BitVector_Empty(X);
     mask &= NOT (mask >> 1);
     for ( count = 0; (ok and (count <= limit)); count++ )
     {
@@ -2812,14 +2924,136 @@ ErrCode BitVector_Multiply(wordptr X, wordptr Y, wordptr Z)
     return(error);
 }
 
+/* Long division on half-word "digits" (Knuth, TAOCP vol. 2, 4.3.1 D).   */
+/* Each digit is kept in its own machine word, so that every partial     */
+/* product and two-digit numerator fits into a single N_word.            */
+
+#define BIT_VECTOR_DIV_STACK 64
+
+static void BIT_VECTOR_div_digits(wordptr Q, wordptr X, wordptr Y, wordptr R,
+                                  wordptr u, wordptr v, wordptr q)
+{
+    N_word  size = size_(Q);
+    N_word  base = LSB << HALFBITS;
+    N_word  m;
+    N_word  n;
+    N_word  i;
+    N_word  j;
+    N_word  s;
+    N_word  num;
+    N_word  qhat;
+    N_word  rhat;
+    N_word  p;
+    N_word  t;
+    N_word  carry;
+    N_word  borrow;
+
+    for ( i = 0; i < size; i++ )
+    {
+        u[2*i]   = X[i] AND HALFMASK;
+        u[2*i+1] = X[i] >> HALFBITS;
+        v[2*i]   = Y[i] AND HALFMASK;
+        v[2*i+1] = Y[i] >> HALFBITS;
+    }
+    m = 2 * size;
+    while ((m > 0) and (u[m-1] == 0)) m--;
+    n = 2 * size;
+    while (v[n-1] == 0) n--;
+
+    BIT_VECTOR_zro_words(q,2*size);
+    if (m < n)
+    {
+        BIT_VECTOR_cpy_words(R,X,size);
+        BIT_VECTOR_zro_words(Q,size);
+        return;
+    }
+    if (n == 1)
+    {
+        rhat = 0;
+        for ( j = m; j-- > 0; )
+        {
+            num = (rhat << HALFBITS) | u[j];
+            q[j] = num / v[0];
+            rhat = num % v[0];
+        }
+        BIT_VECTOR_zro_words(u,2*size);
+        u[0] = rhat;
+    }
+    else
+    {
+        /* normalize so that the top digit of the divisor has its MSB set */
+        s = HALFBITS - 1 - BIT_VECTOR_msb_index(v[n-1]);
+        u[m] = 0;
+        if (s > 0)
+        {
+            u[m] = u[m-1] >> (HALFBITS - s);
+            for ( i = m - 1; i > 0; i-- )
+                u[i] = ((u[i] << s) | (u[i-1] >> (HALFBITS - s))) AND HALFMASK;
+            u[0] = (u[0] << s) AND HALFMASK;
+            for ( i = n - 1; i > 0; i-- )
+                v[i] = ((v[i] << s) | (v[i-1] >> (HALFBITS - s))) AND HALFMASK;
+            v[0] = (v[0] << s) AND HALFMASK;
+        }
+        for ( j = m - n + 1; j-- > 0; )
+        {
+            num = (u[j+n] << HALFBITS) | u[j+n-1];
+            qhat = num / v[n-1];
+            rhat = num % v[n-1];
+            while ((qhat >= base) or
+                   (qhat * v[n-2] > ((rhat << HALFBITS) | u[j+n-2])))
+            {
+                qhat--;
+                rhat += v[n-1];
+                if (rhat >= base) break;
+            }
+            carry = 0;
+            borrow = 0;
+            for ( i = 0; i < n; i++ )
+            {
+                p = qhat * v[i] + carry;
+                carry = p >> HALFBITS;
+                t = u[i+j] - (p AND HALFMASK) - borrow;
+                u[i+j] = t AND HALFMASK;
+                borrow = ((t >> HALFBITS) != 0);
+            }
+            t = u[j+n] - carry - borrow;
+            u[j+n] = t AND HALFMASK;
+            if ((t >> HALFBITS) != 0)
+            {
+                qhat--;
+                carry = 0;
+                for ( i = 0; i < n; i++ )
+                {
+                    t = u[i+j] + v[i] + carry;
+                    u[i+j] = t AND HALFMASK;
+                    carry = t >> HALFBITS;
+                }
+                u[j+n] = (u[j+n] + carry) AND HALFMASK;
+            }
+            q[j] = qhat;
+        }
+        /* denormalize the remainder */
+        if (s > 0)
+        {
+            for ( i = 0; i < n - 1; i++ )
+                u[i] = (u[i] >> s) | ((u[i+1] << (HALFBITS - s)) AND HALFMASK);
+            u[n-1] >>= s;
+        }
+        for ( i = n; i < 2 * size; i++ ) u[i] = 0;
+    }
+    for ( i = 0; i < size; i++ )
+    {
+        Q[i] = q[2*i] | (q[2*i+1] << HALFBITS);
+        R[i] = u[2*i] | (u[2*i+1] << HALFBITS);
+    }
+}
+
 ErrCode BitVector_Div_Pos(wordptr Q, wordptr X, wordptr Y, wordptr R)
 {
     N_word  bits = bits_(Q);
-    N_word  mask;
-    wordptr addr;
-    Z_long  last;
-    boolean flag;
-    boolean copy = FALSE; /* flags whether valid rest is in R (0) or X (1) */
+    N_word  size = size_(Q);
+    N_word  stack[BIT_VECTOR_DIV_STACK];
+    wordptr work = stack;
 
     /*
        Requirements:
@@ -2839,34 +3073,20 @@ ErrCode BitVector_Div_Pos(wordptr Q, wordptr X, wordptr Y, wordptr R)
         return(ErrCode_Zero);
 
     BitVector_Empty(R);
-    BitVector_Copy(Q,X);
-    if ((last = Set_Max(Q)) < 0L) return(ErrCode_Ok);
-    bits = (N_word) ++last;
-    while (bits-- > 0)
+    if (BitVector_is_empty(X))
     {
-        addr = Q + (bits >> LOGBITS);
-        mask = BITMASKTAB[bits AND MODMASK];
-        flag = ((*addr AND mask) != 0);
-        if (copy)
-        {
-            BitVector_shift_left(X,flag);
-            flag = FALSE;
-            BitVector_compute(R,X,Y,TRUE,&flag);
-        }
-        else
-        {
-            BitVector_shift_left(R,flag);
-            flag = FALSE;
-            BitVector_compute(X,R,Y,TRUE,&flag);
-        }
-        if (flag) *addr &= NOT mask;
-        else
-        {
-            *addr |= mask;
-            copy = not copy;
-        }
+        BitVector_Empty(Q);
+        return(ErrCode_Ok);
+    }
+    /* dividend (plus one digit), divisor and quotient, as half-words */
+    if ((6 * size + 1) > BIT_VECTOR_DIV_STACK)
+    {
+        work = (wordptr) yasm_xmalloc((size_t) ((6 * size + 1) << FACTOR));
+        if (work == NULL) return(ErrCode_Null);
     }
-    if (copy) BitVector_Copy(R,X);
+    BIT_VECTOR_div_digits(Q,X,Y,R,work,work + 2 * size + 1,
+                          work + 4 * size + 1);
+    if (work != stack) yasm_xfree(work);
     return(ErrCode_Ok);
 }
 
@@ -3578,12 +3798,7 @@ Z_long Set_Min(wordptr addr)                                /* = min(X)      */
     }
     if (empty) return((Z_long) LONG_MAX);                  /* plus infinity  */
     i <<= LOGBITS;
-    while (not (c AND LSB))
-    {
-        c >>= 1;
-        i++;
-    }
-    return((Z_long) i);
+    return((Z_long) (i + BIT_VECTOR_lsb_index(c)));
 }
 
 Z_long Set_Max(wordptr addr)                                /* = max(X)      */
@@ -3599,13 +3814,8 @@ Z_long Set_Max(wordptr addr)                                /* = max(X)      */
         if ((c = *addr--)) empty = false; else i--;
     }
     if (empty) return((Z_long) LONG_MIN);                  /* minus infinity */
-    i <<= LOGBITS;
-    while (not (c AND MSB))
-    {
-        c <<= 1;
-        i--;
-    }
-    return((Z_long) --i);
+    i = (i - 1) << LOGBITS;
+    return((Z_long) (i + BIT_VECTOR_msb_index(c)));
 }
 
     /**********************************/
@@ -38,6 +38,74 @@
 #include "bytecode.h"
 
 
+/* Bytecodes are allocated from chunks rather than individually, so that
+ * bytecodes created one after another (e.g. the contents of a section, as
+ * parsed) are adjacent in memory and full passes over a section's bytecodes
+ * walk memory sequentially.  Slots of destroyed bytecodes are not reused
+ * individually; a chunk is freed once all of its bytecodes have been
+ * destroyed, except for the current chunk, which starts over from its
+ * first slot instead.
+ */
+#define BC_CHUNK_SIZE   256
+
+struct yasm_bc_chunk {
+    unsigned int used;          /* slots handed out */
+    unsigned int live;          /* slots handed out and not yet destroyed */
+    yasm_bytecode bcs[BC_CHUNK_SIZE];
+};
+
+/* Chunk new bytecodes are allocated from */
+static /*@null@*/ /*@owned@*/ struct yasm_bc_chunk *bc_cur_chunk = NULL;
+
+static /*@only@*/ yasm_bytecode *
+bc_alloc(void)
+{
+    yasm_bytecode *bc;
+
+    if (!bc_cur_chunk || bc_cur_chunk->used == BC_CHUNK_SIZE) {
+        /* Current chunk (if any) is now owned by its live bytecodes */
+        bc_cur_chunk = yasm_xmalloc(sizeof(struct yasm_bc_chunk));
+        bc_cur_chunk->used = 0;
+        bc_cur_chunk->live = 0;
+    }
+
+    bc = &bc_cur_chunk->bcs[bc_cur_chunk->used++];
+    bc_cur_chunk->live++;
+    bc->chunk = bc_cur_chunk;
+    return bc;
+}
+
+static void
+bc_free(/*@only@*/ yasm_bytecode *bc)
+{
+    struct yasm_bc_chunk *chunk = bc->chunk;
+
+    if (--chunk->live > 0)
+        return;
+    if (chunk == bc_cur_chunk) {
+        /* Nothing live; start over at the beginning of the chunk.  This is
+         * safe because every slot handed out from it has been destroyed, so
+         * nothing can still point into it; it's the same as allocating a
+         * fresh chunk, without the free and malloc when a lone bytecode is
+         * repeatedly created and destroyed.
+         */
+        chunk->used = 0;
+        return;
+    }
+    yasm_xfree(chunk);
+}
+
+void
+yasm_bc__release_chunk(void)
+{
+    if (!bc_cur_chunk)
+        return;
+    if (bc_cur_chunk->live == 0)
+        yasm_xfree(bc_cur_chunk);
+    /* Otherwise the last bc_free() of the chunk frees it */
+    bc_cur_chunk = NULL;
+}
+
 void
 yasm_bc_set_multiple(yasm_bytecode *bc, yasm_expr *e)
 {
@@ -96,7 +164,7 @@ yasm_bytecode *
 yasm_bc_create_common(const yasm_bytecode_callback *callback, void *contents,
                       unsigned long line)
 {
-    yasm_bytecode *bc = yasm_xmalloc(sizeof(yasm_bytecode));
+    yasm_bytecode *bc = bc_alloc();
 
     bc->callback = callback;
     bc->section = NULL;
@@ -149,7 +217,7 @@ yasm_bc_destroy(yasm_bytecode *bc)
     yasm_expr_destroy(bc->multiple);
     if (bc->symrecs)
         yasm_xfree(bc->symrecs);
-    yasm_xfree(bc);
+    bc_free(bc);
 }
 
 void
@@ -297,6 +365,28 @@ yasm_bc_expand(yasm_bytecode *bc, int span, long old_val, long new_val,
                                     pos_thres);
 }
 
+/* Output copies first through bc->mult_int-1 of a bytecode. */
+static void
+bc_tobytes_copies(yasm_bytecode *bc, unsigned char *destbuf,
+                  unsigned char *bufstart, long first, void *d,
+                  yasm_output_value_func output_value,
+                  /*@null@*/ yasm_output_reloc_func output_reloc)
+{
+    unsigned char *origbuf;
+    long i;
+    int error;
+
+    for (i=first; i<bc->mult_int; i++) {
+        origbuf = destbuf;
+        error = bc->callback->tobytes(bc, &destbuf, bufstart, d, output_value,
+                                      output_reloc);
+
+        if (!error && ((unsigned long)(destbuf - origbuf) != bc->len))
+            yasm_internal_error(
+                N_("written length does not match optimized length"));
+    }
+}
+
 /*@null@*/ /*@only@*/ unsigned char *
 yasm_bc_tobytes(yasm_bytecode *bc, unsigned char *buf, unsigned long *bufsize,
                 /*@out@*/ int *gap, void *d,
@@ -305,10 +395,7 @@ yasm_bc_tobytes(yasm_bytecode *bc, unsigned char *buf, unsigned long *bufsize,
     /*@sets *buf@*/
 {
     /*@only@*/ /*@null@*/ unsigned char *mybuf = NULL;
-    unsigned char *bufstart;
-    unsigned char *origbuf, *destbuf;
-    long i;
-    int error = 0;
+    unsigned char *destbuf;
 
     long mult;
     if (yasm_bc_get_multiple(bc, &mult, 1) || mult == 0) {
@@ -330,23 +417,140 @@ yasm_bc_tobytes(yasm_bytecode *bc, unsigned char *buf, unsigned long *bufsize,
         destbuf = mybuf;
     } else
         destbuf = buf;
-    bufstart = destbuf;
 
     *bufsize = bc->len*bc->mult_int;
 
     if (!bc->callback)
         yasm_internal_error(N_("got empty bytecode in bc_tobytes"));
-    else for (i=0; i<bc->mult_int; i++) {
-        origbuf = destbuf;
-        error = bc->callback->tobytes(bc, &destbuf, bufstart, d, output_value,
-                                      output_reloc);
+    else
+        bc_tobytes_copies(bc, destbuf, destbuf, 0, d, output_value,
+                          output_reloc);
 
-        if (!error && ((unsigned long)(destbuf - origbuf) != bc->len))
-            yasm_internal_error(
-                N_("written length does not match optimized length"));
+    return mybuf;
+}
+
+/* Passed to the tobytes callback by yasm_bc_tobytes_rep() in place of the
+ * real output functions, to find out whether every copy of a bytecode would
+ * have the same byte representation.
+ */
+typedef struct bc_tobytes_rep_info {
+    /*@null@*/ void *d;
+    yasm_output_value_func output_value;
+    /*@null@*/ yasm_output_reloc_func output_reloc;
+    int varies;         /* output may differ between copies */
+} bc_tobytes_rep_info;
+
+static int
+bc_tobytes_rep_value(yasm_value *value, unsigned char *buf,
+                     unsigned int destsize, unsigned long offset,
+                     yasm_bytecode *bc, int warn, /*@null@*/ void *d)
+{
+    bc_tobytes_rep_info *info = (bc_tobytes_rep_info *)d;
+
+    /* Anything relative to a symbol or to the current position depends on
+     * the offset of the copy (and may generate a relocation).
+     */
+    if (value->rel || value->wrt || value->seg_of || value->curpos_rel)
+        info->varies = 1;
+    return info->output_value(value, buf, destsize, offset, bc, warn,
+                              info->d);
+}
+
+static int
+bc_tobytes_rep_reloc(yasm_symrec *sym, yasm_bytecode *bc, unsigned char *buf,
+                     unsigned int destsize, unsigned int valsize, int warn,
+                     void *d)
+{
+    bc_tobytes_rep_info *info = (bc_tobytes_rep_info *)d;
+    info->varies = 1;
+    return info->output_reloc(sym, bc, buf, destsize, valsize, warn, info->d);
+}
+
+const unsigned char *
+yasm_bc_tobytes_rep(yasm_bytecode *bc, unsigned char *buf,
+                    unsigned long *bufsize, /*@out@*/ unsigned long *multiple,
+                    /*@out@*/ int *gap, /*@out@*/ unsigned char **bigbuf,
+                    void *d, yasm_output_value_func output_value,
+                    /*@null@*/ yasm_output_reloc_func output_reloc)
+    /*@sets *buf@*/
+{
+    /*@only@*/ /*@null@*/ unsigned char *mybuf = NULL;
+    /*@dependent@*/ /*@null@*/ const unsigned char *data;
+    unsigned char *bufstart, *destbuf;
+    bc_tobytes_rep_info info;
+    long mult;
+    int error;
+
+    *multiple = 1;
+    *bigbuf = NULL;
+
+    /* Data already in memory (e.g. included files) is output as is. */
+    if (bc->len > 0 && bc->callback && bc->callback->get_bytes
+        && (data = bc->callback->get_bytes(bc))
+        && !yasm_bc_get_multiple(bc, &mult, 1)) {
+        bc->mult_int = mult;
+        *bufsize = bc->len;
+        *multiple = (unsigned long)mult;
+        *gap = 0;
+        return data;
     }
 
-    return mybuf;
+    /* Only worth trying with more than one copy.  Pending warnings would
+     * hide any the first copy produces, so don't try then either.
+     */
+    if (!bc->callback || bc->callback->special == YASM_BC_SPECIAL_RESERVE
+        || yasm_warn_occurred() || yasm_bc_get_multiple(bc, &mult, 1)
+        || mult <= 1 || bc->len == 0) {
+        *bigbuf = yasm_bc_tobytes(bc, buf, bufsize, gap, d, output_value,
+                                  output_reloc);
+        return *bigbuf ? *bigbuf : buf;
+    }
+    bc->mult_int = mult;
+    *gap = 0;
+
+    /* Output the first copy, watching whether it depends on its offset.
+     * It's output just as yasm_bc_tobytes() would, so if the copies can't
+     * be shared the rest can simply be added after it.
+     */
+    if (*bufsize < bc->len) {
+        mybuf = yasm_xmalloc(bc->len);
+        destbuf = mybuf;
+    } else
+        destbuf = buf;
+    bufstart = destbuf;
+
+    info.d = d;
+    info.output_value = output_value;
+    info.output_reloc = output_reloc;
+    info.varies = 0;
+    error = bc->callback->tobytes(bc, &destbuf, bufstart, &info,
+                                  bc_tobytes_rep_value,
+                                  output_reloc ? bc_tobytes_rep_reloc : NULL);
+    if (!error && ((unsigned long)(destbuf - bufstart) != bc->len))
+        yasm_internal_error(
+            N_("written length does not match optimized length"));
+
+    if (!error && !info.varies && !yasm_warn_occurred()) {
+        *bufsize = bc->len;
+        *multiple = (unsigned long)mult;
+        *bigbuf = mybuf;
+        return mybuf ? mybuf : buf;
+    }
+
+    /* Output the remaining copies individually after the first. */
+    if (*bufsize < bc->len*bc->mult_int) {
+        unsigned char *fullbuf = yasm_xmalloc(bc->len*bc->mult_int);
+        memcpy(fullbuf, bufstart, bc->len);
+        if (mybuf)
+            yasm_xfree(mybuf);
+        mybuf = fullbuf;
+        bufstart = fullbuf;
+    }
+    *bufsize = bc->len*bc->mult_int;
+    bc_tobytes_copies(bc, bufstart+bc->len, bufstart, 1, d, output_value,
+                      output_reloc);
+    *bigbuf = mybuf;
+    return mybuf ? mybuf : buf;
 }
 
 int
@@ -177,6 +177,18 @@ typedef struct yasm_bytecode_callback {
         /** Instruction bytecode. */
         YASM_BC_SPECIAL_INSN
     } special;
+
+    /** Gets the byte representation of a bytecode that is already in
+     * memory as is (e.g. data of an included file), so yasm_bc_tobytes_rep()
+     * can return it without copying.  May be NULL if the byte representation
+     * is always generated by tobytes().
+     * \param bc            bytecode
+     * \return The bc->len bytes of one copy of the bytecode's byte
+     *         representation, or NULL if not available (tobytes() is then
+     *         used).
+     */
+    /*@null@*/ /*@dependent@*/ const unsigned char * (*get_bytes)
+        (yasm_bytecode *bc);
 } yasm_bytecode_callback;
 
 /** A bytecode. */
@@ -225,6 +237,10 @@ struct yasm_bytecode {
 
     /** Implementation-specific data (type identified by callback). */
     void *contents;
+
+    /** Allocation chunk containing this bytecode.  Internal to bytecode.c.
+     */
+    /*@dependent@*/ struct yasm_bc_chunk *chunk;
 };
 
 /** Create a bytecode of any specified type.
@@ -376,6 +392,19 @@ YASM_LIB_DECL
      /*@keep@*/ /*@null@*/ yasm_expr *maxskip,
      /*@null@*/ const unsigned char **code_fill, unsigned long line);
 
+/** Get the alignment of an align bytecode that uses code fill (if possible).
+ * \param bc            bytecode
+ * \param boundary      byte alignment (output)
+ * \param maxskip       maximum number of bytes to skip (output); set to
+ *                      boundary if there is no maximum
+ * \return Nonzero if bc is an align bytecode with constant parameters that
+ *         is filled with code_fill, otherwise 0.
+ */
+YASM_LIB_DECL
+int yasm_bc_get_code_align(yasm_bytecode *bc,
+                           /*@out@*/ unsigned long *boundary,
+                           /*@out@*/ unsigned long *maxskip);
+
 /** Create a bytecode that puts the following bytecode at a fixed section
  * offset.
  * \param start         section offset of following bytecode
@@ -404,6 +433,13 @@ YASM_LIB_DECL
 YASM_LIB_DECL
 void yasm_bc__add_symrec(yasm_bytecode *bc, /*@dependent@*/ yasm_symrec *sym);
 
+/** Release the chunk new bytecodes are currently allocated from.  If
+ * bytecodes allocated from it are still live, it is freed along with the
+ * last of them instead.  For object use only.
+ */
+YASM_LIB_DECL
+void yasm_bc__release_chunk(void);
+
 /** Delete (free allocated memory for) a bytecode.
  * \param bc    bytecode (only pointer to it); may be NULL
  */
@@ -515,6 +551,41 @@ YASM_LIB_DECL
      /*@null@*/ yasm_output_reloc_func output_reloc)
     /*@sets *buf@*/;
 
+/** Convert a bytecode into its byte representation, producing only a single
+ * copy when all copies of a multiple (e.g. TIMES) bytecode are identical.
+ * The caller must output the returned bytes \a multiple times in a row.
+ * Falls back to yasm_bc_tobytes() (and a \a multiple of 1) when the copies
+ * may differ, for example when they contain relocations or PC-relative
+ * values.  Data already held in memory, such as that of an incbin, is
+ * returned in place rather than copied into buf.
+ * \param bc            bytecode
+ * \param buf           byte representation destination buffer
+ * \param bufsize       size of buf (in bytes) prior to call; size of the
+ *                      generated data (one copy) after call
+ * \param multiple      number of copies to output [output]
+ * \param gap           if nonzero, indicates the data does not really need to
+ *                      exist in the object file; if nonzero, contents of buf
+ *                      are undefined [output]
+ * \param bigbuf        newly allocated buffer holding the byte representation
+ *                      if buf was not big enough, otherwise NULL; the caller
+ *                      must free it [output]
+ * \param d             data to pass to each call to output_value/output_reloc
+ * \param output_value  function to call to convert values into their byte
+ *                      representation
+ * \param output_reloc  function to call to output relocation entries
+ *                      for a single sym
+ * \return The byte representation: buf, *bigbuf, or data owned by the
+ *         bytecode.
+ */
+YASM_LIB_DECL
+/*@dependent@*/ const unsigned char *yasm_bc_tobytes_rep
+    (yasm_bytecode *bc, unsigned char *buf, unsigned long *bufsize,
+     /*@out@*/ unsigned long *multiple, /*@out@*/ int *gap,
+     /*@out@*/ /*@only@*/ /*@null@*/ unsigned char **bigbuf, void *d,
+     yasm_output_value_func output_value,
+     /*@null@*/ yasm_output_reloc_func output_reloc)
+    /*@sets *buf@*/;
+
 /** Get the bytecode multiple value as an integer.
  * \param bc            bytecode
  * \param multiple      multiple value (output)
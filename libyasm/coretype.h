@@ -84,6 +84,19 @@ typedef struct yasm_assoc_data_callback {
     void (*print) (void *data, FILE *f, int indent_level);
 } yasm_assoc_data_callback;
 
+/** Register an associated data callback and get its slot number.  Modules
+ * that look up their associated data often should register their callbacks
+ * when they're created, keep the slots, and look up data with
+ * yasm_section_get_slot_data() and yasm_symrec_get_slot_data(), which index
+ * the data directly rather than looking up the callback.  Registering the
+ * same callback again returns the same slot.
+ * \param callback      callback
+ * \return Slot number (never 0).
+ */
+YASM_LIB_DECL
+unsigned int yasm_assoc_data_register
+    (const yasm_assoc_data_callback *callback);
+
 /** Set of collected error/warnings (opaque type).
  * \see errwarn.h for details.
  */
@@ -191,6 +204,16 @@ typedef struct yasm_value {
  */
 typedef struct yasm_linemap yasm_linemap;
 
+/** In-memory output file image (opaque type).  \see file.h for related
+ * functions.
+ */
+typedef struct yasm_outbuf yasm_outbuf;
+
+/** Contents of a file read or mapped into memory (opaque type).  \see file.h
+ * for related functions.
+ */
+typedef struct yasm_mapfile yasm_mapfile;
+
 /** Value/parameter pair (opaque type).
  * \see valparam.h for related functions.
  */
@@ -351,6 +374,59 @@ YASM_LIB_DECL
 YASM_LIB_DECL
 /*@only@*/ char *yasm__xstrndup(const char *str, size_t max);
 
+/** Intern a string.  Equal strings are interned to the same pointer, so
+ * interned strings can be compared by pointer.
+ * \internal
+ * \param str   string
+ * \return Interned copy of str; valid until yasm__intern_cleanup().
+ */
+YASM_LIB_DECL
+/*@dependent@*/ const char *yasm__intern(const char *str);
+
+/** Intern a string given its length.
+ * \internal
+ * \param str   string (need not be NUL-terminated)
+ * \param len   length of string
+ * \return Interned (NUL-terminated) copy of str; valid until
+ *         yasm__intern_cleanup().
+ */
+YASM_LIB_DECL
+/*@dependent@*/ const char *yasm__internn(const char *str, size_t len);
+
+/** Look up an already interned string without interning it.
+ * \internal
+ * \param str   string
+ * \return Interned copy of str, or NULL if str has not been interned.
+ */
+YASM_LIB_DECL
+/*@dependent@*/ /*@null@*/ const char *yasm__intern_find(const char *str);
+
+/** Look up an already interned string given its length, without interning
+ * it.
+ * \internal
+ * \param str   string (need not be NUL-terminated)
+ * \param len   length of string
+ * \return Interned copy of str, or NULL if str has not been interned.
+ */
+YASM_LIB_DECL
+/*@dependent@*/ /*@null@*/ const char *yasm__intern_findn(const char *str,
+                                                         size_t len);
+
+/** Get the hash of an interned string.
+ * \internal
+ * \param istr  interned string (from yasm__intern() or yasm__internn())
+ * \return Hash value of the string.
+ */
+YASM_LIB_DECL
+unsigned long yasm__intern_hash(const char *istr);
+
+/** Free all interned strings.  Call after everything referencing interned
+ * strings (symbol tables, sections, line maps) has been destroyed.
+ * \internal
+ */
+YASM_LIB_DECL
+void yasm__intern_cleanup(void);
+
 /** Error-checking memory allocation.  A default implementation is provided
  * that calls yasm_fatal() on allocation errors.
  * A replacement should \em never return NULL.
@@ -819,8 +819,17 @@ expr_expand_equ(yasm_expr *e, yasm__exprhead *eh)
         /* Expand equ's. */
         if (e->terms[i].type == YASM_EXPR_SYM &&
             (equ_expr = yasm_symrec_get_equ(e->terms[i].data.sym))) {
+            const yasm_intnum *equ_intn;
             yasm__exprentry *np;
 
+            /* Constant EQUs are simplified once and remembered */
+            equ_intn = yasm_symrec__get_equ_intnum(e->terms[i].data.sym);
+            if (equ_intn) {
+                e->terms[i].type = YASM_EXPR_INT;
+                e->terms[i].data.intn = yasm_intnum_copy(equ_intn);
+                continue;
+            }
+
             /* Check for circular reference */
             SLIST_FOREACH(np, eh, next) {
                 if (np->e == equ_expr) {
@@ -43,6 +43,14 @@
 #include <sys/stat.h>
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include <ctype.h>
 #include <errno.h>
 
@@ -534,18 +542,21 @@ typedef struct incpath {
 
 STAILQ_HEAD(incpath_head, incpath) incpaths = STAILQ_HEAD_INITIALIZER(incpaths);
 
-FILE *
-yasm_fopen_include(const char *iname, const char *from, const char *mode,
-                   char **oname)
+/* Try opening iname directly relative to from first, then relative to each
+ * of the include paths.  The first successful open wins.
+ */
+static /*@null@*/ void *
+include_search(const char *iname, const char *from,
+               void *(*open_func) (const char *path, const void *d),
+               const void *d, /*@null@*/ /*@out@*/ char **oname)
 {
-    FILE *f;
+    void *f;
     char *combine;
     incpath *np;
 
-    /* Try directly relative to from first, then each of the include paths */
     if (from) {
         combine = yasm__combpath(from, iname);
-        f = fopen(combine, mode);
+        f = open_func(combine, d);
         if (f) {
             if (oname)
                 *oname = combine;
@@ -558,7 +569,7 @@ yasm_fopen_include(const char *iname, const char *from, const char *mode,
 
     STAILQ_FOREACH(np, &incpaths, link) {
         combine = yasm__combpath(np->path, iname);
-        f = fopen(combine, mode);
+        f = open_func(combine, d);
         if (f) {
             if (oname)
                 *oname = combine;
@@ -574,6 +585,19 @@ yasm_fopen_include(const char *iname, const char *from, const char *mode,
     return NULL;
 }
 
+static void *
+include_fopen(const char *path, const void *mode)
+{
+    return fopen(path, (const char *)mode);
+}
+
+FILE *
+yasm_fopen_include(const char *iname, const char *from, const char *mode,
+                   char **oname)
+{
+    return include_search(iname, from, include_fopen, mode, oname);
+}
+
 void
 yasm_delete_include_paths(void)
 {
@@ -670,3 +694,413 @@ yasm_fwrite_32_b(unsigned long val, FILE *f)
         return 0;
     return 1;
 }
+
+/* The image is kept as a table of fixed-size pages.  Pages are only
+ * allocated once something is written into them; parts of the image that
+ * have only been seeked over or zero-filled are holes (NULL pages), so a
+ * large gap between sections costs a table entry per page rather than
+ * the memory for the gap itself.  Bytes in allocated pages past the end of
+ * the image are always zero.
+ */
+#define OUTBUF_PAGE_SIZE    4096UL
+
+struct yasm_outbuf {
+    /*@only@*/ /*@null@*/ unsigned char **pages;
+    unsigned long npages;       /* number of entries in pages */
+    unsigned long size;         /* size of image (highest offset written) */
+    unsigned long pos;          /* current position */
+};
+
+yasm_outbuf *
+yasm_outbuf_create(void)
+{
+    yasm_outbuf *ob = yasm_xmalloc(sizeof(yasm_outbuf));
+    ob->pages = NULL;
+    ob->npages = 0;
+    ob->size = 0;
+    ob->pos = 0;
+    return ob;
+}
+
+void
+yasm_outbuf_destroy(yasm_outbuf *ob)
+{
+    unsigned long i;
+
+    for (i = 0; i < ob->npages; i++) {
+        if (ob->pages[i])
+            yasm_xfree(ob->pages[i]);
+    }
+    if (ob->pages)
+        yasm_xfree(ob->pages);
+    yasm_xfree(ob);
+}
+
+/* Advance the current position past len bytes, making sure the page table
+ * covers them.  Returns the position the bytes start at.
+ */
+static unsigned long
+outbuf_advance(yasm_outbuf *ob, unsigned long len)
+{
+    unsigned long start = ob->pos, end = ob->pos + len, need;
+
+    if (end < start)
+        yasm__fatal(N_("output file too large"));
+
+    need = end/OUTBUF_PAGE_SIZE + (end%OUTBUF_PAGE_SIZE != 0);
+    if (need > ob->npages) {
+        unsigned long n = ob->npages ? ob->npages : 16;
+        while (n < need) {
+            if (n*2 < n)
+                yasm__fatal(N_("output file too large"));
+            n *= 2;
+        }
+        if (n > ((size_t)-1)/sizeof(unsigned char *))
+            yasm__fatal(N_("output file too large"));
+        ob->pages = yasm_xrealloc(ob->pages, (size_t)n*sizeof(unsigned char *));
+        memset(ob->pages + ob->npages, 0,
+               (size_t)(n - ob->npages)*sizeof(unsigned char *));
+        ob->npages = n;
+    }
+
+    ob->pos = end;
+    if (end > ob->size)
+        ob->size = end;
+    return start;
+}
+
+/* Get the page containing offset pos, allocating it if it's a hole. */
+static unsigned char *
+outbuf_page(yasm_outbuf *ob, unsigned long pos)
+{
+    unsigned char **page = &ob->pages[pos/OUTBUF_PAGE_SIZE];
+    if (!*page)
+        *page = yasm_xcalloc(OUTBUF_PAGE_SIZE, 1);
+    return *page;
+}
+
+void
+yasm_outbuf_write(yasm_outbuf *ob, const void *buf, size_t len)
+{
+    const unsigned char *src = buf;
+    unsigned long pos = outbuf_advance(ob, (unsigned long)len);
+
+    while (len > 0) {
+        unsigned long ofs = pos % OUTBUF_PAGE_SIZE;
+        size_t n = (size_t)(OUTBUF_PAGE_SIZE - ofs);
+        if (n > len)
+            n = len;
+        memcpy(outbuf_page(ob, pos) + ofs, src, n);
+        src += n;
+        pos += (unsigned long)n;
+        len -= n;
+    }
+}
+
+void
+yasm_outbuf_write_rep(yasm_outbuf *ob, const void *buf, size_t len,
+                      unsigned long count)
+{
+    unsigned char block[OUTBUF_PAGE_SIZE];
+    unsigned long total, per, blocklen, done;
+
+    if (len == 0 || count == 0)
+        return;
+    if ((unsigned long)len != len || (unsigned long)len*count/count != len)
+        yasm__fatal(N_("output file too large"));
+    total = (unsigned long)len*count;
+
+    if (len > sizeof(block)) {
+        while (count-- > 0)
+            yasm_outbuf_write(ob, buf, len);
+        return;
+    }
+
+    /* Fill a block with as many whole copies as fit (doubling what's been
+     * copied so far), then write the block repeatedly.
+     */
+    per = (unsigned long)(sizeof(block)/len);
+    if (per > count)
+        per = count;
+    blocklen = per*(unsigned long)len;
+    memcpy(block, buf, len);
+    done = (unsigned long)len;
+    while (done < blocklen) {
+        unsigned long n = done;
+        if (n > blocklen-done)
+            n = blocklen-done;
+        memcpy(block+done, block, (size_t)n);
+        done += n;
+    }
+    for (done = 0; total-done >= blocklen; done += blocklen)
+        yasm_outbuf_write(ob, block, (size_t)blocklen);
+    if (done < total)
+        yasm_outbuf_write(ob, block, (size_t)(total-done));
+}
+
+void
+yasm_outbuf_write_zeros(yasm_outbuf *ob, unsigned long len)
+{
+    unsigned long pos = outbuf_advance(ob, len);
+
+    /* Only pages that already exist need clearing; holes read as zero. */
+    while (len > 0) {
+        unsigned long ofs = pos % OUTBUF_PAGE_SIZE;
+        unsigned long n = OUTBUF_PAGE_SIZE - ofs;
+        unsigned char *page = ob->pages[pos/OUTBUF_PAGE_SIZE];
+        if (n > len)
+            n = len;
+        if (page)
+            memset(page + ofs, 0, (size_t)n);
+        pos += n;
+        len -= n;
+    }
+}
+
+unsigned long
+yasm_outbuf_tell(const yasm_outbuf *ob)
+{
+    return ob->pos;
+}
+
+void
+yasm_outbuf_seek(yasm_outbuf *ob, unsigned long pos)
+{
+    ob->pos = pos;
+}
+
+unsigned long
+yasm_outbuf_size(const yasm_outbuf *ob)
+{
+    return ob->size;
+}
+
+void
+yasm_outbuf_truncate(yasm_outbuf *ob, unsigned long size)
+{
+    unsigned long i;
+
+    if (size >= ob->size)
+        return;
+
+    /* Keep bytes past the end zero: clear the tail of the page holding the
+     * new end and free the pages wholly past it.
+     */
+    i = size/OUTBUF_PAGE_SIZE;
+    if (size%OUTBUF_PAGE_SIZE != 0) {
+        if (ob->pages[i])
+            memset(ob->pages[i] + size%OUTBUF_PAGE_SIZE, 0,
+                   (size_t)(OUTBUF_PAGE_SIZE - size%OUTBUF_PAGE_SIZE));
+        i++;
+    }
+    for (; i < ob->npages; i++) {
+        if (ob->pages[i]) {
+            yasm_xfree(ob->pages[i]);
+            ob->pages[i] = NULL;
+        }
+    }
+    ob->size = size;
+}
+
+struct yasm_mapfile {
+    /*@null@*/ unsigned char *data;
+    unsigned long size;
+    int mapped;                 /* data is mmap'ed rather than allocated */
+};
+
+yasm_mapfile *
+yasm_mapfile_create(const char *filename)
+{
+    yasm_mapfile *mf;
+    FILE *f;
+
+#ifdef HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        void *data;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+            && (off_t)(size_t)st.st_size == st.st_size) {
+            data = NULL;
+            if (st.st_size > 0)
+                data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                            fd, 0);
+            if (data != MAP_FAILED) {
+                close(fd);
+                mf = yasm_xmalloc(sizeof(yasm_mapfile));
+                mf->data = data;
+                mf->size = (unsigned long)st.st_size;
+                mf->mapped = (data != NULL);
+                return mf;
+            }
+        }
+        close(fd);
+    }
+    /* Fall back to reading the file */
+#endif
+
+    f = fopen(filename, "rb");
+    if (!f)
+        return NULL;
+    mf = yasm_mapfile_read(f);
+    fclose(f);
+    return mf;
+}
+
+static void *
+include_mapfile_create(const char *path, /*@unused@*/ const void *d)
+{
+    return yasm_mapfile_create(path);
+}
+
+yasm_mapfile *
+yasm_mapfile_create_include(const char *iname, const char *from,
+                            char **oname)
+{
+    return include_search(iname, from, include_mapfile_create, NULL, oname);
+}
+
+yasm_mapfile *
+yasm_mapfile_read(FILE *f)
+{
+    yasm_mapfile *mf;
+    unsigned long alloc = 4096;
+    long cur, end;
+    size_t n;
+
+    /* Size the buffer up front if the stream is seekable */
+    cur = ftell(f);
+    if (cur >= 0 && fseek(f, 0L, SEEK_END) == 0) {
+        end = ftell(f);
+        if (fseek(f, cur, SEEK_SET) != 0)
+            return NULL;
+        if (end > cur)
+            alloc = (unsigned long)(end - cur) + 1;
+    }
+
+    mf = yasm_xmalloc(sizeof(yasm_mapfile));
+    mf->data = yasm_xmalloc(alloc);
+    mf->size = 0;
+    mf->mapped = 0;
+    for (;;) {
+        n = fread(mf->data + mf->size, 1, (size_t)(alloc - mf->size), f);
+        mf->size += (unsigned long)n;
+        if (mf->size < alloc)
+            break;
+        alloc *= 2;
+        mf->data = yasm_xrealloc(mf->data, alloc);
+    }
+    if (ferror(f)) {
+        yasm_mapfile_destroy(mf);
+        return NULL;
+    }
+    return mf;
+}
+
+void
+yasm_mapfile_destroy(yasm_mapfile *mf)
+{
+#ifdef HAVE_MMAP
+    if (mf->mapped)
+        munmap((void *)mf->data, (size_t)mf->size);
+    else
+#endif
+    if (mf->data)
+        yasm_xfree(mf->data);
+    yasm_xfree(mf);
+}
+
+const unsigned char *
+yasm_mapfile_data(const yasm_mapfile *mf)
+{
+    return mf->data;
+}
+
+unsigned long
+yasm_mapfile_size(const yasm_mapfile *mf)
+{
+    return mf->size;
+}
+
+const char *
+yasm_mapfile_get_line(const yasm_mapfile *mf, unsigned long *pos,
+                      size_t *len)
+{
+    const char *line, *eol;
+    unsigned long left;
+
+    if (*pos >= mf->size)
+        return NULL;
+
+    line = (const char *)mf->data + *pos;
+    left = mf->size - *pos;
+    eol = memchr(line, '\n', (size_t)left);
+    if (eol) {
+        *len = (size_t)(eol - line);
+        *pos += (unsigned long)*len + 1;
+    } else {
+        *len = (size_t)left;
+        *pos = mf->size;
+    }
+    return line;
+}
+
+/* Skip len bytes of a hole when flushing.  Returns 0 if the file can't be
+ * seeked (pipes and terminals), in which case nothing has been skipped.
+ */
+static int
+outbuf_skip(FILE *f, unsigned long len)
+{
+    /* fseek() takes a long, which may be only 32 bits. */
+    while (len > 0) {
+        unsigned long n = len;
+        if (n > 0x40000000UL)
+            n = 0x40000000UL;
+        if (fseek(f, (long)n, SEEK_CUR) != 0)
+            return 0;
+        len -= n;
+    }
+    return 1;
+}
+
+size_t
+yasm_outbuf_flush(const yasm_outbuf *ob, FILE *f)
+{
+    static const unsigned char zeros[OUTBUF_PAGE_SIZE];
+    unsigned long pos, skip = 0;    /* skip = length of hole not yet passed */
+    int can_seek = (f != stdout);   /* might be appending */
+
+    for (pos = 0; pos < ob->size; pos += OUTBUF_PAGE_SIZE) {
+        const unsigned char *page = ob->pages[pos/OUTBUF_PAGE_SIZE];
+        unsigned long n = ob->size - pos;
+        if (n > OUTBUF_PAGE_SIZE)
+            n = OUTBUF_PAGE_SIZE;
+
+        if (!page && can_seek) {
+            if (pos + n < ob->size) {
+                skip += n;
+                continue;
+            }
+            /* Always write the last byte so the file has the right size. */
+            skip += n-1;
+            n = 1;
+        }
+        if (skip > 0) {
+            if (!outbuf_skip(f, skip)) {
+                /* Go back to writing zeros from here on. */
+                can_seek = 0;
+                for (; skip > OUTBUF_PAGE_SIZE; skip -= OUTBUF_PAGE_SIZE) {
+                    if (fwrite(zeros, OUTBUF_PAGE_SIZE, 1, f) != 1)
+                        return 0;
+                }
+                if (fwrite(zeros, (size_t)skip, 1, f) != 1)
+                    return 0;
+            }
+            skip = 0;
+        }
+        if (fwrite(page ? page : zeros, (size_t)n, 1, f) != 1)
+            return 0;
+    }
+    return 1;
+}
@@ -402,6 +402,156 @@ size_t yasm_fwrite_16_b(unsigned short val, FILE *f);
 YASM_LIB_DECL
 size_t yasm_fwrite_32_b(unsigned long val, FILE *f);
 
+/** Create an empty in-memory output image.  Object formats build their
+ * complete output in an image (seeking back to patch headers as needed)
+ * and then write it to the output file in one go with yasm_outbuf_flush().
+ * Memory is only used for the parts of the image actually written; parts
+ * that are seeked over or filled with yasm_outbuf_write_zeros() are kept
+ * as holes.
+ * \return Newly allocated image.
+ */
+YASM_LIB_DECL
+/*@only@*/ yasm_outbuf *yasm_outbuf_create(void);
+
+/** Destroy an output image.
+ * \param ob    output image
+ */
+YASM_LIB_DECL
+void yasm_outbuf_destroy(/*@only@*/ yasm_outbuf *ob);
+
+/** Write bytes to an output image at the current position, growing the image
+ * as needed.  Any gap between the previous end of the image and the current
+ * position is filled with zeros.
+ * \param ob    output image
+ * \param buf   data
+ * \param len   length of data in bytes
+ */
+YASM_LIB_DECL
+void yasm_outbuf_write(yasm_outbuf *ob, const void *buf, size_t len);
+
+/** Write several back-to-back copies of the same bytes to an output image,
+ * as with yasm_outbuf_write().
+ * \param ob    output image
+ * \param buf   data for one copy
+ * \param len   length of one copy in bytes
+ * \param count number of copies
+ */
+YASM_LIB_DECL
+void yasm_outbuf_write_rep(yasm_outbuf *ob, const void *buf, size_t len,
+                           unsigned long count);
+
+/** Write zero bytes to an output image, as with yasm_outbuf_write().
+ * \param ob    output image
+ * \param len   number of zero bytes
+ */
+YASM_LIB_DECL
+void yasm_outbuf_write_zeros(yasm_outbuf *ob, unsigned long len);
+
+/** Get the current position in an output image.
+ * \param ob    output image
+ * \return Offset from the start of the image.
+ */
+YASM_LIB_DECL
+unsigned long yasm_outbuf_tell(const yasm_outbuf *ob);
+
+/** Set the current position in an output image.  The position may be past
+ * the current end of the image.
+ * \param ob    output image
+ * \param pos   offset from the start of the image
+ */
+YASM_LIB_DECL
+void yasm_outbuf_seek(yasm_outbuf *ob, unsigned long pos);
+
+/** Get the size of an output image (the highest offset written so far).
+ * \param ob    output image
+ * \return Size in bytes.
+ */
+YASM_LIB_DECL
+unsigned long yasm_outbuf_size(const yasm_outbuf *ob);
+
+/** Discard everything in an output image past a given size.  The current
+ * position is not changed.
+ * \param ob    output image
+ * \param size  new size in bytes (no effect if not less than the current size)
+ */
+YASM_LIB_DECL
+void yasm_outbuf_truncate(yasm_outbuf *ob, unsigned long size);
+
+/** Write the complete contents of an output image to a file.  Holes in the
+ * image are seeked over rather than written (if the file supports seeking),
+ * so the file must be newly created or truncated.
+ * \param ob    output image
+ * \param f     file
+ * \return 1 if the write was successful, 0 if not (just like fwrite()).
+ */
+YASM_LIB_DECL
+size_t yasm_outbuf_flush(const yasm_outbuf *ob, FILE *f);
+
+/** Make the complete contents of a file available in memory for reading.
+ * The file is memory-mapped where supported, and otherwise read into a
+ * newly allocated buffer.
+ * \param filename  file name
+ * \return Newly allocated file contents, or NULL if the file could not be
+ *         opened or read.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@only@*/ yasm_mapfile *yasm_mapfile_create(const char *filename);
+
+/** Make the complete contents of an include file available in memory, as
+ * with yasm_mapfile_create().  The file is searched for in the same way as
+ * yasm_fopen_include(), and the first match that can be read wins.
+ * \param iname     file to include
+ * \param from      file doing the including
+ * \param oname     full pathname of included file (may be relative). NULL
+ *                  may be passed if this is unwanted.
+ * \return Newly allocated file contents, or NULL if not found.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@only@*/ yasm_mapfile *yasm_mapfile_create_include
+    (const char *iname, const char *from,
+     /*@null@*/ /*@out@*/ /*@only@*/ char **oname);
+
+/** Read the remaining contents of an open stream into memory.  Useful for
+ * streams that can't be mapped, such as standard input.
+ * \param f     stream
+ * \return Newly allocated contents, or NULL if a read error occurred.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@only@*/ yasm_mapfile *yasm_mapfile_read(FILE *f);
+
+/** Release the contents of a file.
+ * \param mf    file contents
+ */
+YASM_LIB_DECL
+void yasm_mapfile_destroy(/*@only@*/ yasm_mapfile *mf);
+
+/** Get the contents of a file.
+ * \param mf    file contents
+ * \return File data (may be NULL if the file is empty).
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@dependent@*/ const unsigned char *yasm_mapfile_data
+    (const yasm_mapfile *mf);
+
+/** Get the size of a file.
+ * \param mf    file contents
+ * \return Size in bytes.
+ */
+YASM_LIB_DECL
+unsigned long yasm_mapfile_size(const yasm_mapfile *mf);
+
+/** Get the next line of a file's contents, without copying it.  The line is
+ * not NUL-terminated and may end with a carriage return.
+ * \param mf    file contents
+ * \param pos   offset of the start of the line; updated to the start of the
+ *              following line
+ * \param len   length of the line, not including the newline [output]
+ * \return Start of the line, or NULL if at the end of the file.
+ */
+YASM_LIB_DECL
+/*@null@*/ /*@dependent@*/ const char *yasm_mapfile_get_line
+    (const yasm_mapfile *mf, unsigned long *pos, /*@out@*/ size_t *len);
+
 /** Read an 8-bit value from a buffer, incrementing buffer pointer.
  * \note Only works properly if ptr is an (unsigned char *).
  * \param ptr   buffer
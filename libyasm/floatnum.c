@@ -227,13 +227,85 @@ floatnum_normalize(yasm_floatnum *flt)
     flt->exponent -= (unsigned short)norm_amt;
 }
 
+/* The arithmetic in floatnum_mul() and yasm_floatnum_create() works on the
+ * mantissa as an array of 16-bit limbs (least significant first) rather
+ * than through BitVector calls.  16-bit limbs keep every partial product
+ * and carry within an unsigned long.
+ */
+#define MANT_LIMBS      (MANT_BITS/16)
+
+static void
+mant_read(/*@out@*/ unsigned long *limbs, const wordptr mantissa)
+{
+    int i;
+    for (i=0; i<MANT_LIMBS; i++)
+        limbs[i] = BitVector_Chunk_Read(mantissa, 16, (N_int)(i*16));
+}
+
+static void
+mant_write(wordptr mantissa, const unsigned long *limbs)
+{
+    int i;
+    for (i=0; i<MANT_LIMBS; i++)
+        BitVector_Chunk_Store(mantissa, 16, (N_int)(i*16), limbs[i]);
+}
+
+/* Index of the highest set bit in limbs[0..n-1], or -1 if all zero. */
+static long
+mant_max(const unsigned long *limbs, int n)
+{
+    int i;
+    for (i=n-1; i>=0; i--) {
+        if (limbs[i] != 0) {
+            unsigned long l = limbs[i];
+            long bit = (long)i*16;
+            while (l >>= 1)
+                bit++;
+            return bit;
+        }
+    }
+    return -1;
+}
+
+/* Shift limbs[0..n-1] left by amt bits, dropping bits shifted out the top. */
+static void
+mant_shift_left(unsigned long *limbs, int n, long amt)
+{
+    int words = (int)(amt/16), bits = (int)(amt%16);
+    int i;
+
+    for (i=n-1; i>=0; i--) {
+        unsigned long l = 0;
+        if (i-words >= 0)
+            l = limbs[i-words] << bits;
+        if (bits != 0 && i-words-1 >= 0)
+            l |= limbs[i-words-1] >> (16-bits);
+        limbs[i] = l & 0xFFFF;
+    }
+}
+
+/* limbs = limbs*10 + digit, dropping any overflow out of MANT_BITS */
+static void
+mant_mul10_add(unsigned long *limbs, unsigned int digit)
+{
+    unsigned long carry = digit;
+    int i;
+
+    for (i=0; i<MANT_LIMBS; i++) {
+        unsigned long t = limbs[i]*10 + carry;
+        limbs[i] = t & 0xFFFF;
+        carry = t >> 16;
+    }
+}
+
 /* acc *= op */
 static void
 floatnum_mul(yasm_floatnum *acc, const yasm_floatnum *op)
 {
     long expon;
-    wordptr product, op1, op2;
+    unsigned long op1[MANT_LIMBS], op2[MANT_LIMBS], product[MANT_LIMBS*2];
     long norm_amt;
+    int i, j;
 
     /* Compute the new sign */
     acc->sign ^= op->sign;
@@ -263,21 +335,20 @@ floatnum_mul(yasm_floatnum *acc, const yasm_floatnum *op)
     /* Add one to the final exponent, as the multiply shifts one extra time. */
     acc->exponent = (unsigned short)(expon+1);
 
-    /* Allocate space for the multiply result */
-    product = BitVector_Create((N_int)((MANT_BITS+1)*2), FALSE);
-
-    /* Allocate 1-bit-longer fields to force the operands to be unsigned */
-    op1 = BitVector_Create((N_int)(MANT_BITS+1), FALSE);
-    op2 = BitVector_Create((N_int)(MANT_BITS+1), FALSE);
-
-    /* Make the operands unsigned after copying from original operands */
-    BitVector_Copy(op1, acc->mantissa);
-    BitVector_MSB(op1, 0);
-    BitVector_Copy(op2, op->mantissa);
-    BitVector_MSB(op2, 0);
-
-    /* Compute the product of the mantissas */
-    BitVector_Multiply(product, op1, op2);
+    /* Compute the (unsigned) product of the mantissas */
+    mant_read(op1, acc->mantissa);
+    mant_read(op2, op->mantissa);
+    for (i=0; i<MANT_LIMBS*2; i++)
+        product[i] = 0;
+    for (i=0; i<MANT_LIMBS; i++) {
+        unsigned long carry = 0;
+        for (j=0; j<MANT_LIMBS; j++) {
+            unsigned long t = op1[i]*op2[j] + product[i+j] + carry;
+            product[i+j] = t & 0xFFFF;
+            carry = t >> 16;
+        }
+        product[i+MANT_LIMBS] = carry;
+    }
 
     /* Normalize the product.  Note: we know the product is non-zero because
      * both of the original operands were non-zero.
@@ -285,19 +356,14 @@ floatnum_mul(yasm_floatnum *acc, const yasm_floatnum *op)
      * Look for the highest set bit, shift to make it the MSB, and adjust
      * exponent.  Don't let exponent go negative.
      */
-    norm_amt = (MANT_BITS*2-1)-Set_Max(product);
+    norm_amt = (MANT_BITS*2-1)-mant_max(product, MANT_LIMBS*2);
     if (norm_amt > (long)acc->exponent)
         norm_amt = (long)acc->exponent;
-    BitVector_Move_Left(product, (N_int)norm_amt);
+    mant_shift_left(product, MANT_LIMBS*2, norm_amt);
     acc->exponent -= (unsigned short)norm_amt;
 
     /* Store the highest bits of the result */
-    BitVector_Interval_Copy(acc->mantissa, product, 0, MANT_BITS, MANT_BITS);
-
-    /* Free allocated variables */
-    BitVector_Destroy(product);
-    BitVector_Destroy(op1);
-    BitVector_Destroy(op2);
+    mant_write(acc->mantissa, &product[MANT_LIMBS]);
 }
 
 yasm_floatnum *
@@ -306,18 +372,18 @@ yasm_floatnum_create(const char *str)
     yasm_floatnum *flt;
     int dec_exponent, dec_exp_add;      /* decimal (powers of 10) exponent */
     int POT_index;
-    wordptr operand[2];
+    unsigned long mant[MANT_LIMBS];
     int sig_digits;
     int decimal_pt;
-    boolean carry;
+    int i;
 
     flt = yasm_xmalloc(sizeof(yasm_floatnum));
 
     flt->mantissa = BitVector_Create(MANT_BITS, TRUE);
 
-    /* allocate and initialize calculation variables */
-    operand[0] = BitVector_Create(MANT_BITS, TRUE);
-    operand[1] = BitVector_Create(MANT_BITS, TRUE);
+    /* initialize calculation variables */
+    for (i=0; i<MANT_LIMBS; i++)
+        mant[i] = 0;
     dec_exponent = 0;
     sig_digits = 0;
     decimal_pt = 1;
@@ -355,18 +421,8 @@ yasm_floatnum_create(const char *str)
         while (isdigit(*str)) {
             /* See if we've processed more than the max significant digits: */
             if (sig_digits < MANT_SIGDIGITS) {
-                /* Multiply mantissa by 10 [x = (x<<1)+(x<<3)] */
-                BitVector_shift_left(flt->mantissa, 0);
-                BitVector_Copy(operand[0], flt->mantissa);
-                BitVector_Move_Left(flt->mantissa, 2);
-                carry = 0;
-                BitVector_add(operand[1], operand[0], flt->mantissa, &carry);
-
-                /* Add in current digit */
-                BitVector_Empty(operand[0]);
-                BitVector_Chunk_Store(operand[0], 4, 0, (N_long)(*str-'0'));
-                carry = 0;
-                BitVector_add(flt->mantissa, operand[1], operand[0], &carry);
+                /* Multiply mantissa by 10 and add in current digit */
+                mant_mul10_add(mant, (unsigned int)(*str-'0'));
             } else {
                 /* Can't integrate more digits with mantissa, so instead just
                  * raise by a power of ten.
@@ -391,18 +447,8 @@ yasm_floatnum_create(const char *str)
                 /* Raise by a power of ten */
                 dec_exponent--;
 
-                /* Multiply mantissa by 10 [x = (x<<1)+(x<<3)] */
-                BitVector_shift_left(flt->mantissa, 0);
-                BitVector_Copy(operand[0], flt->mantissa);
-                BitVector_Move_Left(flt->mantissa, 2);
-                carry = 0;
-                BitVector_add(operand[1], operand[0], flt->mantissa, &carry);
-
-                /* Add in current digit */
-                BitVector_Empty(operand[0]);
-                BitVector_Chunk_Store(operand[0], 4, 0, (N_long)(*str-'0'));
-                carry = 0;
-                BitVector_add(flt->mantissa, operand[1], operand[0], &carry);
+                /* Multiply mantissa by 10 and add in current digit */
+                mant_mul10_add(mant, (unsigned int)(*str-'0'));
             }
             sig_digits++;
             str++;
@@ -419,9 +465,7 @@ yasm_floatnum_create(const char *str)
         dec_exponent += dec_exp_add;
     }
 
-    /* Free calculation variables. */
-    BitVector_Destroy(operand[1]);
-    BitVector_Destroy(operand[0]);
+    mant_write(flt->mantissa, mant);
 
     /* Normalize the number, checking for 0 first. */
     if (BitVector_is_empty(flt->mantissa)) {
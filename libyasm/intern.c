@@ -0,0 +1,204 @@
+/*
+ * String interning
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "util.h"
+
+#include "coretype.h"
+
+
+/* Each interned string is stored once, preceded by its hash. */
+typedef struct intern_str {
+    unsigned long hash;
+    size_t len;
+    char str[1];
+} intern_str;
+
+/* Strings are carved out of large blocks, so interning a new string doesn't
+ * need an allocation of its own.
+ */
+typedef struct intern_block {
+    /*@only@*/ /*@null@*/ struct intern_block *next;
+    size_t used;
+    size_t size;
+} intern_block;
+
+typedef union intern_align {
+    size_t s;
+    unsigned long l;
+    void *p;
+} intern_align;
+
+#define INTERN_BLOCK_SIZE   16384
+#define INTERN_ROUND(n) \
+    (((n) + sizeof(intern_align) - 1) & ~(sizeof(intern_align) - 1))
+#define INTERN_BLOCK_HDR    INTERN_ROUND(sizeof(intern_block))
+#define INTERN_STR_HDR      offsetof(intern_str, str)
+
+/* Open-addressed (linear probing) hash table of all interned strings.  The
+ * size is always a power of 2 and kept at least twice the count.
+ */
+static /*@only@*/ /*@null@*/ intern_str **intern_table = NULL;
+static unsigned long intern_size = 0;
+static unsigned long intern_count = 0;
+static /*@only@*/ /*@null@*/ intern_block *intern_blocks = NULL;
+
+static unsigned long
+intern_hash(const char *str, size_t len)
+{
+    /* FNV-1a */
+    unsigned long h = 2166136261UL;
+    size_t i;
+    for (i=0; i<len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+static /*@dependent@*/ intern_str *
+intern_alloc(size_t len)
+{
+    size_t need = INTERN_ROUND(INTERN_STR_HDR + len + 1);
+    intern_block *block = intern_blocks;
+
+    if (!block || block->used + need > block->size) {
+        size_t size = INTERN_BLOCK_SIZE;
+        if (INTERN_BLOCK_HDR + need > size)
+            size = INTERN_BLOCK_HDR + need;
+        block = yasm_xmalloc(size);
+        block->next = intern_blocks;
+        block->used = INTERN_BLOCK_HDR;
+        block->size = size;
+        intern_blocks = block;
+    }
+
+    block->used += need;
+    return (intern_str *)((char *)block + block->used - need);
+}
+
+static void
+intern_grow(void)
+{
+    intern_str **old_table = intern_table;
+    unsigned long old_size = intern_size;
+    unsigned long i;
+
+    intern_size = old_size ? old_size*2 : 1024;
+    intern_table = yasm_xmalloc(intern_size*sizeof(intern_str *));
+    for (i=0; i<intern_size; i++)
+        intern_table[i] = NULL;
+
+    for (i=0; i<old_size; i++) {
+        intern_str *s = old_table[i];
+        unsigned long j;
+        if (!s)
+            continue;
+        for (j = s->hash & (intern_size-1); intern_table[j];
+             j = (j+1) & (intern_size-1))
+            ;
+        intern_table[j] = s;
+    }
+    if (old_table)
+        yasm_xfree(old_table);
+}
+
+const char *
+yasm__intern_findn(const char *str, size_t len)
+{
+    unsigned long hash;
+    unsigned long i;
+    intern_str *s;
+
+    if (!intern_table)
+        return NULL;
+
+    hash = intern_hash(str, len);
+    for (i = hash & (intern_size-1); (s = intern_table[i]) != NULL;
+         i = (i+1) & (intern_size-1)) {
+        if (s->hash == hash && s->len == len
+            && memcmp(s->str, str, len) == 0)
+            return s->str;
+    }
+    return NULL;
+}
+
+const char *
+yasm__intern_find(const char *str)
+{
+    return yasm__intern_findn(str, strlen(str));
+}
+
+const char *
+yasm__internn(const char *str, size_t len)
+{
+    unsigned long hash = intern_hash(str, len);
+    unsigned long i;
+    intern_str *s;
+
+    if (intern_count*2 >= intern_size)
+        intern_grow();
+
+    for (i = hash & (intern_size-1); (s = intern_table[i]) != NULL;
+         i = (i+1) & (intern_size-1)) {
+        if (s->hash == hash && s->len == len
+            && memcmp(s->str, str, len) == 0)
+            return s->str;
+    }
+
+    s = intern_alloc(len);
+    s->hash = hash;
+    s->len = len;
+    memcpy(s->str, str, len);
+    s->str[len] = '\0';
+    intern_table[i] = s;
+    intern_count++;
+    return s->str;
+}
+
+const char *
+yasm__intern(const char *str)
+{
+    return yasm__internn(str, strlen(str));
+}
+
+unsigned long
+yasm__intern_hash(const char *istr)
+{
+    return ((const intern_str *)(istr - INTERN_STR_HDR))->hash;
+}
+
+void
+yasm__intern_cleanup(void)
+{
+    while (intern_blocks) {
+        intern_block *next = intern_blocks->next;
+        yasm_xfree(intern_blocks);
+        intern_blocks = next;
+    }
+    if (intern_table)
+        yasm_xfree(intern_table);
+    intern_table = NULL;
+    intern_size = 0;
+    intern_count = 0;
+}
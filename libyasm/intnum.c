@@ -666,7 +666,8 @@ yasm_intnum_set_uint(yasm_intnum *intn, unsigned long val)
         if (intn->type != INTNUM_BV) {
             intn->val.bv = BitVector_Create(BITVECT_NATIVE_SIZE, TRUE);
             intn->type = INTNUM_BV;
-        }
+        } else
+            BitVector_Empty(intn->val.bv);
         BitVector_Chunk_Store(intn->val.bv, 32, 0, val);
     } else {
         if (intn->type == INTNUM_BV) {
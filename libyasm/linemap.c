@@ -27,7 +27,6 @@
 #include "util.h"
 
 #include "coretype.h"
-#include "hamt.h"
 
 #include "errwarn.h"
 #include "linemap.h"
@@ -55,8 +54,17 @@ typedef struct line_source_info {
 } line_source_info;
 
 struct yasm_linemap {
-    /* Shared storage for filenames */
-    /*@only@*/ /*@null@*/ HAMT *filenames;
+    /* Filenames used in mappings (interned), in order of first use */
+    /*@only@*/ const char **filenames;
+    size_t num_filenames;
+    size_t filenames_allocated;
+
+    /* Open-addressed (linear probing) hash table of the same filenames,
+     * keyed by interned pointer.  The size is always a power of 2 and kept
+     * at least twice num_filenames.
+     */
+    /*@only@*/ const char **filename_index;
+    size_t filename_index_size;
 
     /* Current virtual line number. */
     unsigned long current;
@@ -71,10 +79,56 @@ struct yasm_linemap {
     size_t source_info_size;
 };
 
-static void
-filename_delete_one(/*@only@*/ void *d)
+/* Find the filename index entry for an interned filename: either the entry
+ * holding it or the empty entry where it belongs.
+ */
+static const char **
+linemap_find_filename(yasm_linemap *linemap, const char *ifilename)
 {
-    yasm_xfree(d);
+    size_t mask = linemap->filename_index_size-1;
+    size_t i = (size_t)(((unsigned long)(size_t)ifilename >> 3)
+                        * 2654435761UL) & mask;
+
+    while (linemap->filename_index[i]
+           && linemap->filename_index[i] != ifilename)
+        i = (i+1) & mask;
+    return &linemap->filename_index[i];
+}
+
+/* Intern a filename, adding it to the linemap's list of filenames if it's
+ * not already there.
+ */
+static /*@dependent@*/ const char *
+linemap_add_filename(yasm_linemap *linemap, const char *filename)
+{
+    const char *ifilename = yasm__intern(filename);
+    const char **entry;
+    size_t i;
+
+    entry = linemap_find_filename(linemap, ifilename);
+    if (*entry)
+        return ifilename;
+
+    if (2*(linemap->num_filenames+1) > linemap->filename_index_size) {
+        /* Grow the index and re-add the existing filenames */
+        yasm_xfree(linemap->filename_index);
+        linemap->filename_index_size *= 2;
+        linemap->filename_index =
+            yasm_xcalloc(linemap->filename_index_size, sizeof(const char *));
+        for (i = 0; i < linemap->num_filenames; i++)
+            *linemap_find_filename(linemap, linemap->filenames[i]) =
+                linemap->filenames[i];
+        entry = linemap_find_filename(linemap, ifilename);
+    }
+    *entry = ifilename;
+
+    if (linemap->num_filenames >= linemap->filenames_allocated) {
+        linemap->filenames_allocated *= 2;
+        linemap->filenames = yasm_xrealloc(linemap->filenames,
+            linemap->filenames_allocated*sizeof(const char *));
+    }
+    linemap->filenames[linemap->num_filenames++] = ifilename;
+    return ifilename;
 }
 
 void
@@ -82,9 +136,7 @@ yasm_linemap_set(yasm_linemap *linemap, const char *filename,
                  unsigned long virtual_line, unsigned long file_line,
                  unsigned long line_inc)
 {
-    char *copy;
     unsigned long i;
-    int replace = 0;
     line_mapping *mapping = NULL;
 
     if (virtual_line == 0) {
@@ -123,14 +175,8 @@ yasm_linemap_set(yasm_linemap *linemap, const char *filename,
         else
             filename = "unknown";
     }
-    if (filename) {
-        /* Copy the filename (via shared storage) */
-        copy = yasm__xstrdup(filename);
-        /*@-aliasunique@*/
-        mapping->filename = HAMT_insert(linemap->filenames, copy, copy,
-                                        &replace, filename_delete_one);
-        /*@=aliasunique@*/
-    }
+    if (filename)
+        mapping->filename = linemap_add_filename(linemap, filename);
 
     mapping->line = virtual_line;
     mapping->file_line = file_line;
@@ -166,7 +212,12 @@ yasm_linemap_create(void)
     size_t i;
     yasm_linemap *linemap = yasm_xmalloc(sizeof(yasm_linemap));
 
-    linemap->filenames = HAMT_create(0, yasm_internal_error_);
+    linemap->filenames = yasm_xmalloc(8*sizeof(const char *));
+    linemap->num_filenames = 0;
+    linemap->filenames_allocated = 8;
+    linemap->filename_index_size = 16;
+    linemap->filename_index = yasm_xcalloc(linemap->filename_index_size,
+                                           sizeof(const char *));
 
     linemap->current = 1;
 
@@ -199,8 +250,8 @@ yasm_linemap_destroy(yasm_linemap *linemap)
 
     yasm_xfree(linemap->map_vector);
 
-    if (linemap->filenames)
-        HAMT_destroy(linemap->filenames, filename_delete_one);
+    yasm_xfree(linemap->filenames);
+    yasm_xfree(linemap->filename_index);
 
     yasm_xfree(linemap);
 }
@@ -273,7 +324,13 @@ int
 yasm_linemap_traverse_filenames(yasm_linemap *linemap, /*@null@*/ void *d,
                                 int (*func) (const char *filename, void *d))
 {
-    return HAMT_traverse(linemap->filenames, d, (int (*) (void *, void *))func);
+    size_t i;
+    for (i=0; i<linemap->num_filenames; i++) {
+        int retval = func(linemap->filenames[i], d);
+        if (retval != 0)
+            return retval;
+    }
+    return 0;
 }
 
 int
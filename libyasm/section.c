@@ -48,15 +48,13 @@
 #include "dbgfmt.h"
 #include "objfmt.h"
 
-#include "inttree.h"
-
 
 struct yasm_section {
     /*@reldef@*/ STAILQ_ENTRY(yasm_section) link;
 
     /*@dependent@*/ yasm_object *object;    /* Pointer to parent object */
 
-    /*@owned@*/ char *name;     /* strdup()'ed name (given by user) */
+    /*@dependent@*/ const char *name;   /* interned name (given by user) */
 
     /* associated data; NULL if none */
     /*@null@*/ /*@only@*/ yasm__assoc_data *assoc_data;
@@ -310,12 +308,13 @@ yasm_object_get_general(yasm_object *object, const char *name,
 {
     yasm_section *s;
     yasm_bytecode *bc;
+    const char *iname = yasm__intern(name);
 
     /* Search through current sections to see if we already have one with
      * that name.
      */
     STAILQ_FOREACH(s, &object->sections, link) {
-        if (strcmp(s->name, name) == 0) {
+        if (s->name == iname) {
             *isnew = 0;
             return s;
         }
@@ -328,9 +327,10 @@ yasm_object_get_general(yasm_object *object, const char *name,
     STAILQ_INSERT_TAIL(&object->sections, s, link);
 
     s->object = object;
-    s->name = yasm__xstrdup(name);
+    s->name = iname;
     s->assoc_data = NULL;
     s->align = align;
+    s->opt_flags = 0;
 
     /* Initialize bytecodes with one empty bytecode (acts as "prior" for first
      * real bytecode in section.
@@ -443,6 +443,12 @@ yasm_section_get_data(yasm_section *sect,
     return yasm__assoc_data_get(sect->assoc_data, callback);
 }
 
+void *
+yasm_section_get_slot_data(yasm_section *sect, unsigned int slot)
+{
+    return yasm__assoc_data_get_slot(sect->assoc_data, slot);
+}
+
 void
 yasm_section_add_data(yasm_section *sect,
                       const yasm_assoc_data_callback *callback, void *data)
@@ -470,6 +476,7 @@ yasm_object_destroy(yasm_object *object)
         yasm_section_destroy(cur);
         cur = next;
     }
+    yasm_bc__release_chunk();
 
     /* Delete directives HAMT */
     HAMT_destroy(object->directives, directive_level1_delete);
@@ -553,9 +560,12 @@ yasm_section *
 yasm_object_find_general(yasm_object *object, const char *name)
 {
     yasm_section *cur;
+    const char *iname = yasm__intern_find(name);
 
+    if (!iname)
+        return NULL;
     STAILQ_FOREACH(cur, &object->sections, link) {
-        if (strcmp(cur->name, name) == 0)
+        if (cur->name == iname)
             return cur;
     }
     return NULL;
@@ -616,11 +626,19 @@ yasm_section_bcs_append(yasm_section *sect, yasm_bytecode *bc)
             STAILQ_INSERT_TAIL(&sect->bcs, bc, link);
             return bc;
         } else
-            yasm_xfree(bc);
+            yasm_bc_destroy(bc);
     }
     return (yasm_bytecode *)NULL;
 }
 
+void
+yasm_section_bcs_insert_after(yasm_section *sect, yasm_bytecode *prevbc,
+                              yasm_bytecode *bc)
+{
+    bc->section = sect;     /* record parent section */
+    STAILQ_INSERT_AFTER(&sect->bcs, prevbc, bc, link);
+}
+
 int
 yasm_section_bcs_traverse(yasm_section *sect,
                           /*@null@*/ yasm_errwarns *errwarns,
@@ -672,7 +690,6 @@ yasm_section_destroy(yasm_section *sect)
     if (!sect)
         return;
 
-    yasm_xfree(sect->name);
     yasm__assoc_data_destroy(sect->assoc_data);
 
     /* Delete bytecodes */
@@ -746,7 +763,7 @@ yasm_section_print(const yasm_section *sect, FILE *f, int indent_level,
  *  - handling of multiples
  *
  * Data structures:
- *  - Interval tree to store spans and associated data
+ *  - Interval index to find the span terms containing a bytecode
  *  - Queues QA and QB
  *
  * Each span keeps track of:
@@ -786,8 +803,21 @@ yasm_section_print(const yasm_section *sect, FILE *f, int indent_level,
  *      next bytecode offset would be less than the old next bytecode offset,
  *      error.  Otherwise increase offset and update dependent spans.
  *
- * To reduce interval tree size, a first expansion pass is performed
- * before the spans are added to the tree.
+ * To reduce interval index size, a first expansion pass is performed
+ * before the spans are added to the index.
+ *
+ * The interval index is a static, flat array: all span terms are added at
+ * once before step 2 and never removed, so rather than a balanced tree,
+ * the term intervals are kept in an array sorted by low bc_index, with an
+ * implicit (array-based) tree of maximum high bc_index over it.  Finding
+ * all terms containing a bytecode is a binary search for the last interval
+ * starting at or before it, followed by a walk of the max tree that prunes
+ * subtrees ending before it.
+ *
+ * Fixed-length bytecodes (e.g. instructions on fixed-length ISAs) never
+ * add spans.  If no spans at all are added in step 1a, the offsets it
+ * calculated are already final, and steps 1b through 3 are skipped.  The
+ * interval index is only built if step 2 is actually needed.
  *
  * Basic algorithm outline:
  *
@@ -806,7 +836,7 @@ yasm_section_print(const yasm_section *sect, FILE *f, int indent_level,
  *     expansion can result, mark span as inactive.
  *  c. Iterate over bytecodes to update all bytecode offsets based on new
  *     (expanded) lengths calculated in 1b.
- *  d. Iterate over active spans.  Add span to interval tree.  Update span's
+ *  d. Iterate over active spans.  Add span to interval index.  Update span's
  *     length based on new bytecode offsets determined in 1c.  If span's
  *     length exceeds long threshold, add that span to Q.
  * 2. Main loop:
@@ -824,6 +854,9 @@ yasm_section_print(const yasm_section *sect, FILE *f, int indent_level,
 
 typedef struct yasm_span yasm_span;
 
+/* Section optimizer flag: bytecode lengths changed, offsets need update */
+#define OPT_SECT_DIRTY      (1UL<<0)
+
 typedef struct yasm_offset_setter {
     /* Linked list in section order (e.g. offset order) */
     /*@reldef@*/ STAILQ_ENTRY(yasm_offset_setter) link;
@@ -876,15 +909,38 @@ struct yasm_span {
     yasm_offset_setter *os;
 };
 
+/* Span term interval, [low, high] in bc_index units */
+typedef struct optimize_term_ival {
+    long low, high;
+    /*@dependent@*/ yasm_span_term *term;
+} optimize_term_ival;
+
+/* Static interval index over span terms; see comment at top. */
+typedef struct optimize_term_index {
+    /*@only@*/ /*@null@*/ optimize_term_ival *ivals;    /* sorted by low */
+    size_t num, alloc;
+    /* implicit binary tree of max high; leaves at [size, size+num) */
+    /*@only@*/ /*@null@*/ long *max_high;
+    size_t size;
+} optimize_term_index;
+
 typedef struct optimize_data {
     /*@reldef@*/ TAILQ_HEAD(yasm_span_head, yasm_span) spans;
     /*@reldef@*/ STAILQ_HEAD(yasm_span_shead, yasm_span) QA, QB;
-    /*@only@*/ IntervalTree *itree;
+    optimize_term_index tidx;
     /*@reldef@*/ STAILQ_HEAD(offset_setters_head, yasm_offset_setter)
         offset_setters;
     long len_diff;      /* used only for optimize_term_expand */
     yasm_span *span;    /* used only for check_cycle */
     yasm_offset_setter *os;
+
+    /*@dependent@*/ yasm_optimize_stats *stats;
+    /*@null@*/ FILE *trace;
+    /*@null@*/ yasm_linemap *linemap;  /* for trace file and line */
+    /* expansion count per bytecode (indexed by bc_index); NULL if not
+     * gathering statistics
+     */
+    /*@null@*/ /*@only@*/ unsigned long *bc_expansions;
 } optimize_data;
 
 static yasm_span *
@@ -923,6 +979,51 @@ optimize_add_span(void *add_span_data, yasm_bytecode *bc, int id,
     yasm_span *span;
     span = create_span(bc, id, value, neg_thres, pos_thres, optd->os);
     TAILQ_INSERT_TAIL(&optd->spans, span, link);
+    optd->stats->spans_created++;
+}
+
+/* Print the source location of a virtual line: file and line if there's a
+ * line mapping, otherwise just the virtual line.
+ */
+static void
+optimize_print_line(FILE *f, /*@null@*/ yasm_linemap *linemap,
+                    unsigned long line)
+{
+    const char *filename;
+    unsigned long file_line;
+
+    if (!linemap) {
+        fprintf(f, "vline %lu", line);
+        return;
+    }
+    yasm_linemap_lookup(linemap, line, &filename, &file_line);
+    fprintf(f, "%s:%lu", filename, file_line);
+}
+
+/* Record (and optionally trace) a span-driven expansion of a bytecode. */
+static void
+optimize_note_expand(optimize_data *optd, const char *step,
+                     const yasm_span *span, unsigned long orig_len,
+                     int retval)
+{
+    const yasm_bytecode *bc = span->bc;
+
+    optd->stats->expansions++;
+    if (optd->bc_expansions) {
+        unsigned long count = ++optd->bc_expansions[bc->bc_index];
+        if (count > optd->stats->max_bc_expansions) {
+            optd->stats->max_bc_expansions = count;
+            optd->stats->max_bc_line = bc->line;
+        }
+    }
+
+    if (!optd->trace)
+        return;
+    fprintf(optd->trace, "%s: bc %lu (", step, bc->bc_index);
+    optimize_print_line(optd->trace, optd->linemap, bc->line);
+    fprintf(optd->trace, ") span %d value %ld: len %lu -> %lu%s\n",
+            span->id, span->new_val, orig_len, bc->len*bc->mult_int,
+            retval < 0 ? " (error)" : retval == 0 ? " (final)" : "");
 }
 
 static void
@@ -1005,6 +1106,21 @@ span_create_terms(yasm_span *span)
     }
 }
 
+/* Determine if all terms of a span are within the span's own section. */
+static int
+span_is_local(const yasm_span *span)
+{
+    unsigned int i;
+
+    for (i=0; i<span->num_terms; i++) {
+        if (span->terms[i].precbc->section != span->bc->section ||
+            span->terms[i].precbc2->section != span->bc->section)
+            return 0;
+    }
+    /* rel_term is only created for same-section references */
+    return 1;
+}
+
 /* Recalculate span value based on current span replacement values.
  * Returns 1 if span needs expansion (e.g. exceeded thresholds).
  */
@@ -1050,43 +1166,58 @@ recalc_normal_span(yasm_span *span)
             || span->new_val > span->pos_thres);
 }
 
-/* Updates all bytecode offsets.  For offset-based bytecodes, calls expand
- * to determine new length.
+/* Updates all bytecode offsets in a section.  For offset-based bytecodes,
+ * calls expand to determine new length.
  */
 static int
-update_all_bc_offsets(yasm_object *object, yasm_errwarns *errwarns)
+update_bc_offsets(yasm_section *sect, yasm_errwarns *errwarns)
 {
-    yasm_section *sect;
+    unsigned long offset = 0;
     int saw_error = 0;
 
-    STAILQ_FOREACH(sect, &object->sections, link) {
-        unsigned long offset = 0;
+    yasm_bytecode *bc = STAILQ_FIRST(&sect->bcs);
+    yasm_bytecode *prevbc;
 
-        yasm_bytecode *bc = STAILQ_FIRST(&sect->bcs);
-        yasm_bytecode *prevbc;
+    /* Skip our locally created empty bytecode first. */
+    prevbc = bc;
+    bc = STAILQ_NEXT(bc, link);
 
-        /* Skip our locally created empty bytecode first. */
+    /* Iterate through the remainder, if any. */
+    while (bc) {
+        if (bc->callback->special == YASM_BC_SPECIAL_OFFSET) {
+            /* Recalculate/adjust len of offset-based bytecodes here */
+            long neg_thres = 0;
+            long pos_thres = (long)yasm_bc_next_offset(bc);
+            int retval = yasm_bc_expand(bc, 1, 0,
+                                        (long)yasm_bc_next_offset(prevbc),
+                                        &neg_thres, &pos_thres);
+            yasm_errwarn_propagate(errwarns, bc->line);
+            if (retval < 0)
+                saw_error = 1;
+        }
+        bc->offset = offset;
+        offset += bc->len*bc->mult_int;
         prevbc = bc;
         bc = STAILQ_NEXT(bc, link);
+    }
+    return saw_error;
+}
 
-        /* Iterate through the remainder, if any. */
-        while (bc) {
-            if (bc->callback->special == YASM_BC_SPECIAL_OFFSET) {
-                /* Recalculate/adjust len of offset-based bytecodes here */
-                long neg_thres = 0;
-                long pos_thres = (long)yasm_bc_next_offset(bc);
-                int retval = yasm_bc_expand(bc, 1, 0,
-                                            (long)yasm_bc_next_offset(prevbc),
-                                            &neg_thres, &pos_thres);
-                yasm_errwarn_propagate(errwarns, bc->line);
-                if (retval < 0)
-                    saw_error = 1;
-            }
-            bc->offset = offset;
-            offset += bc->len*bc->mult_int;
-            prevbc = bc;
-            bc = STAILQ_NEXT(bc, link);
-        }
+/* Updates bytecode offsets in a single section, or in all sections if sect
+ * is NULL.
+ */
+static int
+update_all_bc_offsets(yasm_object *object, /*@null@*/ yasm_section *sect,
+                      yasm_errwarns *errwarns)
+{
+    int saw_error = 0;
+
+    if (sect)
+        return update_bc_offsets(sect, errwarns);
+
+    STAILQ_FOREACH(sect, &object->sections, link) {
+        if (update_bc_offsets(sect, errwarns))
+            saw_error = 1;
     }
     return saw_error;
 }
@@ -1117,7 +1248,13 @@ optimize_cleanup(optimize_data *optd)
     yasm_span *s1, *s2;
     yasm_offset_setter *os1, *os2;
 
-    IT_destroy(optd->itree);
+    if (optd->tidx.ivals)
+        yasm_xfree(optd->tidx.ivals);
+    if (optd->tidx.max_high)
+        yasm_xfree(optd->tidx.max_high);
+
+    if (optd->bc_expansions)
+        yasm_xfree(optd->bc_expansions);
 
     s1 = TAILQ_FIRST(&optd->spans);
     while (s1) {
@@ -1135,7 +1272,117 @@ optimize_cleanup(optimize_data *optd)
 }
 
 static void
-optimize_itree_add(IntervalTree *itree, yasm_span *span, yasm_span_term *term)
+optimize_tidx_init(optimize_term_index *tidx)
+{
+    tidx->ivals = NULL;
+    tidx->num = 0;
+    tidx->alloc = 0;
+    tidx->max_high = NULL;
+    tidx->size = 0;
+}
+
+static int
+optimize_term_ival_compare(const void *a, const void *b)
+{
+    const optimize_term_ival *ia = a, *ib = b;
+    if (ia->low < ib->low)
+        return -1;
+    if (ia->low > ib->low)
+        return 1;
+    return 0;
+}
+
+/* Sort the intervals and build the max tree.  Must be called after all
+ * intervals have been added and before any lookups.
+ */
+static void
+optimize_tidx_build(optimize_term_index *tidx)
+{
+    size_t i;
+
+    if (tidx->num == 0)
+        return;
+
+    /* Stable, so that lookups visit equal-low terms in insertion order */
+    yasm__mergesort(tidx->ivals, tidx->num, sizeof(optimize_term_ival),
+                    optimize_term_ival_compare);
+
+    tidx->size = 1;
+    while (tidx->size < tidx->num)
+        tidx->size <<= 1;
+    tidx->max_high = yasm_xmalloc(2*tidx->size*sizeof(long));
+    for (i=0; i<tidx->size; i++)
+        tidx->max_high[tidx->size+i] =
+            i < tidx->num ? tidx->ivals[i].high : LONG_MIN;
+    for (i=tidx->size-1; i>0; i--) {
+        long l = tidx->max_high[2*i], r = tidx->max_high[2*i+1];
+        tidx->max_high[i] = l > r ? l : r;
+    }
+}
+
+/* Call func for each span term whose interval contains bc_index, in order
+ * of increasing interval start.
+ */
+static void
+optimize_tidx_enumerate(optimize_term_index *tidx, long bc_index, void *d,
+                        void (*func) (yasm_span_term *term, void *d))
+{
+    size_t lo = 0, hi = tidx->num, node, end;
+    unsigned int height;
+
+    if (tidx->num == 0)
+        return;
+
+    /* Find end of intervals starting at or before bc_index */
+    while (lo < hi) {
+        size_t mid = lo + (hi-lo)/2;
+        if (tidx->ivals[mid].low <= bc_index)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    end = lo;
+    if (end == 0)
+        return;
+
+    /* Walk leaves [0, end) in order, skipping subtrees whose maximum high
+     * is below bc_index.  Node n at height h covers leaves starting at
+     * (n<<h)-size.
+     */
+    height = 0;
+    while (((size_t)1<<height) < tidx->size)
+        height++;
+    node = 1;
+    for (;;) {
+        size_t first = (node<<height) - tidx->size;
+
+        if (first >= end)
+            break;      /* this and all following subtrees are past end */
+
+        if (tidx->max_high[node] >= bc_index) {
+            if (height == 0)
+                func(tidx->ivals[first].term, d);
+            else {
+                /* descend to left child */
+                node <<= 1;
+                height--;
+                continue;
+            }
+        }
+
+        /* Move to next subtree: climb while we're a right child */
+        while (node & 1) {
+            node >>= 1;
+            height++;
+        }
+        if (node == 0)
+            break;
+        node++;     /* left child -> right sibling */
+    }
+}
+
+static void
+optimize_tidx_add(optimize_data *optd, yasm_span *span, yasm_span_term *term)
 {
     long precbc_index, precbc2_index;
     unsigned long low, high;
@@ -1160,14 +1407,23 @@ optimize_itree_add(IntervalTree *itree, yasm_span *span, yasm_span_term *term)
     } else
         return;     /* difference is same bc - always 0! */
 
-    IT_insert(itree, (long)low, (long)high, term);
+    if (optd->tidx.num >= optd->tidx.alloc) {
+        optd->tidx.alloc = optd->tidx.alloc ? optd->tidx.alloc*2 : 64;
+        optd->tidx.ivals =
+            yasm_xrealloc(optd->tidx.ivals,
+                          optd->tidx.alloc*sizeof(optimize_term_ival));
+    }
+    optd->tidx.ivals[optd->tidx.num].low = (long)low;
+    optd->tidx.ivals[optd->tidx.num].high = (long)high;
+    optd->tidx.ivals[optd->tidx.num].term = term;
+    optd->tidx.num++;
+    optd->stats->index_terms++;
 }
 
 static void
-check_cycle(IntervalTreeNode *node, void *d)
+check_cycle(yasm_span_term *term, void *d)
 {
     optimize_data *optd = d;
-    yasm_span_term *term = node->data;
     yasm_span *depspan = term->span;
     int i;
     int depspan_bt_alloc;
@@ -1176,6 +1432,8 @@ check_cycle(IntervalTreeNode *node, void *d)
     if (depspan->id > 0)
         return;
 
+    optd->stats->cycle_checks++;
+
     /* Check for a circular reference by looking to see if this dependent
      * span is in our backtrace.
      */
@@ -1239,10 +1497,9 @@ check_cycle(IntervalTreeNode *node, void *d)
 }
 
 static void
-optimize_term_expand(IntervalTreeNode *node, void *d)
+optimize_term_expand(yasm_span_term *term, void *d)
 {
     optimize_data *optd = d;
-    yasm_span_term *term = node->data;
     yasm_span *span = term->span;
     long len_diff = optd->len_diff;
     long precbc_index, precbc2_index;
@@ -1266,6 +1523,7 @@ optimize_term_expand(IntervalTreeNode *node, void *d)
         term->new_val += len_diff;
     else
         term->new_val -= len_diff;
+    optd->stats->term_updates++;
 
     /* If already on Q, don't re-add */
     if (span->active == 2)
@@ -1283,134 +1541,28 @@ optimize_term_expand(IntervalTreeNode *node, void *d)
     span->active = 2;       /* Mark as being in Q */
 }
 
-void
-yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
+/* Steps 1c through 3 of the optimizer, run over the spans in optd.  If sect
+ * is non-NULL, all spans (including all of their terms) are within sect, and
+ * only sect is updated.  Returns nonzero if an error occurred.
+ */
+static int
+optimize_spans(yasm_object *object, /*@null@*/ yasm_section *sect,
+               optimize_data *optd, yasm_errwarns *errwarns)
 {
-    yasm_section *sect;
-    unsigned long bc_index = 0;
     int saw_error = 0;
-    optimize_data optd;
-    yasm_span *span, *span_temp;
+    yasm_span *span;
     yasm_offset_setter *os;
+    unsigned long orig_len;
     int retval;
     unsigned int i;
 
-    TAILQ_INIT(&optd.spans);
-    STAILQ_INIT(&optd.offset_setters);
-    optd.itree = IT_create();
-
-    /* Create an placeholder offset setter for spans to point to; this will
-     * get updated if/when we actually run into one.
-     */
-    os = yasm_xmalloc(sizeof(yasm_offset_setter));
-    os->bc = NULL;
-    os->cur_val = 0;
-    os->new_val = 0;
-    os->thres = 0;
-    STAILQ_INSERT_TAIL(&optd.offset_setters, os, link);
-    optd.os = os;
-
-    /* Step 1a */
-    STAILQ_FOREACH(sect, &object->sections, link) {
-        unsigned long offset = 0;
-
-        yasm_bytecode *bc = STAILQ_FIRST(&sect->bcs);
-        yasm_bytecode *prevbc;
-
-        bc->bc_index = bc_index++;
-
-        /* Skip our locally created empty bytecode first. */
-        prevbc = bc;
-        bc = STAILQ_NEXT(bc, link);
-
-        /* Iterate through the remainder, if any. */
-        while (bc) {
-            bc->bc_index = bc_index++;
-            bc->offset = offset;
-
-            retval = yasm_bc_calc_len(bc, optimize_add_span, &optd);
-            yasm_errwarn_propagate(errwarns, bc->line);
-            if (retval)
-                saw_error = 1;
-            else {
-                if (bc->callback->special == YASM_BC_SPECIAL_OFFSET) {
-                    /* Remember it as offset setter */
-                    os->bc = bc;
-                    os->thres = yasm_bc_next_offset(bc);
-
-                    /* Create new placeholder */
-                    os = yasm_xmalloc(sizeof(yasm_offset_setter));
-                    os->bc = NULL;
-                    os->cur_val = 0;
-                    os->new_val = 0;
-                    os->thres = 0;
-                    STAILQ_INSERT_TAIL(&optd.offset_setters, os, link);
-                    optd.os = os;
-
-                    if (bc->multiple) {
-                        yasm_error_set(YASM_ERROR_VALUE,
-                            N_("cannot combine multiples and setting assembly position"));
-                        yasm_errwarn_propagate(errwarns, bc->line);
-                        saw_error = 1;
-                    }
-                }
-
-                offset += bc->len*bc->mult_int;
-            }
-
-            prevbc = bc;
-            bc = STAILQ_NEXT(bc, link);
-        }
-    }
-
-    if (saw_error) {
-        optimize_cleanup(&optd);
-        return;
-    }
-
-    /* Step 1b */
-    TAILQ_FOREACH_SAFE(span, &optd.spans, link, span_temp) {
-        span_create_terms(span);
-        if (yasm_error_occurred()) {
-            yasm_errwarn_propagate(errwarns, span->bc->line);
-            saw_error = 1;
-        } else if (recalc_normal_span(span)) {
-            retval = yasm_bc_expand(span->bc, span->id, span->cur_val,
-                                    span->new_val, &span->neg_thres,
-                                    &span->pos_thres);
-            yasm_errwarn_propagate(errwarns, span->bc->line);
-            if (retval < 0)
-                saw_error = 1;
-            else if (retval > 0) {
-                if (!span->active) {
-                    yasm_error_set(YASM_ERROR_VALUE,
-                        N_("secondary expansion of an external/complex value"));
-                    yasm_errwarn_propagate(errwarns, span->bc->line);
-                    saw_error = 1;
-                }
-            } else {
-                TAILQ_REMOVE(&optd.spans, span, link);
-                span_destroy(span);
-                continue;
-            }
-        }
-        span->cur_val = span->new_val;
-    }
-
-    if (saw_error) {
-        optimize_cleanup(&optd);
-        return;
-    }
-
     /* Step 1c */
-    if (update_all_bc_offsets(object, errwarns)) {
-        optimize_cleanup(&optd);
-        return;
-    }
+    if (update_all_bc_offsets(object, sect, errwarns))
+        return 1;
 
     /* Step 1d */
-    STAILQ_INIT(&optd.QB);
-    TAILQ_FOREACH(span, &optd.spans, link) {
+    STAILQ_INIT(&optd->QB);
+    TAILQ_FOREACH(span, &optd->spans, link) {
         yasm_intnum *intn;
 
         /* Update span terms based on new bc offsets */
@@ -1436,68 +1588,78 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
 
         if (recalc_normal_span(span)) {
             /* Exceeded threshold, add span to QB */
-            STAILQ_INSERT_TAIL(&optd.QB, span, linkq);
+            STAILQ_INSERT_TAIL(&optd->QB, span, linkq);
             span->active = 2;
         }
     }
 
     /* Do we need step 2?  If not, go ahead and exit. */
-    if (STAILQ_EMPTY(&optd.QB)) {
-        optimize_cleanup(&optd);
-        return;
-    }
+    if (STAILQ_EMPTY(&optd->QB))
+        return 0;
 
-    /* Update offset-setters values */
-    STAILQ_FOREACH(os, &optd.offset_setters, link) {
-        if (!os->bc)
-            continue;
-        os->thres = yasm_bc_next_offset(os->bc);
-        os->new_val = os->bc->offset;
-        os->cur_val = os->new_val;
+    /* Update offset-setters values.  When optimizing a single section, only
+     * the offset-setters reachable from its spans need updating; these start
+     * at the first span's offset-setter and end at the section boundary.
+     */
+    if (sect) {
+        for (os = TAILQ_FIRST(&optd->spans)->os;
+             os->bc && os->bc->section == sect; os = STAILQ_NEXT(os, link)) {
+            os->thres = yasm_bc_next_offset(os->bc);
+            os->new_val = os->bc->offset;
+            os->cur_val = os->new_val;
+        }
+    } else {
+        STAILQ_FOREACH(os, &optd->offset_setters, link) {
+            if (!os->bc)
+                continue;
+            os->thres = yasm_bc_next_offset(os->bc);
+            os->new_val = os->bc->offset;
+            os->cur_val = os->new_val;
+        }
     }
 
-    /* Build up interval tree */
-    TAILQ_FOREACH(span, &optd.spans, link) {
+    /* Build up interval index */
+    TAILQ_FOREACH(span, &optd->spans, link) {
         for (i=0; i<span->num_terms; i++)
-            optimize_itree_add(optd.itree, span, &span->terms[i]);
+            optimize_tidx_add(optd, span, &span->terms[i]);
         if (span->rel_term)
-            optimize_itree_add(optd.itree, span, span->rel_term);
+            optimize_tidx_add(optd, span, span->rel_term);
     }
+    optimize_tidx_build(&optd->tidx);
 
     /* Look for cycles in times expansion (span.id==0) */
-    TAILQ_FOREACH(span, &optd.spans, link) {
+    TAILQ_FOREACH(span, &optd->spans, link) {
         if (span->id > 0)
             continue;
-        optd.span = span;
-        IT_enumerate(optd.itree, (long)span->bc->bc_index,
-                     (long)span->bc->bc_index, &optd, check_cycle);
+        optd->span = span;
+        optimize_tidx_enumerate(&optd->tidx, (long)span->bc->bc_index, optd,
+                                check_cycle);
         if (yasm_error_occurred()) {
             yasm_errwarn_propagate(errwarns, span->bc->line);
             saw_error = 1;
         }
     }
 
-    if (saw_error) {
-        optimize_cleanup(&optd);
-        return;
-    }
+    if (saw_error)
+        return 1;
 
     /* Step 2 */
-    STAILQ_INIT(&optd.QA);
-    while (!STAILQ_EMPTY(&optd.QA) || !(STAILQ_EMPTY(&optd.QB))) {
-        unsigned long orig_len;
+    STAILQ_INIT(&optd->QA);
+    while (!STAILQ_EMPTY(&optd->QA) || !(STAILQ_EMPTY(&optd->QB))) {
         long offset_diff;
 
         /* QA is for TIMES, update those first, then update non-TIMES.
          * This is so that TIMES can absorb increases before we look at
          * expanding non-TIMES BCs.
          */
-        if (!STAILQ_EMPTY(&optd.QA)) {
-            span = STAILQ_FIRST(&optd.QA);
-            STAILQ_REMOVE_HEAD(&optd.QA, linkq);
+        if (!STAILQ_EMPTY(&optd->QA)) {
+            span = STAILQ_FIRST(&optd->QA);
+            STAILQ_REMOVE_HEAD(&optd->QA, linkq);
+            optd->stats->qa_iters++;
         } else {
-            span = STAILQ_FIRST(&optd.QB);
-            STAILQ_REMOVE_HEAD(&optd.QB, linkq);
+            span = STAILQ_FIRST(&optd->QB);
+            STAILQ_REMOVE_HEAD(&optd->QB, linkq);
+            optd->stats->qb_iters++;
         }
 
         if (!span->active)
@@ -1516,6 +1678,7 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
         retval = yasm_bc_expand(span->bc, span->id, span->cur_val,
                                 span->new_val, &span->neg_thres,
                                 &span->pos_thres);
+        optimize_note_expand(optd, "2", span, orig_len, retval);
         yasm_errwarn_propagate(errwarns, span->bc->line);
 
         if (retval < 0) {
@@ -1532,13 +1695,13 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
         } else
             span->active = 0;       /* we're done with this span */
 
-        optd.len_diff = span->bc->len * span->bc->mult_int - orig_len;
-        if (optd.len_diff == 0)
+        optd->len_diff = span->bc->len * span->bc->mult_int - orig_len;
+        if (optd->len_diff == 0)
             continue;   /* didn't increase in size */
 
         /* Iterate over all spans dependent across the bc just expanded */
-        IT_enumerate(optd.itree, (long)span->bc->bc_index,
-                     (long)span->bc->bc_index, &optd, optimize_term_expand);
+        optimize_tidx_enumerate(&optd->tidx, (long)span->bc->bc_index, optd,
+                                optimize_term_expand);
 
         /* Iterate over offset-setters that follow the bc just expanded.
          * Stop iteration if:
@@ -1546,7 +1709,7 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
          *  - offset-setter didn't move its following offset
          */
         os = span->os;
-        offset_diff = optd.len_diff;
+        offset_diff = optd->len_diff;
         while (os->bc && os->bc->section == span->bc->section
                && offset_diff != 0) {
             unsigned long old_next_offset = os->cur_val + os->bc->len;
@@ -1561,24 +1724,307 @@ yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
                                     (long)os->new_val, &neg_thres_temp,
                                     (long *)&os->thres);
             yasm_errwarn_propagate(errwarns, os->bc->line);
+            optd->stats->os_cascades++;
 
             offset_diff = os->new_val + os->bc->len - old_next_offset;
-            optd.len_diff = os->bc->len - orig_len;
-            if (optd.len_diff != 0)
-                IT_enumerate(optd.itree, (long)os->bc->bc_index,
-                     (long)os->bc->bc_index, &optd, optimize_term_expand);
+            optd->len_diff = os->bc->len - orig_len;
+            if (optd->trace) {
+                fprintf(optd->trace, "2: offset-setter bc %lu (",
+                        os->bc->bc_index);
+                optimize_print_line(optd->trace, optd->linemap,
+                                    os->bc->line);
+                fprintf(optd->trace, ") at %lu: len %lu -> %lu\n",
+                        os->new_val, orig_len, os->bc->len);
+            }
+            if (optd->len_diff != 0)
+                optimize_tidx_enumerate(&optd->tidx, (long)os->bc->bc_index,
+                                        optd, optimize_term_expand);
 
             os->cur_val = os->new_val;
             os = STAILQ_NEXT(os, link);
         }
     }
 
+    if (saw_error)
+        return 1;
+
+    /* Step 3 */
+    update_all_bc_offsets(object, sect, errwarns);
+    return 0;
+}
+
+void
+yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns)
+{
+    yasm_object_optimize_stats(object, errwarns, NULL, NULL, NULL);
+}
+
+void
+yasm_object_optimize_stats(yasm_object *object, yasm_errwarns *errwarns,
+                           yasm_optimize_stats *stats, FILE *trace,
+                           yasm_linemap *linemap)
+{
+    yasm_section *sect;
+    unsigned long bc_index = 0;
+    int saw_error = 0;
+    optimize_data optd;
+    yasm_optimize_stats local_stats;
+    yasm_span *span, *span_temp;
+    yasm_offset_setter *os;
+    unsigned long orig_len;
+    int retval;
+
+    TAILQ_INIT(&optd.spans);
+    STAILQ_INIT(&optd.offset_setters);
+    optimize_tidx_init(&optd.tidx);
+    optd.stats = stats ? stats : &local_stats;
+    memset(optd.stats, 0, sizeof(yasm_optimize_stats));
+    optd.trace = trace;
+    optd.linemap = linemap;
+    optd.bc_expansions = NULL;
+
+    /* Create an placeholder offset setter for spans to point to; this will
+     * get updated if/when we actually run into one.
+     */
+    os = yasm_xmalloc(sizeof(yasm_offset_setter));
+    os->bc = NULL;
+    os->cur_val = 0;
+    os->new_val = 0;
+    os->thres = 0;
+    STAILQ_INSERT_TAIL(&optd.offset_setters, os, link);
+    optd.os = os;
+
+    /* Step 1a */
+    STAILQ_FOREACH(sect, &object->sections, link) {
+        unsigned long offset = 0;
+
+        yasm_bytecode *bc = STAILQ_FIRST(&sect->bcs);
+        yasm_bytecode *prevbc;
+
+        bc->bc_index = bc_index++;
+
+        /* Skip our locally created empty bytecode first. */
+        prevbc = bc;
+        bc = STAILQ_NEXT(bc, link);
+
+        /* Iterate through the remainder, if any. */
+        while (bc) {
+            bc->bc_index = bc_index++;
+            bc->offset = offset;
+
+            retval = yasm_bc_calc_len(bc, optimize_add_span, &optd);
+            yasm_errwarn_propagate(errwarns, bc->line);
+            if (retval)
+                saw_error = 1;
+            else {
+                if (bc->callback->special == YASM_BC_SPECIAL_OFFSET) {
+                    /* Offset setters may depend on the lengths of following
+                     * bytecodes, so their section needs offsets updated
+                     * even if it has no spans.
+                     */
+                    sect->opt_flags |= OPT_SECT_DIRTY;
+
+                    /* Remember it as offset setter */
+                    os->bc = bc;
+                    os->thres = yasm_bc_next_offset(bc);
+
+                    /* Create new placeholder */
+                    os = yasm_xmalloc(sizeof(yasm_offset_setter));
+                    os->bc = NULL;
+                    os->cur_val = 0;
+                    os->new_val = 0;
+                    os->thres = 0;
+                    STAILQ_INSERT_TAIL(&optd.offset_setters, os, link);
+                    optd.os = os;
+
+                    /* Spans the offset setter added for itself are followed
+                     * by the new placeholder, not by the setter.
+                     */
+                    for (span = TAILQ_LAST(&optd.spans, yasm_span_head);
+                         span && span->bc == bc;
+                         span = TAILQ_PREV(span, yasm_span_head, link))
+                        span->os = os;
+
+                    if (bc->multiple) {
+                        yasm_error_set(YASM_ERROR_VALUE,
+                            N_("cannot combine multiples and setting assembly position"));
+                        yasm_errwarn_propagate(errwarns, bc->line);
+                        saw_error = 1;
+                    }
+                }
+
+                offset += bc->len*bc->mult_int;
+            }
+
+            prevbc = bc;
+            bc = STAILQ_NEXT(bc, link);
+        }
+    }
+
+    optd.stats->bytecodes = bc_index;
+
     if (saw_error) {
         optimize_cleanup(&optd);
+        STAILQ_FOREACH(sect, &object->sections, link)
+            sect->opt_flags &= ~OPT_SECT_DIRTY;
         return;
     }
 
-    /* Step 3 */
-    update_all_bc_offsets(object, errwarns);
+    /* Without any spans, offsets calculated in step 1a are final except in
+     * sections with offset setters.
+     */
+    if (TAILQ_EMPTY(&optd.spans)) {
+        optimize_cleanup(&optd);
+        STAILQ_FOREACH(sect, &object->sections, link) {
+            if (sect->opt_flags & OPT_SECT_DIRTY) {
+                update_bc_offsets(sect, errwarns);
+                sect->opt_flags &= ~OPT_SECT_DIRTY;
+            }
+        }
+        return;
+    }
+
+    if (stats)
+        optd.bc_expansions = yasm_xcalloc(bc_index, sizeof(unsigned long));
+
+    /* Step 1b */
+    TAILQ_FOREACH_SAFE(span, &optd.spans, link, span_temp) {
+        /* Flag section as needing offsets updated in step 1c */
+        span->bc->section->opt_flags |= OPT_SECT_DIRTY;
+        span_create_terms(span);
+        if (yasm_error_occurred()) {
+            yasm_errwarn_propagate(errwarns, span->bc->line);
+            saw_error = 1;
+        } else if (recalc_normal_span(span)) {
+            orig_len = span->bc->len * span->bc->mult_int;
+            retval = yasm_bc_expand(span->bc, span->id, span->cur_val,
+                                    span->new_val, &span->neg_thres,
+                                    &span->pos_thres);
+            optimize_note_expand(&optd, "1b", span, orig_len, retval);
+            yasm_errwarn_propagate(errwarns, span->bc->line);
+            if (retval < 0)
+                saw_error = 1;
+            else if (retval > 0) {
+                if (!span->active) {
+                    yasm_error_set(YASM_ERROR_VALUE,
+                        N_("secondary expansion of an external/complex value"));
+                    yasm_errwarn_propagate(errwarns, span->bc->line);
+                    saw_error = 1;
+                }
+            } else {
+                TAILQ_REMOVE(&optd.spans, span, link);
+                span_destroy(span);
+                optd.stats->spans_retired++;
+                continue;
+            }
+        }
+        span->cur_val = span->new_val;
+    }
+
+    if (saw_error) {
+        optimize_cleanup(&optd);
+        STAILQ_FOREACH(sect, &object->sections, link)
+            sect->opt_flags &= ~OPT_SECT_DIRTY;
+        return;
+    }
+
+    /* If no span depends on bytecodes in another section, each section can
+     * be optimized on its own.  This keeps interval indexes and queues small
+     * and leaves sections without spans untouched.  Otherwise fall back to
+     * optimizing all sections together.
+     *
+     * The sections are optimized one after another.  Each pass only touches
+     * its own section's spans and bytecodes, but expanding and recalculating
+     * spans goes through state that is global to libyasm (the pending
+     * error and warnings, the intnum calculation temporaries, and the expr
+     * item pool), so passes can't run concurrently.
+     */
+    TAILQ_FOREACH(span, &optd.spans, link) {
+        if (!span_is_local(span))
+            break;
+    }
+    if (span) {
+        optimize_spans(object, NULL, &optd, errwarns);
+        optimize_cleanup(&optd);
+        STAILQ_FOREACH(sect, &object->sections, link)
+            sect->opt_flags &= ~OPT_SECT_DIRTY;
+        return;
+    }
+
+    while (!TAILQ_EMPTY(&optd.spans)) {
+        optimize_data sectd;
+
+        sect = TAILQ_FIRST(&optd.spans)->bc->section;
+
+        /* Spans are in section order; move this section's spans over. */
+        TAILQ_INIT(&sectd.spans);
+        while ((span = TAILQ_FIRST(&optd.spans)) && span->bc->section == sect)
+        {
+            TAILQ_REMOVE(&optd.spans, span, link);
+            TAILQ_INSERT_TAIL(&sectd.spans, span, link);
+        }
+        STAILQ_INIT(&sectd.offset_setters);   /* owned by optd */
+        optimize_tidx_init(&sectd.tidx);
+        sectd.stats = optd.stats;
+        sectd.trace = optd.trace;
+        sectd.linemap = optd.linemap;
+        sectd.bc_expansions = optd.bc_expansions;
+
+        retval = optimize_spans(object, sect, &sectd, errwarns);
+        sect->opt_flags &= ~OPT_SECT_DIRTY;
+
+        sectd.bc_expansions = NULL;     /* owned by optd */
+        optimize_cleanup(&sectd);
+
+        /* Don't go on to the remaining sections after an error; their
+         * offsets aren't needed.
+         */
+        if (retval) {
+            optimize_cleanup(&optd);
+            STAILQ_FOREACH(sect, &object->sections, link)
+                sect->opt_flags &= ~OPT_SECT_DIRTY;
+            return;
+        }
+    }
     optimize_cleanup(&optd);
+
+    /* Sections whose spans were all retired in step 1b, or that have no
+     * spans but do have offset setters, still need their offsets updated.
+     */
+    STAILQ_FOREACH(sect, &object->sections, link) {
+        if (sect->opt_flags & OPT_SECT_DIRTY) {
+            update_bc_offsets(sect, errwarns);
+            sect->opt_flags &= ~OPT_SECT_DIRTY;
+        }
+    }
+}
+
+void
+yasm_optimize_stats_print(const yasm_optimize_stats *stats,
+                          yasm_linemap *linemap, FILE *f, int indent_level)
+{
+    fprintf(f, "%*sBytecodes=%lu\n", indent_level, "", stats->bytecodes);
+    fprintf(f, "%*sSpans Created=%lu\n", indent_level, "",
+            stats->spans_created);
+    fprintf(f, "%*sSpans Retired=%lu\n", indent_level, "",
+            stats->spans_retired);
+    fprintf(f, "%*sInterval Index Terms=%lu\n", indent_level, "",
+            stats->index_terms);
+    fprintf(f, "%*sCycle Checks=%lu\n", indent_level, "",
+            stats->cycle_checks);
+    fprintf(f, "%*sQA Iterations=%lu\n", indent_level, "", stats->qa_iters);
+    fprintf(f, "%*sQB Iterations=%lu\n", indent_level, "", stats->qb_iters);
+    fprintf(f, "%*sExpansions=%lu\n", indent_level, "", stats->expansions);
+    fprintf(f, "%*sTerm Updates=%lu\n", indent_level, "",
+            stats->term_updates);
+    fprintf(f, "%*sOffset-Setter Cascades=%lu\n", indent_level, "",
+            stats->os_cascades);
+    fprintf(f, "%*sMax Expansions of One Bytecode=%lu", indent_level, "",
+            stats->max_bc_expansions);
+    if (stats->max_bc_expansions > 0) {
+        fputs(" (", f);
+        optimize_print_line(f, linemap, stats->max_bc_line);
+        fputc(')', f);
+    }
+    fputc('\n', f);
 }
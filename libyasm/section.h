@@ -201,6 +201,54 @@ void yasm_object_set_global_suffix(yasm_object *object, const char *suffix);
 YASM_LIB_DECL
 void yasm_object_optimize(yasm_object *object, yasm_errwarns *errwarns);
 
+/** Optimizer statistics.  Filled in by yasm_object_optimize_stats(). */
+typedef struct yasm_optimize_stats {
+    unsigned long bytecodes;        /**< Bytecodes numbered in step 1a */
+    unsigned long spans_created;    /**< Spans registered in step 1a */
+    unsigned long spans_retired;    /**< Spans retired in step 1b */
+    unsigned long index_terms;      /**< Span terms added to interval index */
+    unsigned long cycle_checks;     /**< Spans visited by cycle checking */
+    unsigned long qa_iters;         /**< Spans taken from QA (TIMES) */
+    unsigned long qb_iters;         /**< Spans taken from QB */
+    unsigned long expansions;       /**< Calls to expand for spans */
+    unsigned long term_updates;     /**< Span terms updated by expansions */
+    unsigned long os_cascades;      /**< Offset-setters adjusted in step 2 */
+
+    /** Largest number of expansions of a single bytecode. */
+    unsigned long max_bc_expansions;
+    /** Virtual line of the bytecode with #max_bc_expansions (0 if none). */
+    unsigned long max_bc_line;
+} yasm_optimize_stats;
+
+/** Optimize an object as yasm_object_optimize() does, optionally gathering
+ * statistics and tracing optimizer decisions.
+ * \param object        object
+ * \param errwarns      error/warning set
+ * \param stats         statistics (output, may be NULL)
+ * \param trace         file to write a trace of span expansions and
+ *                      offset-setter adjustments to (may be NULL)
+ * \param linemap       line mapping used to give source file and line in
+ *                      the trace (may be NULL to give virtual lines)
+ * \note Optimization failures are stored into errwarns.
+ */
+YASM_LIB_DECL
+void yasm_object_optimize_stats(yasm_object *object, yasm_errwarns *errwarns,
+                                /*@null@*/ /*@out@*/ yasm_optimize_stats *stats,
+                                /*@null@*/ FILE *trace,
+                                /*@null@*/ yasm_linemap *linemap);
+
+/** Print optimizer statistics.
+ * \param stats         statistics
+ * \param linemap       line mapping used to give source file and line
+ *                      (may be NULL to give virtual lines)
+ * \param f             file
+ * \param indent_level  indentation level
+ */
+YASM_LIB_DECL
+void yasm_optimize_stats_print(const yasm_optimize_stats *stats,
+                               /*@null@*/ yasm_linemap *linemap, FILE *f,
+                               int indent_level);
+
 /** Determine if a section is flagged to contain code.
  * \param sect      section
  * \return Nonzero if section is flagged to contain code.
@@ -253,6 +301,16 @@ YASM_LIB_DECL
 /*@dependent@*/ /*@null@*/ void *yasm_section_get_data
     (yasm_section *sect, const yasm_assoc_data_callback *callback);
 
+/** Get associated data for a section and data callback slot.  Faster
+ * equivalent of yasm_section_get_data().
+ * \param sect      section
+ * \param slot      slot of callback from yasm_assoc_data_register()
+ * \return Associated data (NULL if none).
+ */
+YASM_LIB_DECL
+/*@dependent@*/ /*@null@*/ void *yasm_section_get_slot_data
+    (yasm_section *sect, unsigned int slot);
+
 /** Add associated data to a section.
  * \attention Deletes any existing associated data for that data callback.
  * \param sect      section
@@ -318,6 +376,20 @@ yasm_bytecode *yasm_section_bcs_first(yasm_section *sect);
 YASM_LIB_DECL
 yasm_bytecode *yasm_section_bcs_last(yasm_section *sect);
 
+/** Insert bytecode into a section after another bytecode.  Intended for
+ * use while the section is being finalized; the inserted bytecode is not
+ * finalized.
+ * \note Does not make a copy of bc; so don't pass this function static or
+ *       local variables, and discard the bc pointer after calling this
+ *       function.
+ * \param sect          section
+ * \param prevbc        bytecode in sect to insert after
+ * \param bc            bytecode
+ */
+YASM_LIB_DECL
+void yasm_section_bcs_insert_after(yasm_section *sect, yasm_bytecode *prevbc,
+                                   /*@only@*/ yasm_bytecode *bc);
+
 /** Add bytecode to the end of a section.
  * \note Does not make a copy of bc; so don't pass this function static or
  *       local variables, and discard the bc pointer after calling this
@@ -32,7 +32,6 @@
 #include "libyasm-stdint.h"
 #include "coretype.h"
 #include "valparam.h"
-#include "hamt.h"
 #include "assocdat.h"
 
 #include "errwarn.h"
@@ -57,8 +56,18 @@ typedef enum {
                                    purpose */
 } sym_type;
 
+/* State of the remembered integer value of an EQU */
+typedef enum {
+    EQU_INTN_UNKNOWN = 0,       /* not yet computed */
+    EQU_INTN_UNKNOWN_FINAL,     /* not yet computed, but parsing is done so
+                                   undefined symbols will stay undefined */
+    EQU_INTN_BUSY,              /* being computed (catches circular refs) */
+    EQU_INTN_CONST,             /* equ_intn holds the value */
+    EQU_INTN_NONE               /* not an integer constant */
+} equ_intn_state;
+
 struct yasm_symrec {
-    char *name;
+    /*@dependent@*/ const char *name;   /* interned */
     sym_type type;
     yasm_sym_status status;
     yasm_sym_vis visibility;
@@ -74,8 +83,15 @@ struct yasm_symrec {
     unsigned int size;          /* 0 if not user-defined */
     const char *segment;        /* for segmented systems like DOS */
 
+    /* integer value of an EQU, see yasm_symrec__get_equ_intnum() */
+    equ_intn_state equ_state;
+    /*@null@*/ /*@only@*/ yasm_intnum *equ_intn;
+
     /* associated data; NULL if none */
     /*@null@*/ /*@only@*/ yasm__assoc_data *assoc_data;
+
+    /* next symbol in the table (in order of creation) */
+    /*@reldef@*/ STAILQ_ENTRY(yasm_symrec) link;
 };
 
 /* Linked list of symbols not in the symbol table. */
@@ -85,11 +101,26 @@ typedef struct non_table_symrec_s {
 } non_table_symrec;
 
 struct yasm_symtab {
-    /* The symbol table: a hash array mapped trie (HAMT). */
-    /*@only@*/ HAMT *sym_table;
+    /* The symbol table: an open-addressed (linear probing) hash table keyed
+     * by interned name, so names are compared by pointer.  The size is
+     * always a power of 2 and kept at least twice the symbol count.
+     */
+    /*@only@*/ yasm_symrec **sym_table;
+    unsigned long sym_table_size;
+    unsigned long num_syms;
+
+    /* Symbols in the table, in order of creation */
+    STAILQ_HEAD(symtab_syms_head, yasm_symrec) syms;
+
     /* Symbols not in the table */
     SLIST_HEAD(nontablesymhead_s, non_table_symrec_s) non_table_syms;
 
+    /* Flat index returned by yasm_symtab_get_index(); both arrays are
+     * index_alloc entries long.
+     */
+    yasm_symtab_index index;
+    unsigned long index_alloc;
+
     int case_sensitive;
 };
 
@@ -134,8 +165,21 @@ yasm_symtab *
 yasm_symtab_create(void)
 {
     yasm_symtab *symtab = yasm_xmalloc(sizeof(yasm_symtab));
-    symtab->sym_table = HAMT_create(0, yasm_internal_error_);
+    unsigned long i;
+
+    symtab->sym_table_size = 256;
+    symtab->sym_table =
+        yasm_xmalloc(symtab->sym_table_size*sizeof(yasm_symrec *));
+    for (i=0; i<symtab->sym_table_size; i++)
+        symtab->sym_table[i] = NULL;
+    symtab->num_syms = 0;
+    STAILQ_INIT(&symtab->syms);
     SLIST_INIT(&symtab->non_table_syms);
+    symtab->index.syms = NULL;
+    symtab->index.num_syms = 0;
+    symtab->index.exported = NULL;
+    symtab->index.num_exported = 0;
+    symtab->index_alloc = 0;
     symtab->case_sensitive = 1;
     return symtab;
 }
@@ -150,24 +194,78 @@ static void
 symrec_destroy_one(/*@only@*/ void *d)
 {
     yasm_symrec *sym = d;
-    yasm_xfree(sym->name);
     if (sym->type == SYM_EQU && (sym->status & YASM_SYM_VALUED))
         yasm_expr_destroy(sym->value.expn);
+    if (sym->equ_intn)
+        yasm_intnum_destroy(sym->equ_intn);
     yasm__assoc_data_destroy(sym->assoc_data);
     yasm_xfree(sym);
 }
 
+/* Intern a symbol name, folding it to lowercase if the table is not case
+ * sensitive.  If insert is 0, only look up the name; NULL is returned if it
+ * has never been interned (so can't be in the table).
+ */
+static /*@dependent@*/ /*@null@*/ const char *
+symtab_intern(const yasm_symtab *symtab, const char *name, int insert)
+{
+    char buf[128];
+    char *lname;
+    const char *iname;
+    size_t i, len;
+
+    if (symtab->case_sensitive)
+        return insert ? yasm__intern(name) : yasm__intern_find(name);
+
+    len = strlen(name);
+    lname = (len < sizeof(buf)) ? buf : yasm_xmalloc(len+1);
+    for (i=0; i<len; i++)
+        lname[i] = tolower(name[i]);
+    if (insert)
+        iname = yasm__internn(lname, len);
+    else
+        iname = yasm__intern_findn(lname, len);
+    if (lname != buf)
+        yasm_xfree(lname);
+    return iname;
+}
+
+/* Find the table slot holding the symbol with interned name iname, or the
+ * empty slot where it belongs.
+ */
+static yasm_symrec **
+symtab_find_slot(const yasm_symtab *symtab, const char *iname)
+{
+    unsigned long mask = symtab->sym_table_size-1;
+    unsigned long i = yasm__intern_hash(iname) & mask;
+
+    while (symtab->sym_table[i] && symtab->sym_table[i]->name != iname)
+        i = (i+1) & mask;
+    return &symtab->sym_table[i];
+}
+
+static void
+symtab_grow(yasm_symtab *symtab)
+{
+    yasm_symrec *sym;
+    unsigned long i;
+
+    yasm_xfree(symtab->sym_table);
+    symtab->sym_table_size *= 2;
+    symtab->sym_table =
+        yasm_xmalloc(symtab->sym_table_size*sizeof(yasm_symrec *));
+    for (i=0; i<symtab->sym_table_size; i++)
+        symtab->sym_table[i] = NULL;
+
+    STAILQ_FOREACH(sym, &symtab->syms, link)
+        *symtab_find_slot(symtab, sym->name) = sym;
+}
+
 static /*@partial@*/ yasm_symrec *
-symrec_new_common(/*@keep@*/ char *name, int case_sensitive)
+symrec_new_common(/*@dependent@*/ const char *name)
 {
     yasm_symrec *rec = yasm_xmalloc(sizeof(yasm_symrec));
 
-    if (!case_sensitive) {
-        char *c;
-        for (c=name; *c; c++)
-            *c = tolower(*c);
-    }
-
     rec->name = name;
     rec->type = SYM_UNKNOWN;
     rec->def_line = 0;
@@ -176,33 +274,37 @@ symrec_new_common(/*@keep@*/ char *name, int case_sensitive)
     rec->visibility = YASM_SYM_LOCAL;
     rec->size = 0;
     rec->segment = NULL;
+    rec->equ_state = EQU_INTN_UNKNOWN;
+    rec->equ_intn = NULL;
     rec->assoc_data = NULL;
     return rec;
 }
 
 static /*@partial@*/ /*@dependent@*/ yasm_symrec *
-symtab_get_or_new_in_table(yasm_symtab *symtab, /*@only@*/ char *name)
+symtab_get_or_new_in_table(yasm_symtab *symtab, const char *name)
 {
-    yasm_symrec *rec = symrec_new_common(name, symtab->case_sensitive);
-    int replace = 0;
+    const char *iname = symtab_intern(symtab, name, 1);
+    yasm_symrec **slot = symtab_find_slot(symtab, iname);
+    yasm_symrec *rec;
 
-    rec->status = YASM_SYM_NOSTATUS;
+    if (*slot)
+        return *slot;
 
-    if (!symtab->case_sensitive) {
-        char *c;
-        for (c=name; *c; c++)
-            *c = tolower(*c);
-    }
+    rec = symrec_new_common(iname);
+    rec->status = YASM_SYM_NOSTATUS;
+    *slot = rec;
+    STAILQ_INSERT_TAIL(&symtab->syms, rec, link);
 
-    return HAMT_insert(symtab->sym_table, name, rec, &replace,
-                       symrec_destroy_one);
+    if (++symtab->num_syms*2 >= symtab->sym_table_size)
+        symtab_grow(symtab);
+    return rec;
 }
 
 static /*@partial@*/ /*@dependent@*/ yasm_symrec *
-symtab_get_or_new_not_in_table(yasm_symtab *symtab, /*@only@*/ char *name)
+symtab_get_or_new_not_in_table(yasm_symtab *symtab, const char *name)
 {
     non_table_symrec *sym = yasm_xmalloc(sizeof(non_table_symrec));
-    sym->rec = symrec_new_common(name, symtab->case_sensitive);
+    sym->rec = symrec_new_common(symtab_intern(symtab, name, 1));
 
     sym->rec->status = YASM_SYM_NOTINTABLE;
 
@@ -212,42 +314,70 @@ symtab_get_or_new_not_in_table(yasm_symtab *symtab, /*@only@*/ char *name)
 }
 
 /* create a new symrec */
-/*@-freshtrans -mustfree@*/
 static /*@partial@*/ /*@dependent@*/ yasm_symrec *
 symtab_get_or_new(yasm_symtab *symtab, const char *name, int in_table)
 {
-    char *symname = yasm__xstrdup(name);
-
     if (in_table)
-        return symtab_get_or_new_in_table(symtab, symname);
+        return symtab_get_or_new_in_table(symtab, name);
     else
-        return symtab_get_or_new_not_in_table(symtab, symname);
+        return symtab_get_or_new_not_in_table(symtab, name);
 }
-/*@=freshtrans =mustfree@*/
 
 int
 yasm_symtab_traverse(yasm_symtab *symtab, void *d,
                      int (*func) (yasm_symrec *sym, void *d))
 {
-    return HAMT_traverse(symtab->sym_table, d, (int (*) (void *, void *))func);
+    yasm_symrec *sym;
+    STAILQ_FOREACH(sym, &symtab->syms, link) {
+        int retval = func(sym, d);
+        if (retval != 0)
+            return retval;
+    }
+    return 0;
 }
 
 const yasm_symtab_iter *
 yasm_symtab_first(const yasm_symtab *symtab)
 {
-    return (const yasm_symtab_iter *)HAMT_first(symtab->sym_table);
+    return (const yasm_symtab_iter *)STAILQ_FIRST(&symtab->syms);
 }
 
 /*@null@*/ const yasm_symtab_iter *
 yasm_symtab_next(const yasm_symtab_iter *prev)
 {
-    return (const yasm_symtab_iter *)HAMT_next((const HAMTEntry *)prev);
+    return (const yasm_symtab_iter *)
+        STAILQ_NEXT((const yasm_symrec *)prev, link);
 }
 
 yasm_symrec *
 yasm_symtab_iter_value(const yasm_symtab_iter *cur)
 {
-    return (yasm_symrec *)HAMTEntry_get_data((const HAMTEntry *)cur);
+    return (yasm_symrec *)cur;
+}
+
+const yasm_symtab_index *
+yasm_symtab_get_index(yasm_symtab *symtab)
+{
+    yasm_symtab_index *index = &symtab->index;
+    yasm_symrec *sym;
+
+    if (symtab->num_syms > symtab->index_alloc) {
+        symtab->index_alloc = symtab->num_syms;
+        index->syms = yasm_xrealloc(index->syms,
+            symtab->index_alloc*sizeof(yasm_symrec *));
+        index->exported = yasm_xrealloc(index->exported,
+            symtab->index_alloc*sizeof(yasm_symrec *));
+    }
+
+    index->num_syms = 0;
+    index->num_exported = 0;
+    STAILQ_FOREACH(sym, &symtab->syms, link) {
+        index->syms[index->num_syms++] = sym;
+        if (sym->visibility &
+            (YASM_SYM_GLOBAL | YASM_SYM_COMMON | YASM_SYM_EXTERN))
+            index->exported[index->num_exported++] = sym;
+    }
+    return index;
 }
 
 yasm_symrec *
@@ -277,17 +407,10 @@ yasm_symtab_use(yasm_symtab *symtab, const char *name, unsigned long line)
 yasm_symrec *
 yasm_symtab_get(yasm_symtab *symtab, const char *name)
 {
-    if (!symtab->case_sensitive) {
-        char *_name = yasm__xstrdup(name);
-        char *c;
-        yasm_symrec *ret;
-        for (c=_name; *c; c++)
-            *c = tolower(*c);
-        ret = HAMT_search(symtab->sym_table, _name);
-        yasm_xfree(_name);
-        return ret;
-    } else
-      return HAMT_search(symtab->sym_table, name);
+    const char *iname = symtab_intern(symtab, name, 0);
+    if (!iname)
+        return NULL;
+    return *symtab_find_slot(symtab, iname);
 }
 
 static /*@dependent@*/ yasm_symrec *
@@ -341,6 +464,21 @@ yasm_symtab_define_label(yasm_symtab *symtab, const char *name,
     return rec;
 }
 
+void
+yasm_symtab_move_labels(yasm_bytecode *from, yasm_bytecode *to)
+{
+    yasm_symrec **sym;
+
+    if (!from->symrecs)
+        return;
+    for (sym = from->symrecs; *sym; sym++) {
+        (*sym)->value.precbc = to;
+        yasm_bc__add_symrec(to, *sym);
+    }
+    yasm_xfree(from->symrecs);
+    from->symrecs = NULL;
+}
+
 yasm_symrec *
 yasm_symtab_define_curpos(yasm_symtab *symtab, const char *name,
                           yasm_bytecode *precbc, unsigned long line)
@@ -411,6 +549,12 @@ symtab_parser_finalize_checksym(yasm_symrec *sym, /*@null@*/ void *d)
 {
     symtab_finalize_info *info = (symtab_finalize_info *)d;
 
+    /* No more symbols will be defined, so an EQU that depends on an
+     * undefined (or extern) symbol will never become constant.
+     */
+    if (sym->type == SYM_EQU && sym->equ_state == EQU_INTN_UNKNOWN)
+        sym->equ_state = EQU_INTN_UNKNOWN_FINAL;
+
     /* error if a symbol is used but never defined or extern/common declared */
     if ((sym->status & YASM_SYM_USED) && !(sym->status & YASM_SYM_DEFINED) &&
         !(sym->visibility & (YASM_SYM_EXTERN | YASM_SYM_COMMON))) {
@@ -447,7 +591,16 @@ yasm_symtab_parser_finalize(yasm_symtab *symtab, int undef_extern,
 void
 yasm_symtab_destroy(yasm_symtab *symtab)
 {
-    HAMT_destroy(symtab->sym_table, symrec_destroy_one);
+    while (!STAILQ_EMPTY(&symtab->syms)) {
+        yasm_symrec *sym = STAILQ_FIRST(&symtab->syms);
+        STAILQ_REMOVE_HEAD(&symtab->syms, link);
+        symrec_destroy_one(sym);
+    }
+    yasm_xfree(symtab->sym_table);
+    if (symtab->index.syms)
+        yasm_xfree(symtab->index.syms);
+    if (symtab->index.exported)
+        yasm_xfree(symtab->index.exported);
 
     while (!SLIST_EMPTY(&symtab->non_table_syms)) {
         non_table_symrec *sym = SLIST_FIRST(&symtab->non_table_syms);
@@ -544,6 +697,56 @@ yasm_symrec_get_equ(const yasm_symrec *sym)
     return (const yasm_expr *)NULL;
 }
 
+static int
+symrec_is_undef(const yasm_expr__item *ei, /*@unused@*/ void *d)
+{
+    return (ei->type == YASM_EXPR_SYM &&
+            !(ei->data.sym->status & YASM_SYM_DEFINED));
+}
+
+const yasm_intnum *
+yasm_symrec__get_equ_intnum(yasm_symrec *sym)
+{
+    yasm_expr *e;
+    const yasm_intnum *intn;
+    equ_intn_state unknown_state = sym->equ_state;
+
+    if (sym->type != SYM_EQU || !(sym->status & YASM_SYM_VALUED))
+        return NULL;
+    if (sym->equ_state != EQU_INTN_UNKNOWN
+        && sym->equ_state != EQU_INTN_UNKNOWN_FINAL)
+        return sym->equ_intn;
+
+    /* Only evaluate with no error or warning pending, so anything raised
+     * while evaluating can be discarded: the caller falls back to expanding
+     * the EQU in place, which raises it again where it belongs.
+     */
+    if (yasm_error_occurred() || yasm_warn_occurred())
+        return NULL;
+
+    sym->equ_state = EQU_INTN_BUSY;
+    e = yasm_expr_copy(sym->value.expn);
+    intn = yasm_expr_get_intnum(&e, 0);
+    if (yasm_error_occurred() || yasm_warn_occurred()) {
+        yasm_error_clear();
+        yasm_warn_clear();
+        sym->equ_state = EQU_INTN_NONE;
+    } else if (intn) {
+        sym->equ_intn = yasm_intnum_copy(intn);
+        sym->equ_state = EQU_INTN_CONST;
+    } else if (yasm_expr__traverse_leaves_in_const(e, NULL,
+                                                   symrec_is_undef)) {
+        /* May still become constant once the rest is defined, unless
+         * parsing is already done.
+         */
+        sym->equ_state = unknown_state == EQU_INTN_UNKNOWN_FINAL ?
+            EQU_INTN_NONE : EQU_INTN_UNKNOWN;
+    } else
+        sym->equ_state = EQU_INTN_NONE;
+    yasm_expr_destroy(e);
+    return sym->equ_intn;
+}
+
 int
 yasm_symrec_get_label(const yasm_symrec *sym,
                       yasm_symrec_get_label_bytecodep *precbc)
@@ -635,6 +838,12 @@ yasm_symrec_get_data(yasm_symrec *sym,
     return yasm__assoc_data_get(sym->assoc_data, callback);
 }
 
+void *
+yasm_symrec_get_slot_data(yasm_symrec *sym, unsigned int slot)
+{
+    return yasm__assoc_data_get_slot(sym->assoc_data, slot);
+}
+
 void
 yasm_symrec_add_data(yasm_symrec *sym,
                      const yasm_assoc_data_callback *callback, void *data)
@@ -136,6 +136,16 @@ YASM_LIB_DECL
     (yasm_symtab *symtab, const char *name,
      /*@dependent@*/ yasm_bytecode *precbc, int in_table, unsigned long line);
 
+/** Move the labels following a bytecode so that they follow another
+ * bytecode instead.  Used when a bytecode is inserted between a label and
+ * the bytecode it labels.  Only labels in the symbol table are moved.
+ * \param from     bytecode the labels currently follow
+ * \param to       bytecode the labels should follow
+ */
+YASM_LIB_DECL
+void yasm_symtab_move_labels(yasm_bytecode *from,
+                             /*@dependent@*/ yasm_bytecode *to);
+
 /** Define a symbol as a label representing the current assembly position.
  * This should be used for this purpose instead of yasm_symtab_define_label()
  * as value_finalize_scan() looks for usage of this symbol type for special
@@ -231,6 +241,31 @@ YASM_LIB_DECL
 YASM_LIB_DECL
 yasm_symrec *yasm_symtab_iter_value(const yasm_symtab_iter *cur);
 
+/** Flat index of the symbols in a symbol table, for object formats that
+ * make several passes over the symbols at output time.
+ */
+typedef struct yasm_symtab_index {
+    /** All symbols in the table, in order of creation. */
+    /*@dependent@*/ yasm_symrec **syms;
+    size_t num_syms;            /**< Number of symbols in syms */
+
+    /** The symbols with #YASM_SYM_GLOBAL, #YASM_SYM_COMMON, or
+     * #YASM_SYM_EXTERN visibility, in order of creation.
+     */
+    /*@dependent@*/ yasm_symrec **exported;
+    size_t num_exported;        /**< Number of symbols in exported */
+} yasm_symtab_index;
+
+/** Build an index of the symbols in the symbol table.  The index reflects
+ * the table at the time of the call; call this once all symbols have been
+ * defined and declared (typically at the start of object output).
+ * \param symtab    symbol table
+ * \return Index; owned by the symbol table and valid until the next call or
+ *         until the symbol table is destroyed.
+ */
+YASM_LIB_DECL
+const yasm_symtab_index *yasm_symtab_get_index(yasm_symtab *symtab);
+
 /** Finalize symbol table after parsing stage.  Checks for symbols that are
  * used but never defined or declared #YASM_SYM_EXTERN or #YASM_SYM_COMMON.
  * \param symtab        symbol table
@@ -309,6 +344,18 @@ YASM_LIB_DECL
 /*@observer@*/ /*@null@*/ const yasm_expr *yasm_symrec_get_equ
     (const yasm_symrec *sym);
 
+/** Get the value of an EQU symbol if it simplifies to an integer constant.
+ * The value is computed the first time it's needed and remembered, so an
+ * EQU referenced many times (directly or through other EQUs) is only
+ * expanded and simplified once.  For expression use only.
+ * \param sym       symbol
+ * \return Integer value, or NULL if symbol is not an EQU, is not defined, or
+ *         does not (yet) simplify to an integer constant.
+ */
+YASM_LIB_DECL
+/*@observer@*/ /*@null@*/ const yasm_intnum *yasm_symrec__get_equ_intnum
+    (yasm_symrec *sym);
+
 /** Dependent pointer to a bytecode. */
 typedef /*@dependent@*/ yasm_bytecode *yasm_symrec_get_label_bytecodep;
 
@@ -411,6 +458,16 @@ YASM_LIB_DECL
 /*@dependent@*/ /*@null@*/ void *yasm_symrec_get_data
     (yasm_symrec *sym, const yasm_assoc_data_callback *callback);
 
+/** Get associated data for a symbol and data callback slot.  Faster
+ * equivalent of yasm_symrec_get_data().
+ * \param sym       symbol
+ * \param slot      slot of callback from yasm_assoc_data_register()
+ * \return Associated data (NULL if none).
+ */
+YASM_LIB_DECL
+/*@dependent@*/ /*@null@*/ void *yasm_symrec_get_slot_data
+    (yasm_symrec *sym, unsigned int slot);
+
 /** Add associated data to a symbol.
  * \attention Deletes any existing associated data for that data callback.
  * \param sym       symbol
@@ -0,0 +1,14 @@
+; A span in one section depending on bytecodes in another forces all
+; sections to be optimized together.
+section .text1
+a1:
+jmp b1
+times 126 nop
+b1:
+ret
+
+section .text2 follows=.text1
+times (b1-a1) db 0x90
+jmp c2
+times 200 nop
+c2:
@@ -0,0 +1,17 @@
+; Spans local to each section are optimized section by section.
+section .text1
+a1:
+jmp b1
+times 130 nop
+b1:
+jmp a1
+
+section .text2 follows=.text1
+a2:
+jz b2
+times 10 nop
+align 8
+b2:
+jmp a2
+times 120 nop
+jmp a2
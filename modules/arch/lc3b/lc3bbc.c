@@ -57,7 +57,8 @@ static const yasm_bytecode_callback lc3b_bc_callback_insn = {
     lc3b_bc_insn_calc_len,
     lc3b_bc_insn_expand,
     lc3b_bc_insn_tobytes,
-    0
+    0,
+    NULL
 };
 
 
@@ -18,9 +18,6 @@ static void mips_bc_insn_print(const void *contents, FILE *f,
 static int mips_bc_insn_calc_len(yasm_bytecode *bc,
                                  yasm_bc_add_span_func add_span,
                                  void *add_span_data);
-static int mips_bc_insn_expand(yasm_bytecode *bc, int span, long old_val,
-                               long new_val, /*@out@*/ long *neg_thres,
-                               /*@out@*/ long *pos_thres);
 static int mips_bc_insn_tobytes(yasm_bytecode *bc, unsigned char **bufp,
                                 unsigned char *bufstart,
                                 void *d, yasm_output_value_func output_value,
@@ -34,9 +31,10 @@ static const yasm_bytecode_callback mips_bc_callback_insn = {
     yasm_bc_finalize_common,
     NULL,                       /* return elements size of a data bytecode */
     mips_bc_insn_calc_len,      /* calculates the minimum size of a bytecode, called from yasm_bc_calc_len() */
-    mips_bc_insn_expand,        /* recalculates the bytecode's length baed on an expanded span length, called from yasm_bc_expand() */
+    yasm_bc_expand_common,      /* fixed length instructions never add spans */
     mips_bc_insn_tobytes,       /* covnert a bytecode into its byte representation, called from yasm_bc_tobytes() */
-    0
+    0,
+    NULL
 };
 
 
@@ -145,25 +143,14 @@ static int
 mips_bc_insn_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
                       void *add_span_data)
 {
-    /* TBD, really need to understand how this works */
-
-    /* Fixed size instruction length */
+    /* Fixed size instruction length; no spans, so the optimizer can
+     * compute all offsets in a single pass.
+     */
     bc->len += 4;
 
     return 0;
 }
 
-/*
- * recalculates the bytecode's length baed on an expanded span length, called from yasm_bc_expand()
- */
-static int
-mips_bc_insn_expand(yasm_bytecode *bc, int span, long old_val, long new_val,
-                    /*@out@*/ long *neg_thres, /*@out@*/ long *pos_thres)
-{
-    yasm_error_set(YASM_ERROR_VALUE, N_("jump target out of range"));
-    return -1;
-}
-
 /*
  * covnert a bytecode into its byte representation, called from yasm_bc_tobytes()
  */
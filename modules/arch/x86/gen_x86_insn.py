@@ -631,15 +631,25 @@ def output_groups(f):
     lprint("};\n", f)
 
     # Output groups
+    # All groups go into a single array so each form has a unique row
+    # number; each group name is defined as a pointer to its first row.
     seen = set()
+    starts = []
+    row = 0
+    lprint("static const x86_insn_info insn_info[] = {", f)
     for name in groupnames_ordered:
         if name in seen:
             continue
         seen.add(name)
-        lprint("static const x86_insn_info %s_insn[] = {" % name, f)
-        lprint("   ", f, '')
-        lprint(",\n    ".join(str(x) for x in groups[name]), f)
-        lprint("};\n", f)
+        starts.append((name, row, len(groups[name])))
+        row += len(groups[name])
+        lprint("    /* %s */" % name, f)
+        lprint("    " + ",\n    ".join(str(x) for x in groups[name]) + ",",
+               f)
+    lprint("};\n", f)
+    for name, start, num in starts:
+        lprint("#define %s_insn\t(&insn_info[%d])" % (name, start), f)
+        lprint("#define %s_insn_num\t%d" % (name, num), f)
 
 #####################################################################
 # General instruction groupings
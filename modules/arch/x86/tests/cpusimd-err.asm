@@ -0,0 +1,9 @@
+[bits 32]
+cpu 686 mmx
+movd mm0, eax
+movd xmm0, eax
+cpu 686 mmx sse2
+movd xmm0, eax
+cpu 686 mmx
+movd xmm0, eax
+movd mm1, eax
@@ -0,0 +1,27 @@
+[bits 64]
+[cpu jccalign]
+start:
+times 28 nop
+cmp eax, 1		; pair would cross, padded to 32
+jne start
+times 15 nop
+jmp near start		; fits, no padding
+times 4 nop
+jmp near start		; would cross, padded to 64
+times 27 nop
+ret			; ends before boundary, no padding
+times 30 nop
+call start		; would cross, padded to 128
+dec ecx
+jnz fwd
+times 21 nop
+fwd:
+jmp fwd			; would end on boundary, padded to 160 along with fwd
+times 27 nop
+jmp $+2			; short once optimized, fits, no padding
+times 29 nop
+call $+5		; would cross, padded to 224; $ is the call itself
+pop rax
+[cpu nojccalign]
+times 29 nop
+jmp start		; not padded
@@ -0,0 +1,24 @@
+[bits 64]
+[cpu prefixalign]
+start:
+mov eax, 1
+add rcx, rdx
+xor eax, eax
+align 16
+loop1:
+dec ecx
+vmovaps ymm0, ymm1
+jnz loop1
+mov ebx, [rbx+8]
+align 16
+[bits 32]
+inc eax
+mov eax, [ebx]
+push eax
+align 16
+movsb
+call eax
+align 8
+[cpu noprefixalign]
+inc eax
+align 16
@@ -68,6 +68,8 @@ x86_create(const char *machine, const char *parser,
     arch_x86->cpu_enables = yasm_xmalloc(sizeof(wordptr));
     arch_x86->cpu_enables[0] = BitVector_Create(64, FALSE);
     BitVector_Fill(arch_x86->cpu_enables[0]);
+    arch_x86->cpu_forms = yasm_xmalloc(sizeof(wordptr));
+    arch_x86->cpu_forms[0] = NULL;
 
     arch_x86->amd64_machine = amd64_machine;
     arch_x86->mode_bits = 0;
@@ -76,6 +78,8 @@ x86_create(const char *machine, const char *parser,
     arch_x86->default_rel = 0;
     arch_x86->gas_intel_mode = 0;
     arch_x86->nop = X86_NOP_BASIC;
+    arch_x86->jcc_align = 0;
+    arch_x86->prefix_align = 0;
 
     if (yasm__strcasecmp(parser, "nasm") == 0)
         arch_x86->parser = X86_PARSER_NASM;
@@ -90,6 +94,8 @@ x86_create(const char *machine, const char *parser,
         return NULL;
     }
 
+    yasm_x86__create_form_index(arch_x86);
+
     return (yasm_arch *)arch_x86;
 }
 
@@ -98,9 +104,14 @@ x86_destroy(/*@only@*/ yasm_arch *arch)
 {
     yasm_arch_x86 *arch_x86 = (yasm_arch_x86 *)arch;
     unsigned int i;
-    for (i=0; i<arch_x86->cpu_enables_size; i++)
+    for (i=0; i<arch_x86->cpu_enables_size; i++) {
         BitVector_Destroy(arch_x86->cpu_enables[i]);
+        if (arch_x86->cpu_forms[i])
+            BitVector_Destroy(arch_x86->cpu_forms[i]);
+    }
     yasm_xfree(arch_x86->cpu_enables);
+    yasm_xfree(arch_x86->cpu_forms);
+    yasm_x86__destroy_form_index(arch_x86);
     yasm_xfree(arch);
 }
 
@@ -222,11 +233,9 @@ x86_dir_code64(yasm_object *object, yasm_valparamhead *valparams,
     arch_x86->mode_bits = 64;
 }
 
-static const unsigned char **
-x86_get_fill(const yasm_arch *arch)
+const unsigned char **
+yasm_x86__get_fill(unsigned int mode_bits, unsigned int nop)
 {
-    const yasm_arch_x86 *arch_x86 = (const yasm_arch_x86 *)arch;
-
     /* Fill patterns that GAS uses. */
     static const unsigned char fill16_1[1] =
         {0x90};                                 /* 1 - nop */
@@ -431,13 +440,13 @@ x86_get_fill(const yasm_arch *arch)
         fill32amd_12,   fill32amd_13,   fill32amd_14,   fill32amd_15
     };
 
-    switch (arch_x86->mode_bits) {
+    switch (mode_bits) {
         case 16:
             return fill16;
         case 32:
-            if (arch_x86->nop == X86_NOP_INTEL)
+            if (nop == X86_NOP_INTEL)
                 return fill32_intel;
-            else if (arch_x86->nop == X86_NOP_AMD)
+            else if (nop == X86_NOP_AMD)
                 return fill32_amd;
             else
                 return fill32;
@@ -445,7 +454,7 @@ x86_get_fill(const yasm_arch *arch)
             /* We know long nops are available in 64-bit mode; default to Intel
              * ones if unspecified (to match GAS behavior).
              */
-            if (arch_x86->nop == X86_NOP_AMD)
+            if (nop == X86_NOP_AMD)
                 return fill32_amd;
             else
                 return fill32_intel;
@@ -456,6 +465,13 @@ x86_get_fill(const yasm_arch *arch)
     }
 }
 
+static const unsigned char **
+x86_get_fill(const yasm_arch *arch)
+{
+    const yasm_arch_x86 *arch_x86 = (const yasm_arch_x86 *)arch;
+    return yasm_x86__get_fill(arch_x86->mode_bits, arch_x86->nop);
+}
+
 unsigned int
 yasm_x86__get_reg_size(uintptr_t reg)
 {
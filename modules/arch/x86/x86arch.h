@@ -94,6 +94,35 @@ enum x86_parser_type {
 
 #define PARSER(arch) (((arch)->parser == X86_PARSER_GAS && (arch)->gas_intel_mode) ? X86_PARSER_NASM : (arch)->parser)
 
+/* Precomputed match data for one instruction form (one row of the
+ * instruction info table), used to quickly reject forms that can't match
+ * before doing the full operand checks.  See x86id.c.
+ */
+typedef struct x86_insn_form {
+    /* Mode, AVX, parser, and operand count combinations accepted */
+    unsigned int key;
+
+    /* Operand classes accepted, one bit field per operand */
+    unsigned long opclass;
+} x86_insn_form;
+
+/* Forms of one instruction that pass the form index tests for one lookup
+ * key and operand class signature, in table order.  Built the first time an
+ * instruction is used with that combination of operands.  See x86id.c.
+ */
+typedef struct x86_form_list {
+    /*@null@*/ /*@owned@*/ struct x86_form_list *next;  /* hash chain */
+
+    /* What the list was built for */
+    unsigned int group;         /* first info row of the instruction */
+    unsigned int key;
+    unsigned long sig, rev_sig;
+
+    /* Matching info rows */
+    unsigned int num_rows;
+    /*@only@*/ unsigned int *rows;
+} x86_form_list;
+
 typedef struct yasm_arch_x86 {
     yasm_arch_base arch;        /* base structure */
 
@@ -101,6 +130,10 @@ typedef struct yasm_arch_x86 {
     unsigned int active_cpu;        /* active index into cpu_enables table */
     unsigned int cpu_enables_size;  /* size of cpu_enables table */
     wordptr *cpu_enables;
+    /* Instruction info rows available with each cpu_enables entry,
+     * parallel to cpu_enables; built on first use (NULL until then).
+     */
+    /*@null@*/ wordptr *cpu_forms;
 
     unsigned int amd64_machine;
     enum x86_parser_type parser;
@@ -110,11 +143,29 @@ typedef struct yasm_arch_x86 {
     unsigned int default_rel;
     unsigned int gas_intel_mode;
 
+    /* Form index, one entry per instruction info row */
+    /*@only@*/ x86_insn_form *forms;
+
+    /* Hash table of form lists, keyed on the instruction and operands */
+    /*@only@*/ x86_form_list **form_lists;
+    unsigned int form_lists_size;   /* number of buckets (power of 2) */
+    unsigned int num_form_lists;
+
     enum {
         X86_NOP_BASIC = 0,
         X86_NOP_INTEL = 1,
         X86_NOP_AMD = 2
     } nop;
+
+    /* Pad before branches (and macro-fused compare/branch pairs) so they
+     * don't cross or end on a 32-byte boundary (Intel JCC erratum).
+     */
+    unsigned int jcc_align;
+
+    /* Absorb code alignment padding into redundant prefixes on the
+     * instructions leading up to it, rather than filling with NOPs.
+     */
+    unsigned int prefix_align;
 } yasm_arch_x86;
 
 /* 0-15 (low 4 bits) used for register number, stored in same data area.
@@ -291,6 +342,10 @@ typedef struct x86_jmpfar {
     yasm_value offset;          /* target offset */
 } x86_jmpfar;
 
+/*@only@*/ yasm_bytecode *yasm_x86__bc_create_branch_pad
+    (const unsigned char **fill, unsigned int num_bcs, unsigned long line);
+/*@only@*/ yasm_bytecode *yasm_x86__bc_create_prefix_pad(unsigned long line);
+
 void yasm_x86__bc_transform_insn(yasm_bytecode *bc, x86_insn *insn);
 void yasm_x86__bc_transform_jmp(yasm_bytecode *bc, x86_jmp *jmp);
 void yasm_x86__bc_transform_jmpfar(yasm_bytecode *bc, x86_jmpfar *jmpfar);
@@ -326,6 +381,12 @@ int yasm_x86__intnum_tobytes
 
 unsigned int yasm_x86__get_reg_size(uintptr_t reg);
 
+const unsigned char **yasm_x86__get_fill(unsigned int mode_bits,
+                                         unsigned int nop);
+
+void yasm_x86__create_form_index(yasm_arch_x86 *arch_x86);
+void yasm_x86__destroy_form_index(yasm_arch_x86 *arch_x86);
+
 /*@only@*/ yasm_bytecode *yasm_x86__create_empty_insn(yasm_arch *arch,
                                                       unsigned long line);
 #endif
@@ -71,6 +71,36 @@ static int x86_bc_jmpfar_tobytes
      yasm_output_value_func output_value,
      /*@null@*/ yasm_output_reloc_func output_reloc);
 
+static void x86_bc_branch_pad_destroy(void *contents);
+static void x86_bc_branch_pad_print(const void *contents, FILE *f,
+                                    int indent_level);
+static int x86_bc_branch_pad_calc_len(yasm_bytecode *bc,
+                                      yasm_bc_add_span_func add_span,
+                                      void *add_span_data);
+static int x86_bc_branch_pad_expand(yasm_bytecode *bc, int span,
+                                    long old_val, long new_val,
+                                    /*@out@*/ long *neg_thres,
+                                    /*@out@*/ long *pos_thres);
+static int x86_bc_branch_pad_tobytes
+    (yasm_bytecode *bc, unsigned char **bufp, unsigned char *bufstart, void *d,
+     yasm_output_value_func output_value,
+     /*@null@*/ yasm_output_reloc_func output_reloc);
+
+static void x86_bc_prefix_pad_destroy(void *contents);
+static void x86_bc_prefix_pad_print(const void *contents, FILE *f,
+                                    int indent_level);
+static int x86_bc_prefix_pad_calc_len(yasm_bytecode *bc,
+                                      yasm_bc_add_span_func add_span,
+                                      void *add_span_data);
+static int x86_bc_prefix_pad_expand(yasm_bytecode *bc, int span,
+                                    long old_val, long new_val,
+                                    /*@out@*/ long *neg_thres,
+                                    /*@out@*/ long *pos_thres);
+static int x86_bc_prefix_pad_tobytes
+    (yasm_bytecode *bc, unsigned char **bufp, unsigned char *bufstart, void *d,
+     yasm_output_value_func output_value,
+     /*@null@*/ yasm_output_reloc_func output_reloc);
+
 /* Bytecode callback structures */
 
 static const yasm_bytecode_callback x86_bc_callback_insn = {
@@ -81,7 +111,8 @@ static const yasm_bytecode_callback x86_bc_callback_insn = {
     x86_bc_insn_calc_len,
     x86_bc_insn_expand,
     x86_bc_insn_tobytes,
-    0
+    0,
+    NULL
 };
 
 static const yasm_bytecode_callback x86_bc_callback_jmp = {
@@ -92,7 +123,8 @@ static const yasm_bytecode_callback x86_bc_callback_jmp = {
     x86_bc_jmp_calc_len,
     x86_bc_jmp_expand,
     x86_bc_jmp_tobytes,
-    0
+    0,
+    NULL
 };
 
 static const yasm_bytecode_callback x86_bc_callback_jmpfar = {
@@ -103,9 +135,63 @@ static const yasm_bytecode_callback x86_bc_callback_jmpfar = {
     x86_bc_jmpfar_calc_len,
     yasm_bc_expand_common,
     x86_bc_jmpfar_tobytes,
-    0
+    0,
+    NULL
+};
+
+static const yasm_bytecode_callback x86_bc_callback_branch_pad = {
+    x86_bc_branch_pad_destroy,
+    x86_bc_branch_pad_print,
+    yasm_bc_finalize_common,
+    NULL,
+    x86_bc_branch_pad_calc_len,
+    x86_bc_branch_pad_expand,
+    x86_bc_branch_pad_tobytes,
+    YASM_BC_SPECIAL_OFFSET,
+    NULL
 };
 
+static const yasm_bytecode_callback x86_bc_callback_prefix_pad = {
+    x86_bc_prefix_pad_destroy,
+    x86_bc_prefix_pad_print,
+    yasm_bc_finalize_common,
+    NULL,
+    x86_bc_prefix_pad_calc_len,
+    x86_bc_prefix_pad_expand,
+    x86_bc_prefix_pad_tobytes,
+    YASM_BC_SPECIAL_OFFSET,
+    NULL
+};
+
+/* Branches (and macro-fused pairs) are kept from crossing or ending on a
+ * boundary of this size.
+ */
+#define X86_BRANCH_PAD_BOUNDARY     32
+
+typedef struct x86_branch_pad {
+    /* Code fill patterns */
+    const unsigned char **fill;
+
+    /* Number of following bytecodes to keep together */
+    unsigned int num_bcs;
+
+    /* Offset of the padding, as last seen by expand */
+    unsigned long offset;
+
+    /* Current total length of the following bytecodes */
+    unsigned long grouplen;
+} x86_branch_pad;
+
+/* Most redundant prefixes added to a single instruction; some decoders
+ * slow down on instructions with more prefixes than this.
+ */
+#define X86_PREFIX_PAD_MAX          4
+
+typedef struct x86_prefix_pad {
+    /* Redundant prefix byte used for the following instruction */
+    unsigned char prefix;
+} x86_prefix_pad;
+
 int
 yasm_x86__set_rex_from_reg(unsigned char *rex, unsigned char *low3,
                            uintptr_t reg, unsigned int bits,
@@ -1060,3 +1146,303 @@ yasm_x86__intnum_tobytes(yasm_arch *arch, const yasm_intnum *intn,
     yasm_intnum_get_sized(intn, buf, destsize, valsize, shift, 0, warn);
     return 0;
 }
+
+yasm_bytecode *
+yasm_x86__bc_create_branch_pad(const unsigned char **fill,
+                               unsigned int num_bcs, unsigned long line)
+{
+    x86_branch_pad *pad = yasm_xmalloc(sizeof(x86_branch_pad));
+
+    pad->fill = fill;
+    pad->num_bcs = num_bcs;
+    pad->offset = 0;
+    pad->grouplen = 0;
+
+    return yasm_bc_create_common(&x86_bc_callback_branch_pad, pad, line);
+}
+
+static void
+x86_bc_branch_pad_destroy(void *contents)
+{
+    yasm_xfree(contents);
+}
+
+static void
+x86_bc_branch_pad_print(const void *contents, FILE *f, int indent_level)
+{
+    const x86_branch_pad *pad = (const x86_branch_pad *)contents;
+    fprintf(f, "%*s_Branch Pad_\n", indent_level, "");
+    fprintf(f, "%*sNum BCs=%u\n", indent_level, "", pad->num_bcs);
+    fprintf(f, "%*sGroup Len=%lu\n", indent_level, "", pad->grouplen);
+}
+
+/* Longest the bytecode can become during optimization.  Equal to its
+ * current length only if the optimizer can no longer change it.
+ */
+static unsigned long
+x86_bc_max_len(yasm_bytecode *bc)
+{
+    unsigned long len = bc->len;
+
+    if (bc->callback == &x86_bc_callback_jmp) {
+        x86_jmp *jmp = (x86_jmp *)bc->contents;
+        unsigned char opersize = (jmp->common.opersize == 0) ?
+            jmp->common.mode_bits : jmp->common.opersize;
+
+        if (jmp->op_sel == JMP_SHORT && jmp->nearop.len != 0) {
+            len -= jmp->shortop.len + 1;
+            len += jmp->nearop.len;
+            len += (opersize == 16) ? 2 : 4;
+        }
+    } else if (bc->callback == &x86_bc_callback_insn) {
+        x86_insn *insn = (x86_insn *)bc->contents;
+        x86_effaddr *x86_ea = insn->x86_ea;
+
+        if (x86_ea && x86_ea->ea.disp.size == 8 &&
+            (x86_ea->ea.disp.rel || (x86_ea->ea.disp.abs &&
+             !yasm_expr_get_intnum(&x86_ea->ea.disp.abs, 0)))) {
+            len--;
+            len += (insn->common.addrsize == 16) ? 2 : 4;
+        }
+        if (insn->imm && insn->postop == X86_POSTOP_SIGNEXT_IMM8) {
+            len -= insn->opcode.len;
+            len += insn->imm->size/8;
+        }
+    }
+    return len;
+}
+
+static int
+x86_bc_branch_pad_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
+                           void *add_span_data)
+{
+    x86_branch_pad *pad = (x86_branch_pad *)bc->contents;
+    yasm_bytecode *last = bc;
+    yasm_value val;
+    unsigned int i;
+
+    for (i=0; i<pad->num_bcs && STAILQ_NEXT(last, link); i++)
+        last = STAILQ_NEXT(last, link);
+
+    /* Track the length of the following bytecodes as they are optimized,
+     * so padding is decided by the lengths they actually end up with.
+     * The thresholds start out at 0 so the first length is always seen.
+     */
+    yasm_value_initialize(&val,
+        yasm_expr_create(YASM_EXPR_SUB, yasm_expr_precbc(last),
+                         yasm_expr_precbc(bc), bc->line), 0);
+    add_span(add_span_data, bc, 2, &val, 0, 0);
+    yasm_value_delete(&val);
+
+    /* No padding until the optimizer updates offsets. */
+    bc->len = 0;
+    return 0;
+}
+
+static int
+x86_bc_branch_pad_expand(yasm_bytecode *bc, int span, long old_val,
+                         long new_val, /*@out@*/ long *neg_thres,
+                         /*@out@*/ long *pos_thres)
+{
+    x86_branch_pad *pad = (x86_branch_pad *)bc->contents;
+    unsigned long pos;
+
+    if (span == 2) {
+        /* The following bytecodes only grow; look again when they do. */
+        pad->grouplen = (unsigned long)new_val;
+        *neg_thres = new_val;
+        *pos_thres = new_val;
+    } else
+        pad->offset = (unsigned long)new_val;
+
+    /* Move to the next boundary if the branch would cross or end on it */
+    pos = pad->offset & (X86_BRANCH_PAD_BOUNDARY-1);
+    if (pad->grouplen < X86_BRANCH_PAD_BOUNDARY &&
+        pos + pad->grouplen >= X86_BRANCH_PAD_BOUNDARY)
+        bc->len = X86_BRANCH_PAD_BOUNDARY - pos;
+    else
+        bc->len = 0;
+
+    if (span != 2)
+        *pos_thres = new_val + (long)bc->len;
+    return 1;
+}
+
+static int
+x86_bc_branch_pad_tobytes(yasm_bytecode *bc, unsigned char **bufp,
+                          unsigned char *bufstart, void *d,
+                          yasm_output_value_func output_value,
+                          /*@unused@*/ yasm_output_reloc_func output_reloc)
+{
+    x86_branch_pad *pad = (x86_branch_pad *)bc->contents;
+    unsigned long len = bc->len;
+
+    if (len == 0)
+        return 0;
+
+    /* All x86 fill tables have patterns for 1-15 bytes */
+    while (len > 15) {
+        memcpy(*bufp, pad->fill[15], 15);
+        *bufp += 15;
+        len -= 15;
+    }
+    memcpy(*bufp, pad->fill[len], len);
+    *bufp += len;
+    return 0;
+}
+
+yasm_bytecode *
+yasm_x86__bc_create_prefix_pad(unsigned long line)
+{
+    x86_prefix_pad *pad = yasm_xmalloc(sizeof(x86_prefix_pad));
+
+    pad->prefix = 0;
+
+    return yasm_bc_create_common(&x86_bc_callback_prefix_pad, pad, line);
+}
+
+static void
+x86_bc_prefix_pad_destroy(void *contents)
+{
+    yasm_xfree(contents);
+}
+
+static void
+x86_bc_prefix_pad_print(const void *contents, FILE *f, int indent_level)
+{
+    const x86_prefix_pad *pad = (const x86_prefix_pad *)contents;
+    fprintf(f, "%*s_Prefix Pad_\n", indent_level, "");
+    fprintf(f, "%*sPrefix=0x%02x\n", indent_level, "",
+            (unsigned int)pad->prefix);
+}
+
+/* Number of redundant segment prefixes that can be added to the instruction
+ * in bc without changing its meaning or length during optimization.  The
+ * prefix to use is returned in *prefix.
+ */
+static unsigned long
+x86_bc_prefix_room(yasm_bytecode *bc, /*@out@*/ unsigned char *prefix)
+{
+    x86_insn *insn;
+    unsigned long room;
+
+    if (bc->callback != &x86_bc_callback_insn || bc->mult_int != 1)
+        return 0;
+    insn = (x86_insn *)bc->contents;
+
+    /* Leave instructions with a VEX/XOP or segment prefix of their own, and
+     * those whose length the optimizer may still change, alone.
+     */
+    if (insn->special_prefix != 0)
+        return 0;
+    if (insn->x86_ea && insn->x86_ea->ea.segreg != 0)
+        return 0;
+    if (x86_bc_max_len(bc) != bc->len)
+        return 0;
+
+    if (insn->common.mode_bits == 64)
+        *prefix = 0x2E;     /* CS is ignored in 64-bit mode */
+    else {
+        /* Segment overrides take effect outside 64-bit mode, so only use
+         * DS on instructions without a memory operand (where it at most
+         * restates the default segment of string instructions).  Skip
+         * opcode FF, where DS on an indirect branch means "notrack".
+         */
+        if (insn->x86_ea && (insn->x86_ea->modrm & 0xC0) != 0xC0)
+            return 0;
+        if (insn->opcode.opcode[0] == 0xFF)
+            return 0;
+        *prefix = 0x3E;
+    }
+
+    room = X86_PREFIX_PAD_MAX;
+    if (bc->len + room > 15)
+        room = (bc->len < 15) ? 15 - bc->len : 0;
+    return room;
+}
+
+static int
+x86_bc_prefix_pad_calc_len(yasm_bytecode *bc, yasm_bc_add_span_func add_span,
+                           void *add_span_data)
+{
+    /* The following bytecodes don't have a length yet; wait for the
+     * optimizer to update offsets.
+     */
+    bc->len = 0;
+    return 0;
+}
+
+static int
+x86_bc_prefix_pad_expand(yasm_bytecode *bc, int span, long old_val,
+                         long new_val, /*@out@*/ long *neg_thres,
+                         /*@out@*/ long *pos_thres)
+{
+    x86_prefix_pad *pad = (x86_prefix_pad *)bc->contents;
+    yasm_bytecode *cur = STAILQ_NEXT(bc, link);
+    unsigned long room, len = 0, need, boundary, maxskip;
+    unsigned int num_padded = 0;
+    int padded = 1;
+
+    bc->len = 0;
+    *pos_thres = new_val;
+
+    if (!cur || (room = x86_bc_prefix_room(cur, &pad->prefix)) == 0)
+        return 1;
+
+    /* Walk the run of instructions up to the align bytecode.  Each padded
+     * instruction is preceded by one of these bytecodes; only the lengths
+     * of the instructions themselves count, which lets every prefix pad
+     * bytecode in the run be computed from its own offset alone.
+     */
+    for (;;) {
+        if (cur->callback == &x86_bc_callback_prefix_pad)
+            padded = 1;
+        else if (yasm_bc_get_code_align(cur, &boundary, &maxskip))
+            break;
+        else if (cur->callback == &x86_bc_callback_insn
+                 && cur->mult_int == 1 && x86_bc_max_len(cur) == cur->len) {
+            unsigned char prefix;
+            if (padded && x86_bc_prefix_room(cur, &prefix) > 0)
+                num_padded++;
+            padded = 0;
+            len += cur->len;
+        } else
+            return 1;
+        cur = STAILQ_NEXT(cur, link);
+        if (!cur)
+            return 1;
+    }
+
+    if (boundary == 0)
+        return 1;
+
+    /* Spread what the align bytecode would otherwise fill with NOPs over
+     * the remaining padded instructions.
+     */
+    need = ((unsigned long)new_val + len) & (boundary-1);
+    if (need != 0)
+        need = boundary - need;
+    if (need > maxskip)
+        return 1;
+
+    bc->len = (need + num_padded - 1) / num_padded;
+    if (bc->len > room)
+        bc->len = room;
+
+    *pos_thres = new_val + (long)bc->len;
+    return 1;
+}
+
+static int
+x86_bc_prefix_pad_tobytes(yasm_bytecode *bc, unsigned char **bufp,
+                          unsigned char *bufstart, void *d,
+                          yasm_output_value_func output_value,
+                          /*@unused@*/ yasm_output_reloc_func output_reloc)
+{
+    x86_prefix_pad *pad = (x86_prefix_pad *)bc->contents;
+    unsigned long i;
+
+    for (i=0; i<bc->len; i++)
+        YASM_WRITE_8(*bufp, pad->prefix);
+    return 0;
+}
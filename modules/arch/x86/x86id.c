@@ -305,8 +305,13 @@ typedef struct x86_id_insn {
     /* instruction parse group - NULL if empty instruction (just prefixes) */
     /*@null@*/ const x86_insn_info *group;
 
-    /* CPU feature flags enabled at the time of parsing the instruction */
-    wordptr cpu_enabled;
+    /* Architecture (for the form index and CPU form eligibility) */
+    /*@dependent@*/ yasm_arch_x86 *arch_x86;
+
+    /* CPU configuration (index into cpu_enables) active at the time of
+     * parsing the instruction
+     */
+    unsigned int active_cpu;
 
     /* Modifier data */
     unsigned char mod_data[3];
@@ -331,6 +336,15 @@ typedef struct x86_id_insn {
 
     /* Default rel setting at the time of parsing the instruction */
     unsigned int default_rel:1;
+
+    /* JCC erratum padding setting at the time of parsing the instruction */
+    unsigned int jcc_align:1;
+
+    /* Prefix alignment setting at the time of parsing the instruction */
+    unsigned int prefix_align:1;
+
+    /* NOP pattern setting at the time of parsing the instruction */
+    unsigned int nop:2;
 } x86_id_insn;
 
 static void x86_id_insn_destroy(void *contents);
@@ -345,11 +359,305 @@ static const yasm_bytecode_callback x86_id_insn_callback = {
     yasm_bc_calc_len_common,
     yasm_bc_expand_common,
     yasm_bc_tobytes_common,
-    YASM_BC_SPECIAL_INSN
+    YASM_BC_SPECIAL_INSN,
+    NULL
 };
 
 #include "x86insns.c"
 
+/* Form index keys.  An instruction's key has exactly one bit set from each
+ * group (mode, AVX, parser, operand count); a form's key has set the bits of
+ * every value it accepts.  A form can only match if all of the instruction's
+ * key bits are set in the form's key.
+ */
+#define X86_KEY_MODE64      (1U<<0)
+#define X86_KEY_NOTMODE64   (1U<<1)
+#define X86_KEY_AVX         (1U<<2)
+#define X86_KEY_NOTAVX      (1U<<3)
+#define X86_KEY_GAS         (1U<<4)
+#define X86_KEY_NOTGAS      (1U<<5)
+#define X86_KEY_NUMOPS(n)   (1U<<(6+(n)))   /* n = 0..5 */
+
+/* Operand classes.  Each instruction operand falls into at most one class;
+ * each form operand accepts a set of classes.  Operands are packed into the
+ * opclass signature X86_OPCLASS_BITS at a time, first operand lowest.
+ */
+#define X86_OPCLASS_IMM     (1UL<<0)
+#define X86_OPCLASS_MEM     (1UL<<1)
+#define X86_OPCLASS_SEGREG  (1UL<<2)
+#define X86_OPCLASS_GPREG   (1UL<<3)    /* general purpose or FPU */
+#define X86_OPCLASS_SIMDREG (1UL<<4)    /* MMX, XMM, or YMM */
+#define X86_OPCLASS_CTLREG  (1UL<<5)    /* CR, DR, or TR */
+#define X86_OPCLASS_BITS    6
+#define X86_OPCLASS_MAXOPS  5
+
+static unsigned long
+x86_form_operand_classes(unsigned int type)
+{
+    switch (type) {
+        case OPT_Imm:
+        case OPT_Imm1:
+        case OPT_ImmNotSegOff:
+            return X86_OPCLASS_IMM;
+        case OPT_Reg:
+        case OPT_ST0:
+        case OPT_Areg:
+        case OPT_Creg:
+        case OPT_Dreg:
+            return X86_OPCLASS_GPREG;
+        case OPT_RM:
+            return X86_OPCLASS_GPREG|X86_OPCLASS_MEM;
+        case OPT_Mem:
+        case OPT_MemOffs:
+        case OPT_MemrAX:
+        case OPT_MemEAX:
+        case OPT_MemXMMIndex:
+        case OPT_MemYMMIndex:
+            return X86_OPCLASS_MEM;
+        case OPT_SIMDReg:
+        case OPT_XMM0:
+            return X86_OPCLASS_SIMDREG;
+        case OPT_SIMDRM:
+            return X86_OPCLASS_SIMDREG|X86_OPCLASS_MEM;
+        case OPT_SegReg:
+        case OPT_CS:
+        case OPT_DS:
+        case OPT_ES:
+        case OPT_FS:
+        case OPT_GS:
+        case OPT_SS:
+            return X86_OPCLASS_SEGREG;
+        case OPT_CRReg:
+        case OPT_DRReg:
+        case OPT_TRReg:
+        case OPT_CR4:
+            return X86_OPCLASS_CTLREG;
+        default:
+            yasm_internal_error(N_("invalid operand type"));
+            /*@notreached@*/
+            return 0;
+    }
+}
+
+/* Returns the class of an instruction operand, or 0 if it's a register that
+ * no form accepts as a register operand (these are rejected by the full
+ * operand checks).
+ */
+static unsigned long
+x86_operand_class(const yasm_insn_operand *op)
+{
+    switch (op->type) {
+        case YASM_INSN__OPERAND_IMM:
+            return X86_OPCLASS_IMM;
+        case YASM_INSN__OPERAND_MEMORY:
+            return X86_OPCLASS_MEM;
+        case YASM_INSN__OPERAND_SEGREG:
+            return X86_OPCLASS_SEGREG;
+        case YASM_INSN__OPERAND_REG:
+            switch ((x86_expritem_reg_size)(op->data.reg & ~0xFUL)) {
+                case X86_REG8:
+                case X86_REG8X:
+                case X86_REG16:
+                case X86_REG32:
+                case X86_REG64:
+                case X86_FPUREG:
+                    return X86_OPCLASS_GPREG;
+                case X86_MMXREG:
+                case X86_XMMREG:
+                case X86_YMMREG:
+                    return X86_OPCLASS_SIMDREG;
+                case X86_CRREG:
+                case X86_DRREG:
+                case X86_TRREG:
+                    return X86_OPCLASS_CTLREG;
+                default:
+                    return 0;
+            }
+    }
+    return 0;
+}
+
+static unsigned long
+x86_operands_signature(yasm_insn_operand **ops, unsigned int num_operands)
+{
+    unsigned long sig = 0;
+    unsigned int i;
+
+    for (i=0; i<num_operands && i<X86_OPCLASS_MAXOPS; i++)
+        sig |= x86_operand_class(ops[i]) << (i*X86_OPCLASS_BITS);
+    return sig;
+}
+
+/* Get the bitmap of instruction info rows whose CPU requirements are met by
+ * CPU configuration cpu, building it on first use.  CPU configurations
+ * never change once created, so the bitmap stays valid.
+ */
+static wordptr
+x86_cpu_forms(yasm_arch_x86 *arch_x86, unsigned int cpu)
+{
+    wordptr cpu_enabled, forms;
+    size_t row;
+
+    if (arch_x86->cpu_forms[cpu])
+        return arch_x86->cpu_forms[cpu];
+
+    cpu_enabled = arch_x86->cpu_enables[cpu];
+    forms = BitVector_Create((N_int)NELEMS(insn_info), TRUE);
+    for (row=0; row<NELEMS(insn_info); row++) {
+        const x86_insn_info *info = &insn_info[row];
+        if (BitVector_bit_test(cpu_enabled, info->cpu0) &&
+            BitVector_bit_test(cpu_enabled, info->cpu1) &&
+            BitVector_bit_test(cpu_enabled, info->cpu2))
+            BitVector_Bit_On(forms, (N_int)row);
+    }
+    arch_x86->cpu_forms[cpu] = forms;
+    return forms;
+}
+
+void
+yasm_x86__create_form_index(yasm_arch_x86 *arch_x86)
+{
+    x86_insn_form *forms = yasm_xmalloc(NELEMS(insn_info)*sizeof(x86_insn_form));
+    size_t row;
+
+    for (row=0; row<NELEMS(insn_info); row++) {
+        const x86_insn_info *info = &insn_info[row];
+        const x86_info_operand *info_ops =
+            &insn_operands[info->operands_index];
+        unsigned int key = 0;
+        unsigned long opclass = 0;
+        unsigned int i;
+
+        if (!(info->misc_flags & NOT_64))
+            key |= X86_KEY_MODE64;
+        if (!(info->misc_flags & ONLY_64))
+            key |= X86_KEY_NOTMODE64;
+        if (!(info->misc_flags & NOT_AVX))
+            key |= X86_KEY_AVX;
+        if (!(info->misc_flags & ONLY_AVX))
+            key |= X86_KEY_NOTAVX;
+        if (!(info->gas_flags & GAS_ILLEGAL))
+            key |= X86_KEY_GAS;
+        if (!(info->gas_flags & GAS_ONLY))
+            key |= X86_KEY_NOTGAS;
+        if (info->num_operands <= X86_OPCLASS_MAXOPS) {
+            key |= X86_KEY_NUMOPS(info->num_operands);
+            for (i=0; i<info->num_operands; i++)
+                opclass |= x86_form_operand_classes(info_ops[i].type)
+                    << (i*X86_OPCLASS_BITS);
+        }
+
+        forms[row].key = key;
+        forms[row].opclass = opclass;
+    }
+    arch_x86->forms = forms;
+
+    arch_x86->form_lists_size = 64;
+    arch_x86->form_lists = yasm_xcalloc(arch_x86->form_lists_size,
+                                        sizeof(x86_form_list *));
+    arch_x86->num_form_lists = 0;
+}
+
+void
+yasm_x86__destroy_form_index(yasm_arch_x86 *arch_x86)
+{
+    x86_form_list *list, *next;
+    unsigned int i;
+
+    for (i=0; i<arch_x86->form_lists_size; i++) {
+        for (list = arch_x86->form_lists[i]; list; list = next) {
+            next = list->next;
+            yasm_xfree(list->rows);
+            yasm_xfree(list);
+        }
+    }
+    yasm_xfree(arch_x86->form_lists);
+    yasm_xfree(arch_x86->forms);
+}
+
+static unsigned long
+x86_form_list_hash(unsigned int group, unsigned int key, unsigned long sig,
+                   unsigned long rev_sig)
+{
+    unsigned long h = group;
+    h = h*31 + key;
+    h = h*31 + sig;
+    h = h*31 + rev_sig;
+    return h;
+}
+
+/* Get the forms of the instruction whose info rows start at group that can
+ * match operands with the given key and signatures (rev_sig is for the
+ * reversed GAS operand order), building the list on first use.
+ */
+static const x86_form_list *
+x86_get_form_list(yasm_arch_x86 *arch_x86, unsigned int group,
+                  unsigned int num_info, unsigned int key, unsigned long sig,
+                  unsigned long rev_sig)
+{
+    unsigned long h = x86_form_list_hash(group, key, sig, rev_sig);
+    x86_form_list *list;
+    unsigned int row, i;
+
+    for (list = arch_x86->form_lists[h & (arch_x86->form_lists_size-1)];
+         list; list = list->next) {
+        if (list->group == group && list->key == key && list->sig == sig
+            && list->rev_sig == rev_sig)
+            return list;
+    }
+
+    /* Grow the table as it fills so chains stay short */
+    if (arch_x86->num_form_lists >= arch_x86->form_lists_size) {
+        unsigned int new_size = arch_x86->form_lists_size*2;
+        x86_form_list **new_lists = yasm_xcalloc(new_size,
+                                                 sizeof(x86_form_list *));
+        x86_form_list *next;
+
+        for (i=0; i<arch_x86->form_lists_size; i++) {
+            for (list = arch_x86->form_lists[i]; list; list = next) {
+                unsigned long lh = x86_form_list_hash(list->group, list->key,
+                                                      list->sig,
+                                                      list->rev_sig);
+                next = list->next;
+                list->next = new_lists[lh & (new_size-1)];
+                new_lists[lh & (new_size-1)] = list;
+            }
+        }
+        yasm_xfree(arch_x86->form_lists);
+        arch_x86->form_lists = new_lists;
+        arch_x86->form_lists_size = new_size;
+    }
+
+    list = yasm_xmalloc(sizeof(x86_form_list));
+    list->group = group;
+    list->key = key;
+    list->sig = sig;
+    list->rev_sig = rev_sig;
+    list->num_rows = 0;
+    list->rows = yasm_xmalloc(num_info*sizeof(unsigned int));
+    for (row=group; row<group+num_info; row++) {
+        const x86_insn_form *form = &arch_x86->forms[row];
+        unsigned long use_sig = sig;
+
+        /* Match mode, # of operands, AVX, and parser mode */
+        if ((form->key & key) != key)
+            continue;
+
+        /* GAS uses reversed operands if not otherwise specified */
+        if ((key & X86_KEY_GAS) && !(insn_info[row].gas_flags & GAS_NO_REV))
+            use_sig = rev_sig;
+        if ((form->opclass & use_sig) != use_sig)
+            continue;
+
+        list->rows[list->num_rows++] = row;
+    }
+
+    list->next = arch_x86->form_lists[h & (arch_x86->form_lists_size-1)];
+    arch_x86->form_lists[h & (arch_x86->form_lists_size-1)] = list;
+    arch_x86->num_form_lists++;
+    return list;
+}
+
 /* Looks for the first SIMD register match for the purposes of VSIB matching.
  * Full legality checking is performed in EA code.
  */
@@ -506,6 +814,7 @@ x86_finalize_jmp(yasm_bytecode *bc, yasm_bytecode *prev_bc,
     const x86_insn_info *info = id_insn->group;
     unsigned char *mod_data = id_insn->mod_data;
     unsigned int mode_bits = id_insn->mode_bits;
+    wordptr cpu_forms = x86_cpu_forms(id_insn->arch_x86, id_insn->active_cpu);
     /*unsigned char suffix = id_insn->suffix;*/
     yasm_insn_operand *op;
     static const unsigned char size_lookup[] =
@@ -564,9 +873,7 @@ x86_finalize_jmp(yasm_bytecode *bc, yasm_bytecode *prev_bc,
         if (mode_bits == 64 && (info->misc_flags & NOT_64))
             continue;
 
-        if (!BitVector_bit_test(id_insn->cpu_enabled, info->cpu0) ||
-            !BitVector_bit_test(id_insn->cpu_enabled, info->cpu1) ||
-            !BitVector_bit_test(id_insn->cpu_enabled, info->cpu2))
+        if (!BitVector_bit_test(cpu_forms, (N_int)(info - insn_info)))
             continue;
 
         if (info->num_operands == 0)
@@ -627,50 +934,52 @@ x86_find_match(x86_id_insn *id_insn, yasm_insn_operand **ops,
                int bypass)
 {
     const x86_insn_info *info = id_insn->group;
-    unsigned int num_info = id_insn->num_info;
+    wordptr cpu_forms = x86_cpu_forms(id_insn->arch_x86, id_insn->active_cpu);
+    const x86_form_list *list;
     unsigned int suffix = id_insn->suffix;
-    unsigned int mode_bits = id_insn->mode_bits;
+    unsigned int num_operands = id_insn->insn.num_operands;
+    unsigned int key, n;
+    unsigned long sig, rev_sig;
     int found = 0;
 
-    /* Just do a simple linear search through the info array for a match.
-     * First match wins.
+    /* Build the lookup key and operand class signatures, and use them to
+     * look up the forms that can match at all (right mode, operand count,
+     * and operand kinds).  Only those need the full checks.
      */
-    for (; num_info>0 && !found; num_info--, info++) {
+    key = (id_insn->mode_bits == 64) ? X86_KEY_MODE64 : X86_KEY_NOTMODE64;
+    key |= (id_insn->misc_flags & ONLY_AVX) ? X86_KEY_AVX : X86_KEY_NOTAVX;
+    key |= (id_insn->parser == X86_PARSER_GAS) ? X86_KEY_GAS : X86_KEY_NOTGAS;
+    if (num_operands > X86_OPCLASS_MAXOPS)
+        return NULL;
+    key |= X86_KEY_NUMOPS(num_operands);
+    sig = x86_operands_signature(ops, num_operands);
+    rev_sig = sig;
+    if (id_insn->parser == X86_PARSER_GAS)
+        rev_sig = x86_operands_signature(rev_ops, num_operands);
+    list = x86_get_form_list(id_insn->arch_x86,
+                             (unsigned int)(info - insn_info),
+                             id_insn->num_info, key, sig, rev_sig);
+
+    /* Search through the candidate forms for a match.  First match wins. */
+    for (n=0; n<list->num_rows && !found; n++) {
         yasm_insn_operand *op, **use_ops;
-        const x86_info_operand *info_ops =
-            &insn_operands[info->operands_index];
-        unsigned int gas_flags = info->gas_flags;
-        unsigned int misc_flags = info->misc_flags;
+        const x86_info_operand *info_ops;
+        unsigned int gas_flags;
         unsigned int size;
         int mismatch = 0;
         unsigned int i;
 
-        /* Match CPU */
-        if (mode_bits != 64 && (misc_flags & ONLY_64))
-            continue;
-        if (mode_bits == 64 && (misc_flags & NOT_64))
-            continue;
-
-        if (bypass != 8 &&
-            (!BitVector_bit_test(id_insn->cpu_enabled, info->cpu0) ||
-             !BitVector_bit_test(id_insn->cpu_enabled, info->cpu1) ||
-             !BitVector_bit_test(id_insn->cpu_enabled, info->cpu2)))
-            continue;
-
-        /* Match # of operands */
-        if (id_insn->insn.num_operands != info->num_operands)
-            continue;
+        info = &insn_info[list->rows[n]];
+        gas_flags = info->gas_flags;
 
-        /* Match AVX */
-        if (!(id_insn->misc_flags & ONLY_AVX) && (misc_flags & ONLY_AVX))
-            continue;
-        if ((id_insn->misc_flags & ONLY_AVX) && (misc_flags & NOT_AVX))
-            continue;
+        /* Use reversed operands in GAS mode if not otherwise specified */
+        use_ops = ops;
+        if (id_insn->parser == X86_PARSER_GAS && !(gas_flags & GAS_NO_REV))
+            use_ops = rev_ops;
 
-        /* Match parser mode */
-        if ((gas_flags & GAS_ONLY) && id_insn->parser != X86_PARSER_GAS)
-            continue;
-        if ((gas_flags & GAS_ILLEGAL) && id_insn->parser == X86_PARSER_GAS)
+        /* Match CPU */
+        if (bypass != 8 &&
+            !BitVector_bit_test(cpu_forms, (N_int)(info - insn_info)))
             continue;
 
         /* Match suffix (if required) */
@@ -678,10 +987,7 @@ x86_find_match(x86_id_insn *id_insn, yasm_insn_operand **ops,
             && ((suffix & SUF_MASK) & (gas_flags & SUF_MASK)) == 0)
             continue;
 
-        /* Use reversed operands in GAS mode if not otherwise specified */
-        use_ops = ops;
-        if (id_insn->parser == X86_PARSER_GAS && !(gas_flags & GAS_NO_REV))
-            use_ops = rev_ops;
+        info_ops = &insn_operands[info->operands_index];
 
         if (id_insn->insn.num_operands == 0) {
             found = 1;      /* no operands -> must have a match here. */
@@ -1059,6 +1365,164 @@ x86_match_error(x86_id_insn *id_insn, yasm_insn_operand **ops,
     }
 }
 
+/* Is the instruction a branch affected by the JCC erratum? */
+static int
+x86_is_branch(const x86_id_insn *id_insn)
+{
+    const x86_insn_info *info = id_insn->group;
+    unsigned int num_info = id_insn->num_info;
+
+    if (info == retnf_insn)
+        return 1;
+    for (; num_info>0; num_info--, info++) {
+        if (info->num_operands > 0 &&
+            insn_operands[info->operands_index+0].action == OPA_JmpRel)
+            return 1;
+    }
+    return 0;
+}
+
+/* Can the instruction macro-fuse with a following conditional jump? */
+static int
+x86_is_fusible(const x86_id_insn *id_insn)
+{
+    if (id_insn->group == test_insn || id_insn->group == incdec_insn)
+        return 1;
+    if (id_insn->group == arith_insn) {
+        switch (id_insn->mod_data[1]) {
+            case 0:     /* add */
+            case 4:     /* and */
+            case 5:     /* sub */
+            case 7:     /* cmp */
+                return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct x86_curpos_move {
+    yasm_symtab *symtab;
+    yasm_bytecode *from;
+    yasm_bytecode *to;
+} x86_curpos_move;
+
+static int
+x86_move_curpos_callback(yasm_expr__item *ei, void *d)
+{
+    x86_curpos_move *move = (x86_curpos_move *)d;
+    yasm_bytecode *precbc;
+
+    if (ei->type == YASM_EXPR_SYM && yasm_symrec_is_curpos(ei->data.sym)
+        && yasm_symrec_get_label(ei->data.sym, &precbc)
+        && precbc == move->from)
+        ei->data.sym = yasm_symtab_define_curpos(move->symtab, "$",
+                                                 move->to,
+                                                 yasm_symrec_get_def_line(
+                                                     ei->data.sym));
+    return 0;
+}
+
+/* Make "$" in the operands of bc refer to the position after to rather than
+ * after from.
+ */
+static void
+x86_move_curpos(yasm_bytecode *bc, yasm_bytecode *from, yasm_bytecode *to)
+{
+    x86_id_insn *id_insn = (x86_id_insn *)bc->contents;
+    yasm_insn_operand *op;
+    x86_curpos_move move;
+
+    move.symtab = yasm_section_get_object(bc->section)->symtab;
+    move.from = from;
+    move.to = to;
+
+    STAILQ_FOREACH(op, &id_insn->insn.operands, link) {
+        if (op->type == YASM_INSN__OPERAND_IMM && op->data.val)
+            yasm_expr__traverse_leaves_in(op->data.val, &move,
+                                          x86_move_curpos_callback);
+        else if (op->type == YASM_INSN__OPERAND_MEMORY
+                 && op->data.ea->disp.abs)
+            yasm_expr__traverse_leaves_in(op->data.ea->disp.abs, &move,
+                                          x86_move_curpos_callback);
+        if (op->seg)
+            yasm_expr__traverse_leaves_in(op->seg, &move,
+                                          x86_move_curpos_callback);
+    }
+}
+
+/* If bc starts a branch (or a compare and branch pair that may be
+ * macro-fused), insert a padding bytecode in front of it.  Labels on the
+ * branch and "$" within it are moved past the padding, so they still refer
+ * to the branch itself.  Returns the bytecode preceding bc after any
+ * insertion.
+ */
+static yasm_bytecode *
+x86_insert_branch_pad(yasm_bytecode *bc, yasm_bytecode *prev_bc)
+{
+    x86_id_insn *id_insn = (x86_id_insn *)bc->contents;
+    yasm_bytecode *next_bc = STAILQ_NEXT(bc, link);
+    const unsigned char **fill;
+    yasm_bytecode *pad;
+    unsigned int num_bcs;
+
+    if (bc->multiple)
+        return prev_bc;
+
+    if (x86_is_fusible(id_insn) && next_bc && !next_bc->multiple
+        && next_bc->callback == &x86_id_insn_callback
+        && ((x86_id_insn *)next_bc->contents)->group == jcc_insn
+        && ((x86_id_insn *)next_bc->contents)->jcc_align) {
+        /* Pad the pair; the jump doesn't need its own padding. */
+        ((x86_id_insn *)next_bc->contents)->jcc_align = 0;
+        num_bcs = 2;
+    } else if (x86_is_branch(id_insn))
+        num_bcs = 1;
+    else
+        return prev_bc;
+
+    fill = yasm_x86__get_fill(id_insn->mode_bits, id_insn->nop);
+    if (!fill)
+        return prev_bc;
+
+    pad = yasm_x86__bc_create_branch_pad(fill, num_bcs, bc->line);
+    yasm_section_bcs_insert_after(bc->section, prev_bc, pad);
+    yasm_symtab_move_labels(prev_bc, pad);
+    x86_move_curpos(bc, prev_bc, pad);
+    return pad;
+}
+
+/* Instructions this far ahead of a code alignment (or closer) get a prefix
+ * padding bytecode.
+ */
+#define X86_PREFIX_ALIGN_WINDOW     8
+
+/* If bc is in a short run of instructions leading up to a code alignment,
+ * insert a bytecode in front of it that can absorb some of the alignment
+ * padding into redundant prefixes on the instruction.  Values in the
+ * instruction keep using prev_bc, so they see the prefixes as part of it.
+ */
+static void
+x86_insert_prefix_pad(yasm_bytecode *bc, yasm_bytecode *prev_bc)
+{
+    yasm_bytecode *next_bc = bc;
+    unsigned long boundary, maxskip;
+    unsigned int i;
+
+    for (i=0; i<X86_PREFIX_ALIGN_WINDOW; i++) {
+        if (next_bc->multiple || next_bc->callback != &x86_id_insn_callback
+            || !((x86_id_insn *)next_bc->contents)->prefix_align)
+            return;
+        next_bc = STAILQ_NEXT(next_bc, link);
+        if (!next_bc)
+            return;
+        if (yasm_bc_get_code_align(next_bc, &boundary, &maxskip)) {
+            yasm_section_bcs_insert_after(bc->section, prev_bc,
+                yasm_x86__bc_create_prefix_pad(bc->line));
+            return;
+        }
+    }
+}
+
 static void
 x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
 {
@@ -1079,6 +1543,11 @@ x86_id_insn_finalize(yasm_bytecode *bc, yasm_bytecode *prev_bc)
 
     size_lookup[OPS_BITS] = mode_bits;
 
+    if (id_insn->jcc_align)
+        prev_bc = x86_insert_branch_pad(bc, prev_bc);
+    if (id_insn->prefix_align)
+        x86_insert_prefix_pad(bc, prev_bc);
+
     yasm_insn_finalize(&id_insn->insn);
 
     /* Build local array of operands from list, since we know we have a max
@@ -1839,11 +2308,12 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
             id_insn = yasm_xmalloc(sizeof(x86_id_insn));
             yasm_insn_initialize(&id_insn->insn);
             id_insn->group = not64_insn;
-            id_insn->cpu_enabled = cpu_enabled;
+            id_insn->arch_x86 = arch_x86;
+            id_insn->active_cpu = arch_x86->active_cpu;
             id_insn->mod_data[0] = 0;
             id_insn->mod_data[1] = 0;
             id_insn->mod_data[2] = 0;
-            id_insn->num_info = NELEMS(not64_insn);
+            id_insn->num_info = not64_insn_num;
             id_insn->mode_bits = arch_x86->mode_bits;
             id_insn->suffix = 0;
             id_insn->misc_flags = 0;
@@ -1851,6 +2321,9 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
 	
             id_insn->force_strict = arch_x86->force_strict != 0;
             id_insn->default_rel = arch_x86->default_rel != 0;
+            id_insn->jcc_align = 0;
+            id_insn->prefix_align = 0;
+            id_insn->nop = arch_x86->nop;
             *bc = yasm_bc_create_common(&x86_id_insn_callback, id_insn, line);
             return YASM_ARCH_INSN;
         }
@@ -1871,7 +2344,8 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
         id_insn = yasm_xmalloc(sizeof(x86_id_insn));
         yasm_insn_initialize(&id_insn->insn);
         id_insn->group = pdata->group;
-        id_insn->cpu_enabled = cpu_enabled;
+        id_insn->arch_x86 = arch_x86;
+        id_insn->active_cpu = arch_x86->active_cpu;
         id_insn->mod_data[0] = pdata->mod_data0;
         id_insn->mod_data[1] = pdata->mod_data1;
         id_insn->mod_data[2] = pdata->mod_data2;
@@ -1882,6 +2356,9 @@ yasm_x86__parse_check_insnprefix(yasm_arch *arch, const char *id,
         id_insn->parser = PARSER(arch_x86);
         id_insn->force_strict = arch_x86->force_strict != 0;
         id_insn->default_rel = arch_x86->default_rel != 0;
+        id_insn->jcc_align = arch_x86->jcc_align != 0;
+        id_insn->prefix_align = arch_x86->prefix_align != 0;
+        id_insn->nop = arch_x86->nop;
         *bc = yasm_bc_create_common(&x86_id_insn_callback, id_insn, line);
         return YASM_ARCH_INSN;
     } else {
@@ -1934,17 +2411,21 @@ yasm_x86__create_empty_insn(yasm_arch *arch, unsigned long line)
 
     yasm_insn_initialize(&id_insn->insn);
     id_insn->group = empty_insn;
-    id_insn->cpu_enabled = arch_x86->cpu_enables[arch_x86->active_cpu];
+    id_insn->arch_x86 = arch_x86;
+    id_insn->active_cpu = arch_x86->active_cpu;
     id_insn->mod_data[0] = 0;
     id_insn->mod_data[1] = 0;
     id_insn->mod_data[2] = 0;
-    id_insn->num_info = NELEMS(empty_insn);
+    id_insn->num_info = empty_insn_num;
     id_insn->mode_bits = arch_x86->mode_bits;
     id_insn->suffix = (PARSER(arch_x86) == X86_PARSER_GAS) ? SUF_Z : 0;
     id_insn->misc_flags = 0;
     id_insn->parser = PARSER(arch_x86);
     id_insn->force_strict = arch_x86->force_strict != 0;
     id_insn->default_rel = arch_x86->default_rel != 0;
+    id_insn->jcc_align = 0;
+    id_insn->prefix_align = 0;
+    id_insn->nop = arch_x86->nop;
 
     return yasm_bc_create_common(&x86_id_insn_callback, id_insn, line);
 }
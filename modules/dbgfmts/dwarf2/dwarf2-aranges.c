@@ -60,7 +60,7 @@ dwarf2_generate_aranges_section(yasm_section *sect, /*@null@*/ void *d)
     /*@null@*/ dwarf2_section_data *dsd;
     /*@only@*/ yasm_expr *start, *length;
 
-    dsd = yasm_section_get_data(sect, &yasm_dwarf2__section_data_cb);
+    dsd = yasm_section_get_slot_data(sect, yasm_dwarf2__section_data_slot);
     if (!dsd)
         return 0;       /* no line data for this section */
 
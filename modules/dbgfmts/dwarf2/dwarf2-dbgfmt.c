@@ -58,7 +58,8 @@ static const yasm_bytecode_callback dwarf2_head_bc_callback = {
     dwarf2_head_bc_calc_len,
     yasm_bc_expand_common,
     dwarf2_head_bc_tobytes,
-    0
+    0,
+    NULL
 };
 
 /* Section data callback function prototypes */
@@ -71,6 +72,9 @@ const yasm_assoc_data_callback yasm_dwarf2__section_data_cb = {
     dwarf2_section_data_print
 };
 
+/* Slot of the above callback, for fast lookups */
+unsigned int yasm_dwarf2__section_data_slot;
+
 yasm_dbgfmt_module yasm_dwarf2_LTX_dbgfmt;
 
 
@@ -83,6 +87,9 @@ dwarf2_dbgfmt_create(yasm_object *object)
 
     dbgfmt_dwarf2->dbgfmt.module = &yasm_dwarf2_LTX_dbgfmt;
 
+    yasm_dwarf2__section_data_slot =
+        yasm_assoc_data_register(&yasm_dwarf2__section_data_cb);
+
     dbgfmt_dwarf2->dirs_allocated = 32;
     dbgfmt_dwarf2->dirs_size = 0;
     dbgfmt_dwarf2->dirs =
@@ -91,6 +91,7 @@ typedef struct dwarf2_section_data {
 } dwarf2_section_data;
 
 extern const yasm_assoc_data_callback yasm_dwarf2__section_data_cb;
+extern unsigned int yasm_dwarf2__section_data_slot;
 
 yasm_bytecode *yasm_dwarf2__append_bc(yasm_section *sect, yasm_bytecode *bc);
 
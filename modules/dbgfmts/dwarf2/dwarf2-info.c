@@ -210,7 +210,8 @@ static const yasm_bytecode_callback dwarf2_abbrev_bc_callback = {
     dwarf2_abbrev_bc_calc_len,
     yasm_bc_expand_common,
     dwarf2_abbrev_bc_tobytes,
-    0
+    0,
+    NULL
 };
 
 
@@ -154,7 +154,8 @@ static const yasm_bytecode_callback dwarf2_spp_bc_callback = {
     dwarf2_spp_bc_calc_len,
     yasm_bc_expand_common,
     dwarf2_spp_bc_tobytes,
-    0
+    0,
+    NULL
 };
 
 static const yasm_bytecode_callback dwarf2_line_op_bc_callback = {
@@ -165,7 +166,8 @@ static const yasm_bytecode_callback dwarf2_line_op_bc_callback = {
     dwarf2_line_op_bc_calc_len,
     yasm_bc_expand_common,
     dwarf2_line_op_bc_tobytes,
-    0
+    0,
+    NULL
 };
 
 
@@ -585,7 +587,7 @@ dwarf2_generate_line_section(yasm_section *sect, /*@null@*/ void *d)
     dwarf2_line_state state;
     unsigned long addr_delta;
 
-    dsd = yasm_section_get_data(sect, &yasm_dwarf2__section_data_cb);
+    dsd = yasm_section_get_slot_data(sect, yasm_dwarf2__section_data_slot);
     if (!dsd) {
         if (info->asm_source && yasm_section_is_code(sect)) {
             /* Create line data for asm code sections */
@@ -948,8 +950,8 @@ yasm_dwarf2__dir_loc(yasm_object *object, yasm_valparamhead *valparams,
         yasm_xfree(loc);
         return;
     }
-    dsd = yasm_section_get_data(object->cur_section,
-                                &yasm_dwarf2__section_data_cb);
+    dsd = yasm_section_get_slot_data(object->cur_section,
+                                     yasm_dwarf2__section_data_slot);
     if (!dsd) {
         dsd = yasm_xmalloc(sizeof(dwarf2_section_data));
         STAILQ_INIT(&dsd->locs);
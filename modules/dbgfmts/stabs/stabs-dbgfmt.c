@@ -142,7 +142,8 @@ static const yasm_bytecode_callback stabs_bc_str_callback = {
     stabs_bc_str_calc_len,
     yasm_bc_expand_common,
     stabs_bc_str_tobytes,
-    0
+    0,
+    NULL
 };
 
 static const yasm_bytecode_callback stabs_bc_stab_callback = {
@@ -153,7 +154,8 @@ static const yasm_bytecode_callback stabs_bc_stab_callback = {
     stabs_bc_stab_calc_len,
     yasm_bc_expand_common,
     stabs_bc_stab_tobytes,
-    0
+    0,
+    NULL
 };
 
 yasm_dbgfmt_module yasm_stabs_LTX_dbgfmt;
@@ -96,6 +96,9 @@ static const yasm_assoc_data_callback bin_symrec_data_cb = {
     bin_symrec_data_print
 };
 
+/* Slots of the above callbacks, for fast lookups */
+static unsigned int bin_section_data_slot, bin_symrec_data_slot;
+
 yasm_objfmt_module yasm_bin_LTX_objfmt;
 
 
@@ -105,6 +108,9 @@ bin_objfmt_create(yasm_object *object)
     yasm_objfmt_bin *objfmt_bin = yasm_xmalloc(sizeof(yasm_objfmt_bin));
     objfmt_bin->objfmt.module = &yasm_bin_LTX_objfmt;
 
+    bin_section_data_slot = yasm_assoc_data_register(&bin_section_data_cb);
+    bin_symrec_data_slot = yasm_assoc_data_register(&bin_symrec_data_cb);
+
     objfmt_bin->map_flags = NO_MAP;
     objfmt_bin->map_filename = NULL;
     objfmt_bin->org = NULL;
@@ -187,7 +193,7 @@ bin_group_destroy(/*@only@*/ bin_group *group)
 typedef struct bin_objfmt_output_info {
     yasm_object *object;
     yasm_errwarns *errwarns;
-    /*@dependent@*/ FILE *f;
+    /*@dependent@*/ yasm_outbuf *ob;
     /*@only@*/ unsigned char *buf;
     /*@observer@*/ const yasm_section *sect;
     unsigned long start;        /* what normal variables go against */
@@ -208,7 +214,7 @@ bin_objfmt_check_sym(yasm_symrec *sym, /*@null@*/ void *d)
     /* Don't check internally-generated symbols.  Only internally generated
      * symbols have symrec data, so simply check for its presence.
      */
-    if (yasm_symrec_get_data(sym, &bin_symrec_data_cb))
+    if (yasm_symrec_get_slot_data(sym, bin_symrec_data_slot))
         return 0;
 
     if (vis & YASM_SYM_EXTERN) {
@@ -231,7 +237,8 @@ static int
 bin_lma_create_group(yasm_section *sect, /*@null@*/ void *d)
 {
     bin_objfmt_output_info *info = (bin_objfmt_output_info *)d;
-    bin_section_data *bsd = yasm_section_get_data(sect, &bin_section_data_cb);
+    bin_section_data *bsd = yasm_section_get_slot_data(sect,
+                                                       bin_section_data_slot);
     unsigned long align = yasm_section_get_align(sect);
     bin_group *group;
 
@@ -299,7 +306,8 @@ static int
 bin_vma_create_group(yasm_section *sect, /*@null@*/ void *d)
 {
     bin_objfmt_output_info *info = (bin_objfmt_output_info *)d;
-    bin_section_data *bsd = yasm_section_get_data(sect, &bin_section_data_cb);
+    bin_section_data *bsd = yasm_section_get_slot_data(sect,
+                                                       bin_section_data_slot);
     bin_group *group;
 
     assert(info != NULL);
@@ -470,13 +478,14 @@ group_assign_vstart_recurse(bin_group *group, yasm_intnum *start,
 static /*@null@*/ const yasm_intnum *
 get_ssym_value(yasm_symrec *sym)
 {
-    bin_symrec_data *bsymd = yasm_symrec_get_data(sym, &bin_symrec_data_cb);
+    bin_symrec_data *bsymd = yasm_symrec_get_slot_data(sym,
+                                                       bin_symrec_data_slot);
     bin_section_data *bsd;
 
     if (!bsymd)
         return NULL;
 
-    bsd = yasm_section_get_data(bsymd->section, &bin_section_data_cb);
+    bsd = yasm_section_get_slot_data(bsymd->section, bin_section_data_slot);
     assert(bsd != NULL);
 
     switch (bsymd->which) {
@@ -508,7 +517,7 @@ bin_objfmt_expr_xform(/*@returned@*/ /*@only@*/ yasm_expr *e,
             (sect = yasm_bc_get_section(precbc)) &&
             (dist = yasm_calc_bc_dist(yasm_section_bcs_first(sect), precbc))) {
             bin_section_data *bsd;
-            bsd = yasm_section_get_data(sect, &bin_section_data_cb);
+            bsd = yasm_section_get_slot_data(sect, bin_section_data_slot);
             assert(bsd != NULL);
             yasm_intnum_calc(dist, YASM_EXPR_ADD, bsd->ivstart);
             e->terms[i].type = YASM_EXPR_INT;
@@ -535,6 +544,7 @@ typedef struct map_output_info {
     yasm_intnum *intn;
 
     /* symrec output information */
+    const yasm_symtab_index *symindex;
     unsigned long count;
     yasm_section *section;  /* NULL for EQUs */
 
@@ -545,7 +555,8 @@ typedef struct map_output_info {
 static int
 map_prescan_bytes(yasm_section *sect, void *d)
 {
-    bin_section_data *bsd = yasm_section_get_data(sect, &bin_section_data_cb);
+    bin_section_data *bsd = yasm_section_get_slot_data(sect,
+                                                       bin_section_data_slot);
     map_output_info *info = (map_output_info *)d;
 
     assert(bsd != NULL);
@@ -683,7 +694,7 @@ map_symrec_output(yasm_symrec *sym, void *d)
     } else if (yasm_symrec_get_label(sym, &precbc) &&
                yasm_bc_get_section(precbc) == info->section) {
         bin_section_data *bsd =
-            yasm_section_get_data(info->section, &bin_section_data_cb);
+            yasm_section_get_slot_data(info->section, bin_section_data_slot);
 
         /* Real address */
         yasm_intnum_set_uint(info->intn, yasm_bc_next_offset(precbc));
@@ -703,6 +714,14 @@ map_symrec_output(yasm_symrec *sym, void *d)
     return 0;
 }
 
+static void
+map_symrecs(map_output_info *info, int (*func) (yasm_symrec *sym, void *d))
+{
+    size_t i;
+    for (i=0; i<info->symindex->num_syms; i++)
+        func(info->symindex->syms[i], info);
+}
+
 static void
 map_sections_symbols(bin_groups *groups, map_output_info *info)
 {
@@ -710,7 +729,7 @@ map_sections_symbols(bin_groups *groups, map_output_info *info)
     TAILQ_FOREACH(group, groups, link) {
         info->count = 0;
         info->section = group->section;
-        yasm_symtab_traverse(info->object->symtab, info, map_symrec_count);
+        map_symrecs(info, map_symrec_count);
 
         if (info->count > 0) {
             const char *s = yasm_section_get_name(group->section);
@@ -722,8 +741,7 @@ map_sections_symbols(bin_groups *groups, map_output_info *info)
                     info->bytes*2+2, "Real",
                     info->bytes*2+2, "Virtual",
                     "Name");
-            yasm_symtab_traverse(info->object->symtab, info,
-                                 map_symrec_output);
+            map_symrecs(info, map_symrec_output);
             fprintf(info->f, "\n\n");
         }
 
@@ -760,6 +778,7 @@ output_map(bin_objfmt_output_info *info)
     }
 
     mapinfo.object = info->object;
+    mapinfo.symindex = yasm_symtab_get_index(info->object->symtab);
     mapinfo.f = f;
 
     /* Temporary intnum */
@@ -825,15 +844,14 @@ output_map(bin_objfmt_output_info *info)
         /* EQUs */
         mapinfo.count = 0;
         mapinfo.section = NULL;
-        yasm_symtab_traverse(info->object->symtab, &mapinfo, map_symrec_count);
+        map_symrecs(&mapinfo, map_symrec_count);
 
         if (mapinfo.count > 0) {
             fprintf(f, "---- No Section ");
             for (i=0; i<63; i++)
                 fputc('-', f);
             fprintf(f, "\n\n%-*s%s\n", mapinfo.bytes*2+2, "Value", "Name");
-            yasm_symtab_traverse(info->object->symtab, &mapinfo,
-                                 map_symrec_output);
+            map_symrecs(&mapinfo, map_symrec_output);
             fprintf(f, "\n\n");
         }
 
@@ -861,8 +879,8 @@ check_lma_overlap(yasm_section *sect, /*@null@*/ void *d)
     if (sect == other)
         return 0;
 
-    bsd = yasm_section_get_data(sect, &bin_section_data_cb);
-    bsd2 = yasm_section_get_data(other, &bin_section_data_cb);
+    bsd = yasm_section_get_slot_data(sect, bin_section_data_slot);
+    bsd2 = yasm_section_get_slot_data(other, bin_section_data_slot);
 
     if (yasm_intnum_is_zero(bsd->length) ||
         yasm_intnum_is_zero(bsd2->length))
@@ -976,13 +994,15 @@ bin_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 {
     /*@null@*/ bin_objfmt_output_info *info = (bin_objfmt_output_info *)d;
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+    const unsigned char *bytes;
     unsigned long size = REGULAR_OUTBUF_SIZE;
+    unsigned long mult;
     int gap;
 
     assert(info != NULL);
 
-    bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
-                             bin_objfmt_output_value, NULL);
+    bytes = yasm_bc_tobytes_rep(bc, info->buf, &size, &mult, &gap, &bigbuf,
+                                info, bin_objfmt_output_value, NULL);
 
     /* Don't bother doing anything else if size ended up being 0. */
     if (size == 0) {
@@ -993,20 +1013,12 @@ bin_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
             N_("uninitialized space declared in code/data section: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_outbuf_write_zeros(info->ob, size*mult);
     } else {
-        /* Output buf (or bigbuf if non-NULL) to file */
-        fwrite(bigbuf ? bigbuf : info->buf, (size_t)size, 1, info->f);
+        /* Output buf (or bigbuf if non-NULL) to file, once per copy */
+        yasm_outbuf_write_rep(info->ob, bytes, (size_t)size, mult);
     }
 
     /* If bigbuf was allocated, free it */
@@ -1023,12 +1035,13 @@ bin_objfmt_no_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
     /*@null@*/ bin_objfmt_output_info *info = (bin_objfmt_output_info *)d;
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
     unsigned long size = REGULAR_OUTBUF_SIZE;
+    unsigned long mult;
     int gap;
 
     assert(info != NULL);
 
-    bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
-                             bin_objfmt_output_value, NULL);
+    yasm_bc_tobytes_rep(bc, info->buf, &size, &mult, &gap, &bigbuf, info,
+                        bin_objfmt_output_value, NULL);
 
     /* If bigbuf was allocated, free it */
     if (bigbuf)
@@ -1050,7 +1063,8 @@ bin_objfmt_no_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 static int
 bin_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 {
-    bin_section_data *bsd = yasm_section_get_data(sect, &bin_section_data_cb);
+    bin_section_data *bsd = yasm_section_get_slot_data(sect,
+                                                       bin_section_data_slot);
     /*@null@*/ bin_objfmt_output_info *info = (bin_objfmt_output_info *)d;
 
     assert(bsd != NULL);
@@ -1076,9 +1090,8 @@ bin_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
             yasm_errwarn_propagate(info->errwarns, 0);
             return 0;
         }
-        if (fseek(info->f, yasm_intnum_get_int(info->tmp_intn) + info->start,
-                  SEEK_SET) < 0)
-            yasm__fatal(N_("could not seek on output file"));
+        yasm_outbuf_seek(info->ob, (unsigned long)
+                         yasm_intnum_get_int(info->tmp_intn) + info->start);
         yasm_section_bcs_traverse(sect, info->errwarns,
                                   info, bin_objfmt_output_bytecode);
     }
@@ -1102,17 +1115,21 @@ bin_objfmt_cleanup(bin_objfmt_output_info *info)
         bin_group_destroy(group);
 }
 
+/* Lay out and write all sections into ob, starting at its current position.
+ */
 static void
-bin_objfmt_output(yasm_object *object, FILE *f, /*@unused@*/ int all_syms,
-                  yasm_errwarns *errwarns)
+bin_objfmt_output_image(yasm_object *object, yasm_outbuf *ob,
+                        yasm_errwarns *errwarns)
 {
     yasm_objfmt_bin *objfmt_bin = (yasm_objfmt_bin *)object->objfmt;
     bin_objfmt_output_info info;
+    const yasm_symtab_index *symindex;
     bin_group *group, *lma_group, *vma_group, *group_temp;
     yasm_intnum *start, *last, *vdelta;
     bin_groups unsorted_groups, bss_groups;
+    size_t i;
 
-    info.start = ftell(f);
+    info.start = yasm_outbuf_tell(ob);
 
     /* Set ORG to 0 unless otherwise specified */
     if (objfmt_bin->org) {
@@ -1134,14 +1151,18 @@ bin_objfmt_output(yasm_object *object, FILE *f, /*@unused@*/ int all_syms,
 
     info.object = object;
     info.errwarns = errwarns;
-    info.f = f;
+    info.ob = ob;
     info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
     info.tmp_intn = yasm_intnum_create_uint(0);
     TAILQ_INIT(&info.lma_groups);
     TAILQ_INIT(&info.vma_groups);
 
-    /* Check symbol table */
-    yasm_symtab_traverse(object->symtab, &info, bin_objfmt_check_sym);
+    /* Check symbol table; only global/common/extern syms can draw a
+     * warning or error.
+     */
+    symindex = yasm_symtab_get_index(object->symtab);
+    for (i=0; i<symindex->num_exported; i++)
+        bin_objfmt_check_sym(symindex->exported[i], &info);
 
     /* Create section groups */
     if (yasm_object_sections_traverse(object, &info, bin_lma_create_group)) {
@@ -1356,6 +1377,20 @@ bin_objfmt_output(yasm_object *object, FILE *f, /*@unused@*/ int all_syms,
     bin_objfmt_cleanup(&info);
 }
 
+static void
+bin_objfmt_output(yasm_object *object, FILE *f, /*@unused@*/ int all_syms,
+                  yasm_errwarns *errwarns)
+{
+    yasm_outbuf *ob = yasm_outbuf_create();
+
+    bin_objfmt_output_image(object, ob, errwarns);
+    if (!yasm_outbuf_flush(ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
+    yasm_outbuf_destroy(ob);
+}
+
 static void
 bin_objfmt_destroy(yasm_objfmt *objfmt)
 {
@@ -1497,7 +1532,7 @@ bin_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
 
     retval = yasm_object_find_general(object, sectname);
     if (retval) {
-        bsd = yasm_section_get_data(retval, &bin_section_data_cb);
+        bsd = yasm_section_get_slot_data(retval, bin_section_data_slot);
         assert(bsd != NULL);
         data.follows = bsd->follows;
         data.vfollows = bsd->vfollows;
@@ -1564,7 +1599,7 @@ bin_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
     retval = yasm_object_get_general(object, sectname, 0, (int)data.code,
                                      (int)data.bss, &isnew, line);
 
-    bsd = yasm_section_get_data(retval, &bin_section_data_cb);
+    bsd = yasm_section_get_slot_data(retval, bin_section_data_slot);
 
     if (isnew || yasm_section_is_default(retval)) {
         yasm_section_set_default(retval, 0);
@@ -1849,12 +1884,13 @@ dosexe_objfmt_output(yasm_object *object, FILE *f, /*@unused@*/ int all_syms,
     unsigned long tot_size, size, bss_size;
     unsigned long start, bss;
     unsigned char c;
+    yasm_outbuf *ob = yasm_outbuf_create();
 
-    fseek(f, EXE_HEADER_SIZE, SEEK_SET);
+    yasm_outbuf_seek(ob, EXE_HEADER_SIZE);
 
-    bin_objfmt_output(object, f, all_syms, errwarns);
+    bin_objfmt_output_image(object, ob, errwarns);
 
-    tot_size = ftell(f);
+    tot_size = yasm_outbuf_tell(ob);
 
     /* if there is a __bss_start symbol, data after it is 0, no need to write
      * it.  */
@@ -1864,90 +1900,101 @@ dosexe_objfmt_output(yasm_object *object, FILE *f, /*@unused@*/ int all_syms,
     else
         size = tot_size;
     bss_size = tot_size - size;
-#ifdef HAVE_FTRUNCATE
-    if (size != tot_size)
-        ftruncate(fileno(f), EXE_HEADER_SIZE + size);
-#endif
-    fseek(f, 0, SEEK_SET);
+    yasm_outbuf_seek(ob, 0);
 
     /* magic */
-    fwrite("MZ", 1, 2, f);
+    yasm_outbuf_write(ob, "MZ", 2);
 
     /* file size */
     c = size & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = !!(size & 0x100);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = ((size + 511) >> 9) & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = ((size + 511) >> 17) & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* relocation # */
     c = 0;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* header size */
     c = EXE_HEADER_SIZE / 16;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = 0;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* minimum paragraph # */
     bss_size = (bss_size + 15) >> 4;
     c = bss_size & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = (bss_size >> 8) & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* maximum paragraph # */
     c = 0xFF;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* relative value of stack segment */
     c = 0;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* SP at start */
     c = 0;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* header checksum */
     c = 0;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* IP at start */
     start = get_sym(object, "start");
     if (!start) {
         yasm_error_set(YASM_ERROR_GENERAL,
                 N_("%s: could not find symbol `start'"));
+        if (!yasm_outbuf_flush(ob, f)) {
+            yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+            yasm_errwarn_propagate(errwarns, 0);
+        }
+        yasm_outbuf_destroy(ob);
         return;
     }
     c = start & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = (start >> 8) & 0xff;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* CS start */
     c = 0;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* reloc start */
     c = 0x22;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
     c = 0;
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
 
     /* Overlay number */
     c = 0;
-    fwrite(&c, 1, 1, f);
-    fwrite(&c, 1, 1, f);
+    yasm_outbuf_write(ob, &c, 1);
+    yasm_outbuf_write(ob, &c, 1);
+
+    /* Don't write out the bss */
+    if (size != tot_size)
+        yasm_outbuf_truncate(ob, EXE_HEADER_SIZE + size);
+
+    if (!yasm_outbuf_flush(ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
+    yasm_outbuf_destroy(ob);
 }
 
 
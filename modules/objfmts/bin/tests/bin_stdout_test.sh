@@ -0,0 +1,3 @@
+#! /bin/sh
+${srcdir}/stdout_test.sh bin_stdout_test modules/objfmts/bin/tests "bin objfmt stdout" "-f bin" ""
+exit $?
@@ -0,0 +1,9 @@
+; Everything from __bss_start on is left out of the file; the header's
+; minimum allocation reserves memory for it instead.
+bits 16
+	db "data"
+start:
+	mov ax, 0x4c00
+	int 0x21
+__bss_start:
+	times 100 db 0
@@ -0,0 +1,3 @@
+#! /bin/sh
+${srcdir}/stdout_test.sh dosexe_stdout_test modules/objfmts/bin/tests/dosexe "dosexe objfmt stdout" "-f dosexe" ".exe"
+exit $?
@@ -0,0 +1,3 @@
+#! /bin/sh
+${srcdir}/out_test.sh dosexe_test modules/objfmts/bin/tests/dosexe "dosexe objfmt" "-f dosexe" ".exe"
+exit $?
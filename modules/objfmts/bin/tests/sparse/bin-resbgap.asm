@@ -0,0 +1,8 @@
+; Uninitialized space in a progbits section is zero-filled in the output
+; but should not be materialized, in memory or in the file.
+section .a start=0
+db 1
+resb 0x1000000
+db 2
+section .b start=0x10000000
+db 3
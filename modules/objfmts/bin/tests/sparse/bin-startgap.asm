@@ -0,0 +1,6 @@
+; The 256 MB gap between the sections should be neither held in memory
+; nor written out.
+section .a start=0
+db 1
+section .b start=0x10000000
+db 2
@@ -0,0 +1,86 @@
+#! /bin/sh
+
+YASM_TEST_SUITE=1
+export YASM_TEST_SUITE
+
+case `echo "testing\c"; echo 1,2,3`,`echo -n testing; echo 1,2,3` in
+  *c*,-n*) ECHO_N= ECHO_C='
+' ECHO_T='      ' ;;
+  *c*,*  ) ECHO_N=-n ECHO_C= ECHO_T= ;;
+  *)       ECHO_N= ECHO_C='\c' ECHO_T= ;;
+esac
+
+mkdir results >/dev/null 2>&1
+
+#
+# Verify that large gaps in the output are neither held in memory (the
+# assembler runs with a virtual memory limit well below the output size)
+# nor written to the file (if the file system supports holes), and that
+# they read back as zeros.
+#
+
+passedct=0
+failedct=0
+
+# Only check disk usage if the file system makes holes in the first place.
+rm -f results/sparse.probe
+dd if=/dev/zero of=results/sparse.probe bs=1 count=1 seek=16777215 >/dev/null 2>&1
+probekb=`du -k results/sparse.probe 2>/dev/null | sed 's,[^0-9].*,,'`
+if test -n "${probekb}" && test ${probekb} -lt 1024; then
+    checkdu=1
+else
+    checkdu=0
+fi
+rm -f results/sparse.probe
+
+echo $ECHO_N "Test bin_sparse_test: $ECHO_C"
+for asm in ${srcdir}/modules/objfmts/bin/tests/sparse/*.asm
+do
+    a=`echo ${asm} | sed 's,^.*/,,;s,.asm$,,'`
+    o=${a}
+    rm -f results/${o}
+
+    # Run within a subshell to prevent signal messages from displaying.
+    sh -c "ulimit -v 120000 2>/dev/null; ./yasm -f bin -o results/${o} ${asm} 2>/dev/null" >/dev/null 2>/dev/null
+    status=$?
+    if test $status -gt 128; then
+        # We should never get a coredump!
+        echo $ECHO_N "C$ECHO_C"
+        eval "failed$failedct='C: ${a} crashed!'"
+        failedct=`expr $failedct + 1`
+    elif test $status -gt 0; then
+        echo $ECHO_N "E$ECHO_C"
+        eval "failed$failedct='E: ${a} returned an error code!'"
+        failedct=`expr $failedct + 1`
+    elif sh -c "./yasm -f bin -o - ${asm} 2>/dev/null | cmp -s - results/${o}"; then
+        kb=`du -k results/${o} | sed 's,[^0-9].*,,'`
+        if test ${checkdu} -eq 1 && test ${kb} -ge 1024; then
+            # Gap was written out.
+            echo $ECHO_N "S$ECHO_C"
+            eval "failed$failedct='S: ${a} output is not sparse!'"
+            failedct=`expr $failedct + 1`
+        else
+            echo $ECHO_N ".$ECHO_C"
+            passedct=`expr $passedct + 1`
+        fi
+    else
+        # File output doesn't match the (fully written) piped output.
+        echo $ECHO_N "O$ECHO_C"
+        eval "failed$failedct='O: ${a} file output did not match piped output!'"
+        failedct=`expr $failedct + 1`
+    fi
+    rm -f results/${o}
+done
+
+ct=`expr $failedct + $passedct`
+per=`expr 100 \* $passedct / $ct`
+
+echo " +$passedct-$failedct/$ct $per%"
+i=0
+while test $i -lt $failedct; do
+    eval "failure=\$failed$i"
+    echo " ** $failure"
+    i=`expr $i + 1`
+done
+
+exit $failedct
@@ -199,8 +199,9 @@ typedef struct coff_objfmt_output_info {
     yasm_object *object;
     yasm_objfmt_coff *objfmt_coff;
     yasm_errwarns *errwarns;
-    /*@dependent@*/ FILE *f;
+    /*@only@*/ yasm_outbuf *ob;
     /*@only@*/ unsigned char *buf;
+    /*@only@*/ yasm_intnum *tmp_intn;   /* temporary working intnum */
     yasm_section *sect;
     /*@dependent@*/ coff_section_data *csd;
     unsigned long addr;                 /* start of next section */
@@ -226,6 +227,9 @@ static const yasm_assoc_data_callback coff_symrec_data_cb = {
     coff_symrec_data_print
 };
 
+/* Slots of the above callbacks, for fast lookups */
+static unsigned int coff_section_data_slot, coff_symrec_data_slot;
+
 /* Bytecode callback function prototypes */
 static void win32_sxdata_bc_destroy(void *contents);
 static void win32_sxdata_bc_print(const void *contents, FILE *f,
@@ -246,7 +250,8 @@ static const yasm_bytecode_callback win32_sxdata_bc_callback = {
     win32_sxdata_bc_calc_len,
     yasm_bc_expand_common,
     win32_sxdata_bc_tobytes,
-    0
+    0,
+    NULL
 };
 
 yasm_objfmt_module yasm_coff_LTX_objfmt;
@@ -287,6 +292,9 @@ coff_common_create(yasm_object *object)
         return NULL;
     }
 
+    coff_section_data_slot = yasm_assoc_data_register(&coff_section_data_cb);
+    coff_symrec_data_slot = yasm_assoc_data_register(&coff_symrec_data_cb);
+
     objfmt_coff->parse_scnum = 1;    /* section numbering starts at 1 */
 
     /* FIXME: misuse of NULL bytecode here; it works, but only barely. */
@@ -445,7 +453,7 @@ coff_objfmt_set_section_addr(yasm_section *sect, /*@null@*/ void *d)
     /*@dependent@*/ /*@null@*/ coff_section_data *csd;
 
     assert(info != NULL);
-    csd = yasm_section_get_data(sect, &coff_section_data_cb);
+    csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
     assert(csd != NULL);
 
     csd->addr = info->addr;
@@ -537,7 +545,7 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
                 /*@dependent@*/ /*@null@*/ yasm_expr **csize_expr;
                 /*@dependent@*/ /*@null@*/ yasm_intnum *common_size;
 
-                csymd = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+                csymd = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
                 assert(csymd != NULL);
                 csize_expr = yasm_symrec_get_common_size(sym);
                 assert(csize_expr != NULL);
@@ -563,8 +571,8 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
             if (yasm_symrec_get_label(sym, &sym_precbc)) {
                 yasm_section *sym_sect = yasm_bc_get_section(sym_precbc);
                 /*@null@*/ coff_section_data *sym_csd;
-                sym_csd = yasm_section_get_data(sym_sect,
-                                                &coff_section_data_cb);
+                sym_csd = yasm_section_get_slot_data(sym_sect,
+                                                     coff_section_data_slot);
                 assert(sym_csd != NULL);
                 sym = sym_csd->sym;
                 intn_val = yasm_bc_next_offset(sym_precbc);
@@ -707,10 +715,11 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
      * and dist.  We do all this at the end to avoid creating temporary
      * intnums above (except for dist).
      */
+    intn = info->tmp_intn;
     if (intn_minus <= intn_val)
-        intn = yasm_intnum_create_uint(intn_val-intn_minus);
+        yasm_intnum_set_uint(intn, intn_val-intn_minus);
     else {
-        intn = yasm_intnum_create_uint(intn_minus-intn_val);
+        yasm_intnum_set_uint(intn, intn_minus-intn_val);
         yasm_intnum_calc(intn, YASM_EXPR_NEG, NULL);
     }
 
@@ -719,7 +728,6 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
         if (!intn2) {
             yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                            N_("coff: relocation too complex"));
-            yasm_intnum_destroy(intn);
             if (dist)
                 yasm_intnum_destroy(dist);
             return 1;
@@ -734,7 +742,6 @@ coff_objfmt_output_value(yasm_value *value, unsigned char *buf,
 
     retval = yasm_arch_intnum_tobytes(info->object->arch, intn, buf, destsize,
                                       valsize, 0, bc, warn);
-    yasm_intnum_destroy(intn);
     return retval;
 }
 
@@ -743,13 +750,15 @@ coff_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 {
     /*@null@*/ coff_objfmt_output_info *info = (coff_objfmt_output_info *)d;
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+    const unsigned char *bytes;
     unsigned long size = REGULAR_OUTBUF_SIZE;
+    unsigned long mult;
     int gap;
 
     assert(info != NULL);
 
-    bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
-                             coff_objfmt_output_value, NULL);
+    bytes = yasm_bc_tobytes_rep(bc, info->buf, &size, &mult, &gap, &bigbuf,
+                                info, coff_objfmt_output_value, NULL);
 
     /* Don't bother doing anything else if size ended up being 0. */
     if (size == 0) {
@@ -758,24 +767,16 @@ coff_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
         return 0;
     }
 
-    info->csd->size += size;
+    info->csd->size += size*mult;
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
             N_("uninitialized space declared in code/data section: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_outbuf_write_zeros(info->ob, size*mult);
     } else {
-        /* Output buf (or bigbuf if non-NULL) to file */
-        fwrite(bigbuf ? bigbuf : info->buf, (size_t)size, 1, info->f);
+        /* Output buf (or bigbuf if non-NULL) to file, once per copy */
+        yasm_outbuf_write_rep(info->ob, bytes, (size_t)size, mult);
     }
 
     /* If bigbuf was allocated, free it */
@@ -795,7 +796,7 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     unsigned char *localbuf;
 
     assert(info != NULL);
-    csd = yasm_section_get_data(sect, &coff_section_data_cb);
+    csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
     assert(csd != NULL);
 
     /* Add to strtab if in win32 format and name > 8 chars */
@@ -817,12 +818,7 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         pos = 0;    /* position = 0 because it's not in the file */
         csd->size = yasm_bc_next_offset(yasm_section_bcs_last(sect));
     } else {
-        pos = ftell(info->f);
-        if (pos == -1) {
-            yasm__fatal(N_("could not get file position on output file"));
-            /*@notreached@*/
-            return 1;
-        }
+        pos = (long)yasm_outbuf_tell(info->ob);
 
         info->sect = sect;
         info->csd = csd;
@@ -848,13 +844,7 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     if (csd->nreloc == 0)
         return 0;
 
-    pos = ftell(info->f);
-    if (pos == -1) {
-        yasm__fatal(N_("could not get file position on output file"));
-        /*@notreached@*/
-        return 1;
-    }
-    csd->relptr = (unsigned long)pos;
+    csd->relptr = yasm_outbuf_tell(info->ob);
 
     /* If >=64K relocs (for Win32/64), we set a flag in the section header
      * (NRELOC_OVFL) and the first relocation contains the number of relocs.
@@ -864,7 +854,7 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         YASM_WRITE_32_L(localbuf, csd->nreloc+1);   /* address of relocation */
         YASM_WRITE_32_L(localbuf, 0);           /* relocated symbol */
         YASM_WRITE_16_L(localbuf, 0);           /* type of relocation */
-        fwrite(info->buf, 10, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 10);
     }
 
     reloc = (coff_reloc *)yasm_section_relocs_first(sect);
@@ -872,7 +862,8 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         /*@null@*/ coff_symrec_data *csymd;
         localbuf = info->buf;
 
-        csymd = yasm_symrec_get_data(reloc->reloc.sym, &coff_symrec_data_cb);
+        csymd = yasm_symrec_get_slot_data(reloc->reloc.sym,
+                                          coff_symrec_data_slot);
         if (!csymd)
             yasm_internal_error(
                 N_("coff: no symbol data for relocated symbol"));
@@ -881,7 +872,7 @@ coff_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         localbuf += 4;                          /* address of relocation */
         YASM_WRITE_32_L(localbuf, csymd->index);    /* relocated symbol */
         YASM_WRITE_16_L(localbuf, reloc->type);     /* type of relocation */
-        fwrite(info->buf, 10, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 10);
 
         reloc = (coff_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
     }
@@ -903,7 +894,7 @@ coff_objfmt_output_sectstr(yasm_section *sect, /*@null@*/ void *d)
     name = yasm_section_get_name(sect);
     len = strlen(name);
     if (len > 8)
-        fwrite(name, len+1, 1, info->f);
+        yasm_outbuf_write(info->ob, name, len+1);
     return 0;
 }
 
@@ -918,7 +909,7 @@ coff_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
 
     assert(info != NULL);
     objfmt_coff = info->objfmt_coff;
-    csd = yasm_section_get_data(sect, &coff_section_data_cb);
+    csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
     assert(csd != NULL);
 
     /* Check to see if alignment is supported size */
@@ -970,7 +961,7 @@ coff_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
         YASM_WRITE_16_L(localbuf, csd->nreloc); /* num of relocation entries */
     YASM_WRITE_16_L(localbuf, 0);               /* num of line number entries */
     YASM_WRITE_32_L(localbuf, csd->flags);      /* flags */
-    fwrite(info->buf, 40, 1, info->f);
+    yasm_outbuf_write(info->ob, info->buf, 40);
 
     return 0;
 }
@@ -984,7 +975,7 @@ coff_objfmt_count_sym(yasm_symrec *sym, /*@null@*/ void *d)
 
     assert(info != NULL);
 
-    sym_data = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+    sym_data = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
 
     if (info->all_syms || vis != YASM_SYM_LOCAL || yasm_symrec_is_abs(sym) ||
         (sym_data && sym_data->forcevis)) {
@@ -1016,7 +1007,7 @@ coff_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
     /*@dependent@*/ /*@null@*/ coff_symrec_data *csymd;
     yasm_valparamhead *objext_valparams =
         yasm_symrec_get_objext_valparams(sym);
-    csymd = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+    csymd = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
 
     assert(info != NULL);
 
@@ -1067,7 +1058,8 @@ coff_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
              */
             if (sect) {
                 /*@dependent@*/ /*@null@*/ coff_section_data *csectd;
-                csectd = yasm_section_get_data(sect, &coff_section_data_cb);
+                csectd = yasm_section_get_slot_data(sect,
+                                                    coff_section_data_slot);
                 if (csectd) {
                     scnum = csectd->scnum;
                     scnlen = csectd->size;
@@ -1127,7 +1119,7 @@ coff_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
         YASM_WRITE_16_L(localbuf, csymd->type); /* type */
         YASM_WRITE_8(localbuf, csymd->sclass);  /* storage class */
         YASM_WRITE_8(localbuf, csymd->numaux);  /* number of aux entries */
-        fwrite(info->buf, 18, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 18);
         for (aux=0; aux<csymd->numaux; aux++) {
             localbuf = info->buf;
             memset(localbuf, 0, 18);
@@ -1152,7 +1144,7 @@ coff_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
                     yasm_internal_error(
                         N_("coff: unrecognized aux symtab type"));
             }
-            fwrite(info->buf, 18, 1, info->f);
+            yasm_outbuf_write(info->ob, info->buf, 18);
         }
         yasm_xfree(name);
     }
@@ -1165,7 +1157,7 @@ coff_objfmt_output_str(yasm_symrec *sym, /*@null@*/ void *d)
     /*@null@*/ coff_objfmt_output_info *info = (coff_objfmt_output_info *)d;
     yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
     /*@dependent@*/ /*@null@*/ coff_symrec_data *csymd;
-    csymd = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+    csymd = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
 
     assert(info != NULL);
 
@@ -1180,13 +1172,13 @@ coff_objfmt_output_str(yasm_symrec *sym, /*@null@*/ void *d)
             yasm_internal_error(N_("coff: expected sym data to be present"));
 
         if (len > 8)
-            fwrite(name, len+1, 1, info->f);
+            yasm_outbuf_write(info->ob, name, len+1);
         for (aux=0; aux<csymd->numaux; aux++) {
             switch (csymd->auxtype) {
                 case COFF_SYMTAB_AUX_FILE:
                     len = strlen(csymd->aux[0].fname);
                     if (len > 14)
-                        fwrite(csymd->aux[0].fname, len+1, 1, info->f);
+                        yasm_outbuf_write(info->ob, csymd->aux[0].fname, len+1);
                     break;
                 default:
                     break;
@@ -1203,8 +1195,9 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 {
     yasm_objfmt_coff *objfmt_coff = (yasm_objfmt_coff *)object->objfmt;
     coff_objfmt_output_info info;
+    const yasm_symtab_index *symindex;
+    size_t i;
     unsigned char *localbuf;
-    long pos;
     unsigned long symtab_pos;
     unsigned long symtab_count;
     unsigned int flags;
@@ -1234,20 +1227,19 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     info.object = object;
     info.objfmt_coff = objfmt_coff;
     info.errwarns = errwarns;
-    info.f = f;
+    info.ob = yasm_outbuf_create();
     info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
+    info.tmp_intn = yasm_intnum_create_uint(0);
 
     /* Allocate space for headers by seeking forward */
-    if (fseek(f, (long)(20+40*(objfmt_coff->parse_scnum-1)), SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, 20+40*(objfmt_coff->parse_scnum-1));
 
     /* Finalize symbol table (assign index to each symbol) */
     info.indx = 0;
     info.all_syms = all_syms;
-    yasm_symtab_traverse(object->symtab, &info, coff_objfmt_count_sym);
+    symindex = yasm_symtab_get_index(object->symtab);
+    for (i=0; i<symindex->num_syms; i++)
+        coff_objfmt_count_sym(symindex->syms[i], &info);
     symtab_count = info.indx;
 
     /* Section data/relocs */
@@ -1259,35 +1251,35 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
          */
         info.addr = 0;
         if (yasm_object_sections_traverse(object, &info,
-                                          coff_objfmt_set_section_addr))
+                                          coff_objfmt_set_section_addr)) {
+            yasm_intnum_destroy(info.tmp_intn);
+            yasm_outbuf_destroy(info.ob);
             return;
+        }
     }
     info.addr = 0;
     if (yasm_object_sections_traverse(object, &info,
-                                      coff_objfmt_output_section))
+                                      coff_objfmt_output_section)) {
+        yasm_intnum_destroy(info.tmp_intn);
+        yasm_outbuf_destroy(info.ob);
         return;
+    }
 
     /* Symbol table */
-    pos = ftell(f);
-    if (pos == -1) {
-        yasm__fatal(N_("could not get file position on output file"));
-        /*@notreached@*/
-        return;
-    }
-    symtab_pos = (unsigned long)pos;
-    yasm_symtab_traverse(object->symtab, &info, coff_objfmt_output_sym);
+    symtab_pos = yasm_outbuf_tell(info.ob);
+    for (i=0; i<symindex->num_syms; i++)
+        coff_objfmt_output_sym(symindex->syms[i], &info);
 
     /* String table */
-    yasm_fwrite_32_l(info.strtab_offset, f); /* total length */
+    localbuf = info.buf;
+    YASM_WRITE_32_L(localbuf, info.strtab_offset);      /* total length */
+    yasm_outbuf_write(info.ob, info.buf, 4);
     yasm_object_sections_traverse(object, &info, coff_objfmt_output_sectstr);
-    yasm_symtab_traverse(object->symtab, &info, coff_objfmt_output_str);
+    for (i=0; i<symindex->num_syms; i++)
+        coff_objfmt_output_str(symindex->syms[i], &info);
 
     /* Write headers */
-    if (fseek(f, 0, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, 0);
 
     localbuf = info.buf;
     YASM_WRITE_16_L(localbuf, objfmt_coff->machine);    /* magic number */
@@ -1309,10 +1301,16 @@ coff_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     if (objfmt_coff->machine != COFF_MACHINE_AMD64)
         flags |= COFF_F_AR32WR;
     YASM_WRITE_16_L(localbuf, flags);
-    fwrite(info.buf, 20, 1, f);
+    yasm_outbuf_write(info.ob, info.buf, 20);
 
     yasm_object_sections_traverse(object, &info, coff_objfmt_output_secthead);
 
+    if (!yasm_outbuf_flush(info.ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
+    yasm_outbuf_destroy(info.ob);
+    yasm_intnum_destroy(info.tmp_intn);
     yasm_xfree(info.buf);
 }
 
@@ -1337,7 +1335,7 @@ coff_objfmt_add_default_section(yasm_object *object)
 
     retval = yasm_object_get_general(object, ".text", 16, 1, 0, &isnew, 0);
     if (isnew) {
-        csd = yasm_section_get_data(retval, &coff_section_data_cb);
+        csd = yasm_section_get_slot_data(retval, coff_section_data_slot);
         csd->flags = COFF_STYP_TEXT;
         if (objfmt_coff->win32)
             csd->flags |= COFF_STYP_EXECUTE | COFF_STYP_READ;
@@ -1623,7 +1621,7 @@ coff_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
                                      resonly, &isnew, line);
     yasm_xfree(realname);
 
-    csd = yasm_section_get_data(retval, &coff_section_data_cb);
+    csd = yasm_section_get_slot_data(retval, coff_section_data_slot);
 
     if (isnew || yasm_section_is_default(retval)) {
         yasm_section_set_default(retval, 0);
@@ -1733,7 +1731,7 @@ dir_export(yasm_object *object, yasm_valparamhead *valparams,
     /* Initialize directive section if needed */
     if (isnew) {
         coff_section_data *csd;
-        csd = yasm_section_get_data(sect, &coff_section_data_cb);
+        csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
         csd->flags = COFF_STYP_INFO | COFF_STYP_DISCARD | COFF_STYP_READ;
     }
 
@@ -1765,7 +1763,7 @@ dir_safeseh(yasm_object *object, yasm_valparamhead *valparams,
     if (symname) {
         coff_symrec_data *sym_data;
         sym = yasm_symtab_use(object->symtab, symname, line);
-        sym_data = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+        sym_data = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
         if (!sym_data) {
             sym_data = coff_objfmt_sym_set_data(sym, COFF_SCL_NULL, 0,
                                                 COFF_SYMTAB_AUX_NONE);
@@ -1787,7 +1785,7 @@ dir_safeseh(yasm_object *object, yasm_valparamhead *valparams,
     /* Initialize sxdata section if needed */
     if (isnew) {
         coff_section_data *csd;
-        csd = yasm_section_get_data(sect, &coff_section_data_cb);
+        csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
         csd->flags = COFF_STYP_INFO;
     }
 
@@ -1827,7 +1825,7 @@ win32_sxdata_bc_tobytes(yasm_bytecode *bc, unsigned char **bufp,
     unsigned char *buf = *bufp;
     coff_symrec_data *csymd;
 
-    csymd = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+    csymd = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
     if (!csymd)
         yasm_internal_error(N_("coff: no symbol data for SAFESEH symbol"));
 
@@ -1958,7 +1956,7 @@ dir_def(yasm_object *object, yasm_valparamhead *valparams,
     }
 
     sym = yasm_symtab_use(object->symtab, symname, line);
-    sym_data = yasm_symrec_get_data(sym, &coff_symrec_data_cb);
+    sym_data = yasm_symrec_get_slot_data(sym, coff_symrec_data_slot);
     if (!sym_data) {
         sym_data = coff_objfmt_sym_set_data(sym, COFF_SCL_NULL, 0,
                                             COFF_SYMTAB_AUX_NONE);
@@ -2323,7 +2321,7 @@ dir_endproc_frame(yasm_object *object, /*@null@*/ yasm_valparamhead *valparams,
 
     /* Initialize xdata section if needed */
     if (isnew) {
-        csd = yasm_section_get_data(sect, &coff_section_data_cb);
+        csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
         csd->flags = COFF_STYP_DATA | COFF_STYP_READ;
         yasm_section_set_align(sect, 8, line);
     }
@@ -2332,7 +2330,7 @@ dir_endproc_frame(yasm_object *object, /*@null@*/ yasm_valparamhead *valparams,
     unwindpos = yasm_symtab_define_curpos(object->symtab, "$",
         yasm_section_bcs_last(sect), line);
     /* Get symbol for .xdata as we'll want to reference it with WRT */
-    csd = yasm_section_get_data(sect, &coff_section_data_cb);
+    csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
     xdata_sym = csd->sym;
 
     /* Add unwind info.  Use line number of start of procedure. */
@@ -2348,7 +2346,7 @@ dir_endproc_frame(yasm_object *object, /*@null@*/ yasm_valparamhead *valparams,
 
     /* Initialize pdata section if needed */
     if (isnew) {
-        csd = yasm_section_get_data(sect, &coff_section_data_cb);
+        csd = yasm_section_get_slot_data(sect, coff_section_data_slot);
         csd->flags = COFF_STYP_DATA | COFF_STYP_READ;
         csd->flags2 = COFF_FLAG_NOBASE;
         yasm_section_set_align(sect, 4, line);
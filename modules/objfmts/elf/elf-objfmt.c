@@ -62,12 +62,14 @@ typedef struct yasm_objfmt_elf {
 typedef struct {
     yasm_objfmt_elf *objfmt_elf;
     yasm_errwarns *errwarns;
-    FILE *f;
+    yasm_outbuf *ob;
     elf_secthead *shead;
     yasm_section *sect;
     yasm_object *object;
     unsigned long sindex;
     yasm_symrec *GOT_sym;
+    unsigned long sect_size;    /* bytes output so far in current section */
+    /*@only@*/ yasm_intnum *tmp_intn;   /* temporary working intnum */
 } elf_objfmt_output_info;
 
 typedef struct {
@@ -90,7 +92,8 @@ elf_objfmt_symtab_append(yasm_objfmt_elf *objfmt_elf, yasm_symrec *sym,
                          yasm_expr *size, elf_address *value,
                          yasm_object *object)
 {
-    elf_symtab_entry *entry = yasm_symrec_get_data(sym, &elf_symrec_data);
+    elf_symtab_entry *entry = yasm_symrec_get_slot_data(sym,
+                                                        elf_symrec_data_slot);
 
     if (!entry) {
         /*@only@*/ char *symname = yasm_symrec_get_global_name(sym, object);
@@ -257,7 +260,8 @@ elf_objfmt_build_symtab(yasm_symrec *sym, /*@null@*/ void *d)
     build_symtab_info *info = (build_symtab_info *)d;
     yasm_sym_vis vis = yasm_symrec_get_visibility(sym);
     yasm_sym_status status = yasm_symrec_get_status(sym);
-    elf_symtab_entry *entry = yasm_symrec_get_data(sym, &elf_symrec_data);
+    elf_symtab_entry *entry = yasm_symrec_get_slot_data(sym,
+                                                        elf_symrec_data_slot);
     elf_address value=0;
     yasm_section *sect=NULL;
     yasm_bytecode *precbc=NULL;
@@ -317,7 +321,7 @@ elf_objfmt_build_symtab(yasm_symrec *sym, /*@null@*/ void *d)
         if (yasm_symrec_get_equ(sym) && !yasm_symrec_is_abs(sym))
             return 0;
 #endif
-        entry = yasm_symrec_get_data(sym, &elf_symrec_data);
+        entry = yasm_symrec_get_slot_data(sym, elf_symrec_data_slot);
         if (!entry) {
             /*@only@*/ char *symname =
                 yasm_symrec_get_global_name(sym, info->object);
@@ -356,6 +360,12 @@ elf_objfmt_create_common(yasm_object *object, yasm_objfmt_module *module,
     const elf_machine_handler *elf_march;
 
     objfmt_elf->objfmt.module = module;
+
+    elf_section_data_slot = yasm_assoc_data_register(&elf_section_data);
+    elf_symrec_data_slot = yasm_assoc_data_register(&elf_symrec_data);
+    elf_ssym_symrec_data_slot =
+        yasm_assoc_data_register(&elf_ssym_symrec_data);
+
     elf_march = elf_set_arch(object->arch, object->symtab, bits_pref);
     if (!elf_march) {
         yasm_xfree(objfmt_elf);
@@ -426,28 +436,19 @@ elfx32_objfmt_create(yasm_object *object)
     return elf_objfmt_create_common(object, &yasm_elfx32_LTX_objfmt, 32, NULL);
 }
 
-static long
-elf_objfmt_output_align(FILE *f, unsigned int align)
+static unsigned long
+elf_objfmt_output_align(yasm_outbuf *ob, unsigned int align)
 {
-    long pos;
+    unsigned long pos;
     unsigned long delta;
     if (!is_exp2(align))
         yasm_internal_error("requested alignment not a power of two");
 
-    pos = ftell(f);
-    if (pos == -1) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("could not get file position on output file"));
-        return -1;
-    }
+    pos = yasm_outbuf_tell(ob);
     delta = align - (pos & (align-1)); 
     if (delta != align) {
         pos += delta;
-        if (fseek(f, pos, SEEK_SET) < 0) {
-            yasm_error_set(YASM_ERROR_IO,
-                           N_("could not set file position on output file"));
-            return -1;
-        }
+        yasm_outbuf_seek(ob, pos);
     }
     return pos;
 }
@@ -543,7 +544,8 @@ elf_objfmt_output_value(yasm_value *value, unsigned char *buf,
                 /* Relocate to section start */
                 yasm_section *sym_sect = yasm_bc_get_section(sym_precbc);
                 /*@null@*/ elf_secthead *sym_shead;
-                sym_shead = yasm_section_get_data(sym_sect, &elf_section_data);
+                sym_shead = yasm_section_get_slot_data(sym_sect,
+                                                       elf_section_data_slot);
                 assert(sym_shead != NULL);
                 sym = elf_secthead_get_sym(sym_shead);
 
@@ -568,14 +570,14 @@ elf_objfmt_output_value(yasm_value *value, unsigned char *buf,
         elf_secthead_append_reloc(info->sect, info->shead, reloc);
     }
 
-    intn = yasm_intnum_create_uint(intn_val);
+    intn = info->tmp_intn;
+    yasm_intnum_set_uint(intn, intn_val);
 
     if (value->abs) {
         yasm_intnum *intn2 = yasm_expr_get_intnum(&value->abs, 0);
         if (!intn2) {
             yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                            N_("elf: relocation too complex"));
-            yasm_intnum_destroy(intn);
             return 1;
         }
         yasm_intnum_calc(intn, YASM_EXPR_ADD, intn2);
@@ -585,7 +587,6 @@ elf_objfmt_output_value(yasm_value *value, unsigned char *buf,
         elf_handle_reloc_addend(intn, reloc, offset);
     retval = yasm_arch_intnum_tobytes(info->object->arch, intn, buf, destsize,
                                       valsize, 0, bc, warn);
-    yasm_intnum_destroy(intn);
     return retval;
 }
 
@@ -595,14 +596,17 @@ elf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
     /*@null@*/ elf_objfmt_output_info *info = (elf_objfmt_output_info *)d;
     unsigned char buf[256];
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+    const unsigned char *bytes;
     unsigned long size = 256;
+    unsigned long mult;
     int gap;
 
     if (info == NULL)
         yasm_internal_error("null info struct");
 
-    bigbuf = yasm_bc_tobytes(bc, buf, &size, &gap, info,
-                             elf_objfmt_output_value, elf_objfmt_output_reloc);
+    bytes = yasm_bc_tobytes_rep(bc, buf, &size, &mult, &gap, &bigbuf,
+                                info, elf_objfmt_output_value,
+                                elf_objfmt_output_reloc);
 
     /* Don't bother doing anything else if size ended up being 0. */
     if (size == 0) {
@@ -610,28 +614,16 @@ elf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
             yasm_xfree(bigbuf);
         return 0;
     }
-    else {
-        yasm_intnum *bcsize = yasm_intnum_create_uint(size);
-        elf_secthead_add_size(info->shead, bcsize);
-        yasm_intnum_destroy(bcsize);
-    }
+    info->sect_size += size*mult;
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
             N_("uninitialized space declared in code/data section: zeroing"));
-        /* Write out in chunks */
-        memset(buf, 0, 256);
-        left = size;
-        while (left > 256) {
-            fwrite(buf, 256, 1, info->f);
-            left -= 256;
-        }
-        fwrite(buf, left, 1, info->f);
+        yasm_outbuf_write_zeros(info->ob, size*mult);
     } else {
-        /* Output buf (or bigbuf if non-NULL) to file */
-        fwrite(bigbuf ? bigbuf : buf, (size_t)size, 1, info->f);
+        /* Output buf (or bigbuf if non-NULL) to file, once per copy */
+        yasm_outbuf_write_rep(info->ob, bytes, (size_t)size, mult);
     }
 
     /* If bigbuf was allocated, free it */
@@ -652,7 +644,7 @@ elf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
 
     if (info == NULL)
         yasm_internal_error("null info struct");
-    shead = yasm_section_get_data(sect, &elf_section_data);
+    shead = yasm_section_get_slot_data(sect, elf_section_data_slot);
     if (shead == NULL)
         yasm_internal_error("no associated data");
 
@@ -664,35 +656,31 @@ elf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     {
         yasm_bytecode *last = yasm_section_bcs_last(sect);
         if (last) {
-            yasm_intnum *sectsize;
-            sectsize = yasm_intnum_create_uint(yasm_bc_next_offset(last));
-            elf_secthead_add_size(shead, sectsize);
-            yasm_intnum_destroy(sectsize);
+            yasm_intnum_set_uint(info->tmp_intn, yasm_bc_next_offset(last));
+            elf_secthead_add_size(shead, info->tmp_intn);
         }
         elf_secthead_set_index(shead, ++info->sindex);
         return 0;
     }
 
-    if ((pos = ftell(info->f)) == -1) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("couldn't read position on output stream"));
-        yasm_errwarn_propagate(info->errwarns, 0);
-    }
+    pos = (long)yasm_outbuf_tell(info->ob);
     pos = elf_secthead_set_file_offset(shead, pos);
-    if (fseek(info->f, pos, SEEK_SET) < 0) {
-        yasm_error_set(YASM_ERROR_IO, N_("couldn't seek on output stream"));
-        yasm_errwarn_propagate(info->errwarns, 0);
-    }
+    yasm_outbuf_seek(info->ob, (unsigned long)pos);
 
     info->sect = sect;
     info->shead = shead;
+    info->sect_size = 0;
     yasm_section_bcs_traverse(sect, info->errwarns, info,
                               elf_objfmt_output_bytecode);
 
+    /* Add the section size all at once rather than per bytecode */
+    yasm_intnum_set_uint(info->tmp_intn, info->sect_size);
+    elf_secthead_add_size(shead, info->tmp_intn);
+
     elf_secthead_set_index(shead, ++info->sindex);
 
     /* No relocations to output?  Go on to next section */
-    if (elf_secthead_write_relocs_to_file(info->f, sect, shead,
+    if (elf_secthead_write_relocs_to_file(info->ob, sect, shead,
                                           info->errwarns) == 0)
         return 0;
     elf_secthead_set_rel_index(shead, ++info->sindex);
@@ -715,17 +703,17 @@ elf_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
 
     if (info == NULL)
         yasm_internal_error("null info struct");
-    shead = yasm_section_get_data(sect, &elf_section_data);
+    shead = yasm_section_get_slot_data(sect, elf_section_data_slot);
     if (shead == NULL)
         yasm_internal_error("no section header attached to section");
 
-    if(elf_secthead_write_to_file(info->f, shead, info->sindex+1))
+    if(elf_secthead_write_to_file(info->ob, shead, info->sindex+1))
         info->sindex++;
 
     /* output strtab headers here? */
 
     /* relocation entries for .foo are stored in section .rel[a].foo */
-    if(elf_secthead_write_rel_to_file(info->f, 3, sect, shead,
+    if(elf_secthead_write_rel_to_file(info->ob, 3, sect, shead,
                                       info->sindex+1))
         info->sindex++;
 
@@ -739,7 +727,9 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     yasm_objfmt_elf *objfmt_elf = (yasm_objfmt_elf *)object->objfmt;
     elf_objfmt_output_info info;
     build_symtab_info buildsym_info;
-    long pos;
+    const yasm_symtab_index *symindex;
+    yasm_outbuf *ob;
+    size_t i;
     unsigned long elf_shead_addr;
     elf_secthead *esdn;
     unsigned long elf_strtab_offset, elf_shstrtab_offset, elf_symtab_offset;
@@ -750,19 +740,19 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     info.object = object;
     info.objfmt_elf = objfmt_elf;
     info.errwarns = errwarns;
-    info.f = f;
     info.GOT_sym = yasm_symtab_get(object->symtab, "_GLOBAL_OFFSET_TABLE_");
 
     /* Update filename strtab */
     elf_strtab_entry_set_str(objfmt_elf->file_strtab_entry,
                              object->src_filename);
 
+    /* The file is built in memory and written out once it's complete. */
+    ob = yasm_outbuf_create();
+    info.ob = ob;
+    info.tmp_intn = yasm_intnum_create_uint(0);
+
     /* Allocate space for Ehdr by seeking forward */
-    if (fseek(f, (long)(elf_proghead_get_size()), SEEK_SET) < 0) {
-        yasm_error_set(YASM_ERROR_IO, N_("could not seek on output file"));
-        yasm_errwarn_propagate(errwarns, 0);
-        return;
-    }
+    yasm_outbuf_seek(ob, elf_proghead_get_size());
 
     /* add all (local) syms to symtab because relocation needs a symtab index
      * if all_syms, register them by name.  if not, use strtab entry 0 */
@@ -770,16 +760,20 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     buildsym_info.objfmt_elf = objfmt_elf;
     buildsym_info.errwarns = errwarns;
     buildsym_info.local_names = all_syms;
-    yasm_symtab_traverse(object->symtab, &buildsym_info,
-                         elf_objfmt_build_symtab);
+    symindex = yasm_symtab_get_index(object->symtab);
+    for (i=0; i<symindex->num_syms; i++)
+        elf_objfmt_build_symtab(symindex->syms[i], &buildsym_info);
     elf_symtab_nlocal = elf_symtab_assign_indices(objfmt_elf->elf_symtab);
 
     /* output known sections - includes reloc sections which aren't in yasm's
      * list.  Assign indices as we go. */
     info.sindex = 3;
     if (yasm_object_sections_traverse(object, &info,
-                                      elf_objfmt_output_section))
+                                      elf_objfmt_output_section)) {
+        yasm_intnum_destroy(info.tmp_intn);
+        yasm_outbuf_destroy(ob);
         return;
+    }
 
     /* add final sections to the shstrtab */
     elf_strtab_name = elf_strtab_append_str(objfmt_elf->shstrtab, ".strtab");
@@ -788,36 +782,20 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
                                               ".shstrtab");
 
     /* output .shstrtab */
-    if ((pos = elf_objfmt_output_align(f, 4)) == -1) {
-        yasm_errwarn_propagate(errwarns, 0);
-        return;
-    }
-    elf_shstrtab_offset = (unsigned long) pos;
-    elf_shstrtab_size = elf_strtab_output_to_file(f, objfmt_elf->shstrtab);
+    elf_shstrtab_offset = elf_objfmt_output_align(ob, 4);
+    elf_shstrtab_size = elf_strtab_output_to_file(ob, objfmt_elf->shstrtab);
 
     /* output .strtab */
-    if ((pos = elf_objfmt_output_align(f, 4)) == -1) {
-        yasm_errwarn_propagate(errwarns, 0);
-        return;
-    }
-    elf_strtab_offset = (unsigned long) pos;
-    elf_strtab_size = elf_strtab_output_to_file(f, objfmt_elf->strtab);
+    elf_strtab_offset = elf_objfmt_output_align(ob, 4);
+    elf_strtab_size = elf_strtab_output_to_file(ob, objfmt_elf->strtab);
 
     /* output .symtab - last section so all others have indexes */
-    if ((pos = elf_objfmt_output_align(f, 4)) == -1) {
-        yasm_errwarn_propagate(errwarns, 0);
-        return;
-    }
-    elf_symtab_offset = (unsigned long) pos;
-    elf_symtab_size = elf_symtab_write_to_file(f, objfmt_elf->elf_symtab,
+    elf_symtab_offset = elf_objfmt_output_align(ob, 4);
+    elf_symtab_size = elf_symtab_write_to_file(ob, objfmt_elf->elf_symtab,
                                                errwarns);
 
     /* output section header table */
-    if ((pos = elf_objfmt_output_align(f, 16)) == -1) {
-        yasm_errwarn_propagate(errwarns, 0);
-        return;
-    }
-    elf_shead_addr = (unsigned long) pos;
+    elf_shead_addr = elf_objfmt_output_align(ob, 16);
 
     /* stabs debugging support */
     if (strcmp(yasm_dbgfmt_keyword(object->dbgfmt), "stabs")==0) {
@@ -826,9 +804,9 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
             yasm_object_find_general(object, ".stabstr");
         if (stabsect && stabstrsect) {
             elf_secthead *stab =
-                yasm_section_get_data(stabsect, &elf_section_data);
+                yasm_section_get_slot_data(stabsect, elf_section_data_slot);
             elf_secthead *stabstr =
-                yasm_section_get_data(stabstrsect, &elf_section_data);
+                yasm_section_get_slot_data(stabstrsect, elf_section_data_slot);
             if (stab && stabstr) {
                 elf_secthead_set_link(stab, elf_secthead_get_index(stabstr));
             }
@@ -842,19 +820,19 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 
     esdn = elf_secthead_create(NULL, SHT_NULL, 0, 0, 0);
     elf_secthead_set_index(esdn, 0);
-    elf_secthead_write_to_file(f, esdn, 0);
+    elf_secthead_write_to_file(ob, esdn, 0);
     elf_secthead_destroy(esdn);
 
     esdn = elf_secthead_create(elf_shstrtab_name, SHT_STRTAB, 0,
                                elf_shstrtab_offset, elf_shstrtab_size);
     elf_secthead_set_index(esdn, 1);
-    elf_secthead_write_to_file(f, esdn, 1);
+    elf_secthead_write_to_file(ob, esdn, 1);
     elf_secthead_destroy(esdn);
 
     esdn = elf_secthead_create(elf_strtab_name, SHT_STRTAB, 0,
                                elf_strtab_offset, elf_strtab_size);
     elf_secthead_set_index(esdn, 2);
-    elf_secthead_write_to_file(f, esdn, 2);
+    elf_secthead_write_to_file(ob, esdn, 2);
     elf_secthead_destroy(esdn);
 
     esdn = elf_secthead_create(elf_symtab_name, SHT_SYMTAB, 0,
@@ -862,7 +840,7 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     elf_secthead_set_index(esdn, 3);
     elf_secthead_set_info(esdn, elf_symtab_nlocal);
     elf_secthead_set_link(esdn, 2);     /* for .strtab, which is index 2 */
-    elf_secthead_write_to_file(f, esdn, 3);
+    elf_secthead_write_to_file(ob, esdn, 3);
     elf_secthead_destroy(esdn);
 
     info.sindex = 3;
@@ -870,13 +848,15 @@ elf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     yasm_object_sections_traverse(object, &info, elf_objfmt_output_secthead);
 
     /* output Ehdr */
-    if (fseek(f, 0, SEEK_SET) < 0) {
-        yasm_error_set(YASM_ERROR_IO, N_("could not seek on output file"));
+    yasm_outbuf_seek(ob, 0);
+    elf_proghead_write_to_file(ob, elf_shead_addr, info.sindex+1, 1);
+
+    if (!yasm_outbuf_flush(ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
         yasm_errwarn_propagate(errwarns, 0);
-        return;
     }
-
-    elf_proghead_write_to_file(f, elf_shead_addr, info.sindex+1, 1);
+    yasm_outbuf_destroy(ob);
+    yasm_intnum_destroy(info.tmp_intn);
 }
 
 static void
@@ -927,7 +907,8 @@ elf_objfmt_add_default_section(yasm_object *object)
     retval = yasm_object_get_general(object, ".text", 16, 1, 0, &isnew, 0);
     if (isnew)
     {
-        elf_secthead *esd = yasm_section_get_data(retval, &elf_section_data);
+        elf_secthead *esd = yasm_section_get_slot_data(retval,
+                                                       elf_section_data_slot);
         elf_secthead_set_typeflags(esd, SHT_PROGBITS,
                                    SHF_ALLOC + SHF_EXECINSTR);
         yasm_section_set_default(retval, 1);
@@ -1120,7 +1101,7 @@ elf_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
                                      (data.flags & SHF_EXECINSTR) != 0,
                                      resonly, &isnew, line);
 
-    esd = yasm_section_get_data(retval, &elf_section_data);
+    esd = yasm_section_get_slot_data(retval, elf_section_data_slot);
 
     if (isnew || yasm_section_is_default(retval)) {
         yasm_section_set_default(retval, 0);
@@ -1156,7 +1137,8 @@ dir_type(yasm_object *object, yasm_valparamhead *valparams,
     const char *symname = yasm_vp_id(vp);
     /* Get symbol elf data */
     yasm_symrec *sym = yasm_symtab_use(object->symtab, symname, line);
-    elf_symtab_entry *entry = yasm_symrec_get_data(sym, &elf_symrec_data);
+    elf_symtab_entry *entry = yasm_symrec_get_slot_data(sym,
+                                                        elf_symrec_data_slot);
     /*@null@*/ const char *type;
 
     /* Create entry if necessary */
@@ -1193,7 +1175,8 @@ dir_size(yasm_object *object, yasm_valparamhead *valparams,
     const char *symname = yasm_vp_id(vp);
     /* Get symbol elf data */
     yasm_symrec *sym = yasm_symtab_use(object->symtab, symname, line);
-    elf_symtab_entry *entry = yasm_symrec_get_data(sym, &elf_symrec_data);
+    elf_symtab_entry *entry = yasm_symrec_get_slot_data(sym,
+                                                        elf_symrec_data_slot);
     /*@only@*/ /*@null@*/ yasm_expr *size;
 
     /* Create entry if necessary */
@@ -57,7 +57,7 @@ elf_x86_x32_accepts_reloc(size_t val, yasm_symrec *wrt)
 {
     if (wrt) {
         const elf_machine_ssym *ssym = (elf_machine_ssym *)
-            yasm_symrec_get_data(wrt, &elf_ssym_symrec_data);
+            yasm_symrec_get_slot_data(wrt, elf_ssym_symrec_data_slot);
         if (!ssym || val != ssym->size)
             return 0;
         return 1;
@@ -79,7 +79,7 @@ elf_x86_x32_write_symtab_entry(unsigned char *bufp,
     YASM_WRITE_8(bufp, ELF32_ST_OTHER(entry->vis));
     if (entry->sect) {
         elf_secthead *shead =
-            yasm_section_get_data(entry->sect, &elf_section_data);
+            yasm_section_get_slot_data(entry->sect, elf_section_data_slot);
         if (!shead)
             yasm_internal_error(N_("symbol references section without data"));
         YASM_WRITE_16_L(bufp, shead->index);
@@ -148,7 +148,7 @@ elf_x86_x32_map_reloc_info_to_type(elf_reloc_entry *reloc)
 {
     if (reloc->wrt) {
         const elf_machine_ssym *ssym = (elf_machine_ssym *)
-            yasm_symrec_get_data(reloc->wrt, &elf_ssym_symrec_data);
+            yasm_symrec_get_slot_data(reloc->wrt, elf_ssym_symrec_data_slot);
         if (!ssym || reloc->valsize != ssym->size)
             yasm_internal_error(N_("Unsupported WRT"));
 
@@ -156,7 +156,8 @@ elf_x86_x32_map_reloc_info_to_type(elf_reloc_entry *reloc)
         if (ssym->sym_rel & ELF_SSYM_THREAD_LOCAL) {
             elf_symtab_entry *esym;
 
-            esym = yasm_symrec_get_data(reloc->reloc.sym, &elf_symrec_data);
+            esym = yasm_symrec_get_slot_data(reloc->reloc.sym,
+                                             elf_symrec_data_slot);
             if (esym)
                 esym->type = STT_TLS;
         }
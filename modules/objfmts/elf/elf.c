@@ -54,6 +54,10 @@ const yasm_assoc_data_callback elf_ssym_symrec_data = {
     elf_ssym_symtab_entry_print
 };
 
+/* Slots of the above callbacks, for fast lookups */
+unsigned int elf_section_data_slot, elf_symrec_data_slot,
+    elf_ssym_symrec_data_slot;
+
 extern elf_machine_handler
     elf_machine_handler_x86_x86,
     elf_machine_handler_x86_amd64,
@@ -274,7 +278,7 @@ elf_strtab_destroy(elf_strtab_head *strtab)
 }
 
 unsigned long
-elf_strtab_output_to_file(FILE *f, elf_strtab_head *strtab)
+elf_strtab_output_to_file(yasm_outbuf *ob, elf_strtab_head *strtab)
 {
     unsigned long size = 0;
     elf_strtab_entry *entry;
@@ -285,7 +289,7 @@ elf_strtab_output_to_file(FILE *f, elf_strtab_head *strtab)
     /* consider optimizing tables here */
     STAILQ_FOREACH(entry, strtab, qlink) {
         size_t len = 1 + strlen(entry->str);
-        fwrite(entry->str, len, 1, f);
+        yasm_outbuf_write(ob, entry->str, len);
         size += (unsigned long)len;
     }
     return size;
@@ -464,7 +468,7 @@ elf_symtab_assign_indices(elf_symtab_head *symtab)
 }
 
 unsigned long
-elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
+elf_symtab_write_to_file(yasm_outbuf *ob, elf_symtab_head *symtab,
                          yasm_errwarns *errwarns)
 {
     unsigned char buf[SYMTAB_MAXSIZE], *bufp;
@@ -523,7 +527,8 @@ elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
             elf_secthead *shead;
             if (yasm_symrec_get_label(entry->sym, &precbc) &&
                 (sect = yasm_bc_get_section(precbc)) &&
-                (shead = yasm_section_get_data(sect, &elf_section_data)) &&
+                (shead = yasm_section_get_slot_data(sect,
+                                                    elf_section_data_slot)) &&
                 shead->flags & SHF_TLS) {
                 entry->type = STT_TLS;
             }
@@ -532,7 +537,7 @@ elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
         if (!elf_march->write_symtab_entry || !elf_march->symtab_entry_size)
             yasm_internal_error(N_("Unsupported machine for ELF output"));
         elf_march->write_symtab_entry(bufp, entry, value_intn, size_intn);
-        fwrite(buf, elf_march->symtab_entry_size, 1, f);
+        yasm_outbuf_write(ob, buf, elf_march->symtab_entry_size);
         size += elf_march->symtab_entry_size;
 
         yasm_intnum_destroy(size_intn);
@@ -671,7 +676,7 @@ elf_secthead_print(void *data, FILE *f, int indent_level)
 }
 
 unsigned long
-elf_secthead_write_to_file(FILE *f, elf_secthead *shead,
+elf_secthead_write_to_file(yasm_outbuf *ob, elf_secthead *shead,
                            elf_section_index sindex)
 {
     unsigned char buf[SHDR_MAXSIZE], *bufp = buf;
@@ -683,10 +688,8 @@ elf_secthead_write_to_file(FILE *f, elf_secthead *shead,
     if (!elf_march->write_secthead || !elf_march->secthead_size)
         yasm_internal_error(N_("Unsupported machine for ELF output"));
     elf_march->write_secthead(bufp, shead);
-    if (fwrite(buf, elf_march->secthead_size, 1, f))
-        return elf_march->secthead_size;
-    yasm_internal_error(N_("Failed to write an elf section header"));
-    return 0;
+    yasm_outbuf_write(ob, buf, elf_march->secthead_size);
+    return elf_march->secthead_size;
 }
 
 void
@@ -733,7 +736,8 @@ elf_handle_reloc_addend(yasm_intnum *intn,
 }
 
 unsigned long
-elf_secthead_write_rel_to_file(FILE *f, elf_section_index symtab_idx,
+elf_secthead_write_rel_to_file(yasm_outbuf *ob,
+                               elf_section_index symtab_idx,
                                yasm_section *sect, elf_secthead *shead,
                                elf_section_index sindex)
 {
@@ -750,20 +754,18 @@ elf_secthead_write_rel_to_file(FILE *f, elf_section_index symtab_idx,
     if (!elf_march->write_secthead_rel || !elf_march->secthead_size)
         yasm_internal_error(N_("Unsupported machine for ELF output"));
     elf_march->write_secthead_rel(bufp, shead, symtab_idx, sindex);
-    if (fwrite(buf, elf_march->secthead_size, 1, f))
-        return elf_march->secthead_size;
-    yasm_internal_error(N_("Failed to write an elf section header"));
-    return 0;
+    yasm_outbuf_write(ob, buf, elf_march->secthead_size);
+    return elf_march->secthead_size;
 }
 
 unsigned long
-elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
+elf_secthead_write_relocs_to_file(yasm_outbuf *ob, yasm_section *sect,
                                   elf_secthead *shead, yasm_errwarns *errwarns)
 {
     elf_reloc_entry *reloc;
     unsigned char buf[RELOC_MAXSIZE], *bufp;
     unsigned long size = 0;
-    long pos;
+    unsigned long pos;
 
     if (shead == NULL)
         yasm_internal_error("shead is null");
@@ -773,18 +775,9 @@ elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
         return 0;
 
     /* first align section to multiple of 4 */
-    pos = ftell(f);
-    if (pos == -1) {
-        yasm_error_set(YASM_ERROR_IO,
-                       N_("couldn't read position on output stream"));
-        yasm_errwarn_propagate(errwarns, 0);
-    }
-    pos = (pos + 3) & ~3;
-    if (fseek(f, pos, SEEK_SET) < 0) {
-        yasm_error_set(YASM_ERROR_IO, N_("couldn't seek on output stream"));
-        yasm_errwarn_propagate(errwarns, 0);
-    }
-    shead->rel_offset = (unsigned long)pos;
+    pos = (yasm_outbuf_tell(ob) + 3) & ~3UL;
+    yasm_outbuf_seek(ob, pos);
+    shead->rel_offset = pos;
 
 
     while (reloc) {
@@ -792,7 +785,8 @@ elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
         unsigned int r_type=0, r_sym;
         elf_symtab_entry *esym;
 
-        esym = yasm_symrec_get_data(reloc->reloc.sym, &elf_symrec_data);
+        esym = yasm_symrec_get_slot_data(reloc->reloc.sym,
+                                         elf_symrec_data_slot);
         if (esym)
             r_sym = esym->symindex;
         else
@@ -807,7 +801,7 @@ elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
         if (!elf_march->write_reloc || !elf_march->reloc_entry_size)
             yasm_internal_error(N_("Unsupported arch/machine for elf output"));
         elf_march->write_reloc(bufp, reloc, r_type, r_sym);
-        fwrite(buf, elf_march->reloc_entry_size, 1, f);
+        yasm_outbuf_write(ob, buf, elf_march->reloc_entry_size);
         size += elf_march->reloc_entry_size;
 
         reloc = (elf_reloc_entry *)
@@ -937,7 +931,7 @@ elf_proghead_get_size(void)
 }
 
 unsigned long
-elf_proghead_write_to_file(FILE *f,
+elf_proghead_write_to_file(yasm_outbuf *ob,
                            elf_offset secthead_addr,
                            unsigned long secthead_count,
                            elf_section_index shstrtab_index)
@@ -956,9 +950,6 @@ elf_proghead_write_to_file(FILE *f,
     if (((unsigned)(bufp - buf)) != elf_march->proghead_size)
         yasm_internal_error(N_("ELF program header is not proper length"));
 
-    if (fwrite(buf, elf_march->proghead_size, 1, f))
-        return elf_march->proghead_size;
-
-    yasm_internal_error(N_("Failed to write ELF program header"));
-    return 0;
+    yasm_outbuf_write(ob, buf, elf_march->proghead_size);
+    return elf_march->proghead_size;
 }
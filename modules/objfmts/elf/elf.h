@@ -423,6 +423,8 @@ struct elf_symtab_entry {
 extern const yasm_assoc_data_callback elf_section_data;
 extern const yasm_assoc_data_callback elf_symrec_data;
 extern const yasm_assoc_data_callback elf_ssym_symrec_data;
+extern unsigned int elf_section_data_slot, elf_symrec_data_slot,
+    elf_ssym_symrec_data_slot;
 
 
 const elf_machine_handler *elf_set_arch(struct yasm_arch *arch,
@@ -448,7 +450,7 @@ void elf_strtab_entry_set_str(elf_strtab_entry *entry, const char *str);
 elf_strtab_head *elf_strtab_create(void);
 elf_strtab_entry *elf_strtab_append_str(elf_strtab_head *head, const char *str);
 void elf_strtab_destroy(elf_strtab_head *head);
-unsigned long elf_strtab_output_to_file(FILE *f, elf_strtab_head *head);
+unsigned long elf_strtab_output_to_file(yasm_outbuf *ob, elf_strtab_head *head);
 
 /* symtab functions */
 elf_symtab_entry *elf_symtab_entry_create(elf_strtab_entry *name,
@@ -459,7 +461,7 @@ void elf_symtab_insert_local_sym(elf_symtab_head *symtab,
                                  elf_symtab_entry *entry);
 void elf_symtab_destroy(elf_symtab_head *head);
 unsigned long elf_symtab_assign_indices(elf_symtab_head *symtab);
-unsigned long elf_symtab_write_to_file(FILE *f, elf_symtab_head *symtab,
+unsigned long elf_symtab_write_to_file(yasm_outbuf *ob, elf_symtab_head *symtab,
                                        yasm_errwarns *errwarns);
 void elf_symtab_set_nonzero(elf_symtab_entry    *entry,
                             struct yasm_section *sect,
@@ -481,7 +483,7 @@ elf_secthead *elf_secthead_create(elf_strtab_entry      *name,
                                   elf_address           offset,
                                   elf_size              size);
 void elf_secthead_destroy(elf_secthead *esd);
-unsigned long elf_secthead_write_to_file(FILE *f, elf_secthead *esd,
+unsigned long elf_secthead_write_to_file(yasm_outbuf *ob, elf_secthead *esd,
                                          elf_section_index sindex);
 void elf_secthead_append_reloc(yasm_section *sect, elf_secthead *shead,
                                elf_reloc_entry *reloc);
@@ -511,11 +513,13 @@ char *elf_secthead_name_reloc_section(const char *basesect);
 void elf_handle_reloc_addend(yasm_intnum *intn,
                              elf_reloc_entry *reloc,
                              unsigned long offset);
-unsigned long elf_secthead_write_rel_to_file(FILE *f, elf_section_index symtab,
+unsigned long elf_secthead_write_rel_to_file(yasm_outbuf *ob,
+                                             elf_section_index symtab,
                                              yasm_section *sect,
                                              elf_secthead *esd,
                                              elf_section_index sindex);
-unsigned long elf_secthead_write_relocs_to_file(FILE *f, yasm_section *sect,
+unsigned long elf_secthead_write_relocs_to_file(yasm_outbuf *ob,
+                                                yasm_section *sect,
                                                 elf_secthead *shead,
                                                 yasm_errwarns *errwarns);
 long elf_secthead_set_file_offset(elf_secthead *shead, long pos);
@@ -524,7 +528,7 @@ long elf_secthead_set_file_offset(elf_secthead *shead, long pos);
 unsigned long
 elf_proghead_get_size(void);
 unsigned long
-elf_proghead_write_to_file(FILE *f,
+elf_proghead_write_to_file(yasm_outbuf *ob,
                            elf_offset secthead_addr,
                            unsigned long secthead_count,
                            elf_section_index shstrtab_index);
@@ -0,0 +1,3 @@
+#! /bin/sh
+${srcdir}/stdout_test.sh elf_stdout_test modules/objfmts/elf/tests "elf objfmt stdout" "-f elf" ".o"
+exit $?
@@ -294,7 +294,7 @@ typedef struct macho_objfmt_output_info {
     yasm_object *object;
     yasm_objfmt_macho *objfmt_macho;
     yasm_errwarns *errwarns;
-    /*@dependent@ */ FILE *f;
+    /*@only@ */ yasm_outbuf *ob;
     /*@only@ */ unsigned char *buf;
     yasm_section *sect;
     /*@dependent@ */ macho_section_data *msd;
@@ -314,6 +314,8 @@ typedef struct macho_objfmt_output_info {
     unsigned long symindex;     /* current symbol index in output order */
     int all_syms;               /* outputting all symbols? */
     unsigned long strlength;    /* length of all strings */
+
+    /*@only@*/ yasm_intnum *tmp_intn;   /* temporary working intnum */
 } macho_objfmt_output_info;
 
 
@@ -333,6 +335,9 @@ static const yasm_assoc_data_callback macho_symrec_data_cb = {
     macho_symrec_data_print
 };
 
+/* Slots of the above callbacks, for fast lookups */
+static unsigned int macho_section_data_slot, macho_symrec_data_slot;
+
 yasm_objfmt_module yasm_macho_LTX_objfmt;
 yasm_objfmt_module yasm_macho32_LTX_objfmt;
 yasm_objfmt_module yasm_macho64_LTX_objfmt;
@@ -345,6 +350,9 @@ macho_objfmt_create_common(yasm_object *object, yasm_objfmt_module *module,
 
     objfmt_macho->objfmt.module = module;
 
+    macho_section_data_slot = yasm_assoc_data_register(&macho_section_data_cb);
+    macho_symrec_data_slot = yasm_assoc_data_register(&macho_symrec_data_cb);
+
     /* Only support x86 arch for now */
     if (yasm__strcasecmp(yasm_arch_keyword(object->arch), "x86") != 0) {
         yasm_xfree(objfmt_macho);
@@ -538,7 +546,8 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
             if (yasm_symrec_get_label(value->rel, &sym_precbc)) {
                 yasm_section *sym_sect = yasm_bc_get_section(sym_precbc);
                 /*@null@*/ macho_section_data *msd;
-                msd = yasm_section_get_data(sym_sect, &macho_section_data_cb);
+                msd = yasm_section_get_slot_data(sym_sect,
+                                                 macho_section_data_slot);
                 assert(msd != NULL);
                 intn_plus += msd->vmoff + yasm_bc_next_offset(sym_precbc);
             }
@@ -549,10 +558,11 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
         yasm_section_add_reloc(info->sect, (yasm_reloc *)reloc, yasm_xfree);
     }
 
+    intn = info->tmp_intn;
     if (intn_minus <= intn_plus)
-        intn = yasm_intnum_create_uint(intn_plus-intn_minus);
+        yasm_intnum_set_uint(intn, intn_plus-intn_minus);
     else {
-        intn = yasm_intnum_create_uint(intn_minus-intn_plus);
+        yasm_intnum_set_uint(intn, intn_minus-intn_plus);
         yasm_intnum_calc(intn, YASM_EXPR_NEG, NULL);
     }
 
@@ -562,7 +572,6 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
         if (!intn2) {
             yasm_error_set(YASM_ERROR_TOO_COMPLEX,
                            N_("macho: relocation too complex"));
-            yasm_intnum_destroy(intn);
             return 1;
         }
         yasm_intnum_calc(intn, YASM_EXPR_ADD, intn2);
@@ -571,7 +580,6 @@ macho_objfmt_output_value(yasm_value *value, unsigned char *buf,
     retval = yasm_arch_intnum_tobytes(info->object->arch, intn, buf, destsize,
                                       valsize, 0, bc, warn);
     /*printf("val %ld\n",yasm_intnum_get_int(intn));*/
-    yasm_intnum_destroy(intn);
     return retval;
 }
 
@@ -580,13 +588,15 @@ macho_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 {
     /*@null@*/ macho_objfmt_output_info *info = (macho_objfmt_output_info *)d;
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+    const unsigned char *bytes;
     unsigned long size = REGULAR_OUTBUF_SIZE;
+    unsigned long mult;
     int gap;
 
     assert(info != NULL);
 
-    bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
-                             macho_objfmt_output_value, NULL);
+    bytes = yasm_bc_tobytes_rep(bc, info->buf, &size, &mult, &gap, &bigbuf,
+                                info, macho_objfmt_output_value, NULL);
 
     /* Don't bother doing anything else if size ended up being 0. */
     if (size == 0) {
@@ -597,21 +607,12 @@ macho_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
-
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
                       N_("uninitialized space: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_outbuf_write_zeros(info->ob, size*mult);
     } else {
-        /* Output buf (or bigbuf if non-NULL) to file */
-        fwrite(bigbuf ? bigbuf : info->buf, (size_t) size, 1, info->f);
+        /* Output buf (or bigbuf if non-NULL) to file, once per copy */
+        yasm_outbuf_write_rep(info->ob, bytes, (size_t)size, mult);
     }
 
     /* If bigbuf was allocated, free it */
@@ -629,7 +630,7 @@ macho_objfmt_output_section(yasm_section *sect, /*@null@ */ void *d)
     /*@dependent@ *//*@null@ */ macho_section_data *msd;
 
     assert(info != NULL);
-    msd = yasm_section_get_data(sect, &macho_section_data_cb);
+    msd = yasm_section_get_slot_data(sect, macho_section_data_slot);
     assert(msd != NULL);
 
     if (!(msd->flags & S_ZEROFILL)) {
@@ -655,7 +656,8 @@ macho_objfmt_output_relocs(yasm_section *sect, /*@null@*/ void *d)
         /*@null@*/ macho_symrec_data *xsymd;
         unsigned long symnum;
 
-        xsymd = yasm_symrec_get_data(reloc->reloc.sym, &macho_symrec_data_cb);
+        xsymd = yasm_symrec_get_slot_data(reloc->reloc.sym,
+                                          macho_symrec_data_slot);
         yasm_intnum_get_sized(reloc->reloc.addr, localbuf, 4, 32, 0, 0, 0);
         localbuf += 4;          /* address of relocation */
 
@@ -668,7 +670,8 @@ macho_objfmt_output_relocs(yasm_section *sect, /*@null@*/ void *d)
             symnum = 0; /* default to absolute */
             if (yasm_symrec_get_label(reloc->reloc.sym, &precbc) &&
                 (dsect = yasm_bc_get_section(precbc)) &&
-                (msd = yasm_section_get_data(dsect, &macho_section_data_cb)))
+                (msd = yasm_section_get_slot_data(dsect,
+                                                  macho_section_data_slot)))
                 symnum = msd->scnum+1;
         }
         YASM_WRITE_32_L(localbuf,
@@ -677,7 +680,7 @@ macho_objfmt_output_relocs(yasm_section *sect, /*@null@*/ void *d)
                         (((unsigned long)reloc->length & 3) << 25) |
                         (((unsigned long)reloc->ext & 1) << 27) |
                         (((unsigned long)reloc->type & 0xf) << 28));
-        fwrite(info->buf, 8, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 8);
         reloc = (macho_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
     }
 
@@ -716,7 +719,7 @@ macho_objfmt_is_section_label(yasm_symrec *sym)
         if (sect) {
             /*@dependent@*/ /*@null@*/ macho_section_data *msd;
 
-            msd = yasm_section_get_data(sect, &macho_section_data_cb);
+            msd = yasm_section_get_slot_data(sect, macho_section_data_slot);
             if (msd) {
                 if (msd->sym == sym)
                     return 1;   /* don't store section names */
@@ -736,7 +739,7 @@ macho_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
 
     assert(info != NULL);
     objfmt_macho = info->objfmt_macho;
-    msd = yasm_section_get_data(sect, &macho_section_data_cb);
+    msd = yasm_section_get_slot_data(sect, macho_section_data_slot);
     assert(msd != NULL);
 
     localbuf = info->buf;
@@ -784,9 +787,9 @@ macho_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
     YASM_WRITE_32_L(localbuf, 0);       /* reserved 2 */
 
     if (info->is_64)
-        fwrite(info->buf, MACHO_SECTCMD64_SIZE, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, MACHO_SECTCMD64_SIZE);
     else
-        fwrite(info->buf, MACHO_SECTCMD_SIZE, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, MACHO_SECTCMD_SIZE);
 
     return 0;
 }
@@ -805,7 +808,7 @@ macho_objfmt_count_sym(yasm_symrec *sym, /*@null@*/ void *d)
         if (0 == macho_objfmt_is_section_label(sym)) {
             /* Save index in symrec data */
             macho_symrec_data *sym_data =
-                yasm_symrec_get_data(sym, &macho_symrec_data_cb);
+                yasm_symrec_get_slot_data(sym, macho_symrec_data_slot);
             if (!sym_data) {
                 sym_data = yasm_xcalloc(sizeof(macho_symrec_data), 1);
                 yasm_symrec_add_data(sym, &macho_symrec_data_cb, sym_data);
@@ -850,7 +853,7 @@ macho_objfmt_output_symtable(yasm_symrec *sym, /*@null@*/ void *d)
 
         val = yasm_intnum_create_uint(0);
 
-        symd = yasm_symrec_get_data(sym, &macho_symrec_data_cb);
+        symd = yasm_symrec_get_slot_data(sym, macho_symrec_data_slot);
 
         /* Look at symrec for value/scnum/etc. */
         if (yasm_symrec_get_label(sym, &precbc)) {
@@ -864,7 +867,8 @@ macho_objfmt_output_symtable(yasm_symrec *sym, /*@null@*/ void *d)
             if (sect) {
                 /*@dependent@*/ /*@null@*/ macho_section_data *msd;
 
-                msd = yasm_section_get_data(sect, &macho_section_data_cb);
+                msd = yasm_section_get_slot_data(sect,
+                                                 macho_section_data_slot);
                 if (msd) {
                     if (msd->sym == sym) {
                         /* don't store section names */
@@ -958,7 +962,7 @@ macho_objfmt_output_symtable(yasm_symrec *sym, /*@null@*/ void *d)
 
         info->indx += symd->length;
 
-        fwrite(info->buf, 8 + long_int_bytes, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 8 + long_int_bytes);
     }
 
     return 0;
@@ -982,8 +986,8 @@ macho_objfmt_output_str(yasm_symrec *sym, /*@null@*/ void *d)
                 yasm_symrec_get_global_name(sym, info->object);
             size_t len = strlen(name);
 
-            xsymd = yasm_symrec_get_data(sym, &macho_symrec_data_cb);
-            fwrite(name, len + 1, 1, info->f);
+            xsymd = yasm_symrec_get_slot_data(sym, macho_symrec_data_slot);
+            yasm_outbuf_write(info->ob, name, len + 1);
             yasm_xfree(name);
         }
     }
@@ -999,7 +1003,7 @@ macho_objfmt_calc_sectsize(yasm_section *sect, /*@null@ */ void *d)
     unsigned long align;
 
     assert(info != NULL);
-    msd = yasm_section_get_data(sect, &macho_section_data_cb);
+    msd = yasm_section_get_slot_data(sect, macho_section_data_slot);
     assert(msd != NULL);
 
     msd->size = yasm_bc_next_offset(yasm_section_bcs_last(sect));
@@ -1033,6 +1037,9 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 {
     yasm_objfmt_macho *objfmt_macho = (yasm_objfmt_macho *)object->objfmt;
     macho_objfmt_output_info info;
+    const yasm_symtab_index *symindex;
+    /*@dependent@*/ yasm_symrec **syms;
+    size_t num_syms, i;
     unsigned char *localbuf;
     unsigned long symtab_count = 0;
     unsigned long headsize;
@@ -1047,7 +1054,7 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     info.object = object;
     info.objfmt_macho = objfmt_macho;
     info.errwarns = errwarns;
-    info.f = f;
+    info.ob = yasm_outbuf_create();
     info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
 
     if (objfmt_macho->parse_scnum == 0) {
@@ -1057,6 +1064,7 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     }
 
     val = yasm_intnum_create_uint(0);
+    info.tmp_intn = yasm_intnum_create_uint(0);
 
     /*
      * MACH-O Header, Seg CMD, Sect CMDs, Sym Tab, Reloc Data
@@ -1093,15 +1101,21 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     info.strlength = 1;         /* string table starts with a zero byte */
     info.all_syms = all_syms || info.is_64;
     /*info.all_syms = 1;                * force all syms into symbol table */
-    yasm_symtab_traverse(object->symtab, &info, macho_objfmt_count_sym);
+    symindex = yasm_symtab_get_index(object->symtab);
+    if (info.all_syms) {
+        syms = symindex->syms;
+        num_syms = symindex->num_syms;
+    } else {
+        /* Only global/common/extern syms get output */
+        syms = symindex->exported;
+        num_syms = symindex->num_exported;
+    }
+    for (i=0; i<num_syms; i++)
+        macho_objfmt_count_sym(syms[i], &info);
     symtab_count = info.indx;
 
     /* write raw section data first */
-    if (fseek(f, (long)headsize, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@ */
-        return;
-    }
+    yasm_outbuf_seek(info.ob, headsize);
 
     /* get size of sections in memory (including BSS) and size of sections
      * in file (without BSS)
@@ -1114,14 +1128,10 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     /* output sections to file */
     yasm_object_sections_traverse(object, &info, macho_objfmt_output_section);
 
-    fileoff_sections = ftell(f);
+    fileoff_sections = yasm_outbuf_tell(info.ob);
 
     /* Write headers */
-    if (fseek(f, 0, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, 0);
 
     localbuf = info.buf;
 
@@ -1202,7 +1212,7 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     YASM_WRITE_32_L(localbuf, 0);       /* no flags */
 
     /* write MACH-O header and segment command to outfile */
-    fwrite(info.buf, (size_t) (localbuf - info.buf), 1, f);
+    yasm_outbuf_write(info.ob, info.buf, (size_t) (localbuf - info.buf));
 
     /* next: section headers */
     /* offset to relocs for first section */
@@ -1222,21 +1232,17 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
                     info.s_reloff);     /* string table offset */
     YASM_WRITE_32_L(localbuf, info.strlength);  /* string table size */
     /* write symbol command */
-    fwrite(info.buf, (size_t)(localbuf - info.buf), 1, f);
+    yasm_outbuf_write(info.ob, info.buf, (size_t)(localbuf - info.buf));
 
     /*printf("num symbols %d, vmsize %d, filesize %d\n",symtab_count,
       info.vmsize, info.filesize ); */
 
     /* get back to end of raw section data */
-    if (fseek(f, (long)fileoff_sections, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, fileoff_sections);
 
     /* padding to long boundary */
     if ((info.rel_base - fileoff_sections) > 0) {
-        fwrite(pad_data, info.rel_base - fileoff_sections, 1, f);
+        yasm_outbuf_write(info.ob, pad_data, info.rel_base - fileoff_sections);
     }
 
     /* relocation data */
@@ -1244,13 +1250,21 @@ macho_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 
     /* symbol table (NLIST) */
     info.indx = 1;              /* restart symbol table indices */
-    yasm_symtab_traverse(object->symtab, &info, macho_objfmt_output_symtable);
+    for (i=0; i<num_syms; i++)
+        macho_objfmt_output_symtable(syms[i], &info);
 
     /* symbol strings */
-    fwrite(pad_data, 1, 1, f);
-    yasm_symtab_traverse(object->symtab, &info, macho_objfmt_output_str);
+    yasm_outbuf_write(info.ob, pad_data, 1);
+    for (i=0; i<num_syms; i++)
+        macho_objfmt_output_str(syms[i], &info);
 
+    if (!yasm_outbuf_flush(info.ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
+    yasm_outbuf_destroy(info.ob);
     yasm_intnum_destroy(val);
+    yasm_intnum_destroy(info.tmp_intn);
     yasm_xfree(info.buf);
 }
 
@@ -1296,7 +1310,7 @@ macho_objfmt_add_default_section(yasm_object *object)
     retval = yasm_object_get_general(object, "LC_SEGMENT.__TEXT.__text", 0, 1,
                                      0, &isnew, 0);
     if (isnew) {
-        msd = yasm_section_get_data(retval, &macho_section_data_cb);
+        msd = yasm_section_get_slot_data(retval, macho_section_data_slot);
         msd->segname = yasm__xstrdup("__TEXT");
         msd->sectname = yasm__xstrdup("__text");
         msd->flags = S_ATTR_PURE_INSTRUCTIONS;
@@ -1489,7 +1503,7 @@ macho_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
                                      &isnew, line);
     yasm_xfree(realname);
 
-    msd = yasm_section_get_data(retval, &macho_section_data_cb);
+    msd = yasm_section_get_slot_data(retval, macho_section_data_slot);
 
     if (isnew || yasm_section_is_default(retval)) {
         yasm_section_set_default(retval, 0);
@@ -118,7 +118,7 @@ typedef struct rdf_objfmt_output_info {
     yasm_object *object;
     yasm_objfmt_rdf *objfmt_rdf;
     yasm_errwarns *errwarns;
-    /*@dependent@*/ FILE *f;
+    /*@only@*/ yasm_outbuf *ob;
     /*@only@*/ unsigned char *buf;
     yasm_section *sect;
     /*@dependent@*/ rdf_section_data *rsd;
@@ -144,6 +144,9 @@ static const yasm_assoc_data_callback rdf_symrec_data_cb = {
     rdf_symrec_data_print
 };
 
+/* Slots of the above callbacks, for fast lookups */
+static unsigned int rdf_section_data_slot, rdf_symrec_data_slot;
+
 yasm_objfmt_module yasm_rdf_LTX_objfmt;
 
 
@@ -167,6 +170,9 @@ rdf_objfmt_create(yasm_object *object)
      * Really we only support byte-addressable ones.
      */
 
+    rdf_section_data_slot = yasm_assoc_data_register(&rdf_section_data_cb);
+    rdf_symrec_data_slot = yasm_assoc_data_register(&rdf_symrec_data_cb);
+
     objfmt_rdf->parse_scnum = 0;    /* section numbering starts at 0 */
 
     STAILQ_INIT(&objfmt_rdf->module_names);
@@ -253,15 +259,15 @@ rdf_objfmt_output_value(yasm_value *value, unsigned char *buf,
             /*@dependent@*/ yasm_section *sect;
 
             sect = yasm_bc_get_section(precbc);
-            csectd = yasm_section_get_data(sect, &rdf_section_data_cb);
+            csectd = yasm_section_get_slot_data(sect, rdf_section_data_slot);
             if (!csectd)
                 yasm_internal_error(N_("didn't understand section"));
             reloc->refseg = csectd->scnum;
             intn_plus = yasm_bc_next_offset(precbc);
         } else {
             /* must be common/external */
-            rsymd = yasm_symrec_get_data(reloc->reloc.sym,
-                                         &rdf_symrec_data_cb);
+            rsymd = yasm_symrec_get_slot_data(reloc->reloc.sym,
+                                              rdf_symrec_data_slot);
             if (!rsymd)
                 yasm_internal_error(
                     N_("rdf: no symbol data for relocated symbol"));
@@ -299,13 +305,15 @@ rdf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 {
     /*@null@*/ rdf_objfmt_output_info *info = (rdf_objfmt_output_info *)d;
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+    const unsigned char *bytes;
     unsigned long size = REGULAR_OUTBUF_SIZE;
+    unsigned long mult;
     int gap;
 
     assert(info != NULL);
 
-    bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
-                             rdf_objfmt_output_value, NULL);
+    bytes = yasm_bc_tobytes_rep(bc, info->buf, &size, &mult, &gap, &bigbuf,
+                                info, rdf_objfmt_output_value, NULL);
 
     /* Don't bother doing anything else if size ended up being 0. */
     if (size == 0) {
@@ -319,15 +327,17 @@ rdf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
                       N_("uninitialized space: zeroing"));
         /* Write out in chunks */
-        memset(&info->rsd->raw_data[info->rsd->size], 0, size);
+        memset(&info->rsd->raw_data[info->rsd->size], 0, size*mult);
+        info->rsd->size += size*mult;
     } else {
-        /* Output buf (or bigbuf if non-NULL) to file */
-        memcpy(&info->rsd->raw_data[info->rsd->size],
-               bigbuf ? bigbuf : info->buf, (size_t)size);
+        /* Output buf (or bigbuf if non-NULL) to file, once per copy */
+        for (; mult > 0; mult--) {
+            memcpy(&info->rsd->raw_data[info->rsd->size], bytes,
+                   (size_t)size);
+            info->rsd->size += size;
+        }
     }
 
-    info->rsd->size += size;
-
     /* If bigbuf was allocated, free it */
     if (bigbuf)
         yasm_xfree(bigbuf);
@@ -343,7 +353,7 @@ rdf_objfmt_output_section_mem(yasm_section *sect, /*@null@*/ void *d)
     unsigned long size;
 
     assert(info != NULL);
-    rsd = yasm_section_get_data(sect, &rdf_section_data_cb);
+    rsd = yasm_section_get_slot_data(sect, rdf_section_data_slot);
     assert(rsd != NULL);
 
     size = yasm_bc_next_offset(yasm_section_bcs_last(sect));
@@ -385,7 +395,7 @@ rdf_objfmt_output_section_reloc(yasm_section *sect, /*@null@*/ void *d)
     rdf_reloc *reloc;
 
     assert(info != NULL);
-    rsd = yasm_section_get_data(sect, &rdf_section_data_cb);
+    rsd = yasm_section_get_slot_data(sect, rdf_section_data_slot);
     assert(rsd != NULL);
 
     if (rsd->type == RDF_SECT_BSS) {
@@ -413,7 +423,7 @@ rdf_objfmt_output_section_reloc(yasm_section *sect, /*@null@*/ void *d)
         localbuf += 4;                          /* offset of relocation */
         YASM_WRITE_8(localbuf, reloc->size);        /* size of relocation */
         YASM_WRITE_16_L(localbuf, reloc->refseg);   /* relocated symbol */
-        fwrite(info->buf, 10, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 10);
 
         reloc = (rdf_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
     }
@@ -429,7 +439,7 @@ rdf_objfmt_output_section_file(yasm_section *sect, /*@null@*/ void *d)
     unsigned char *localbuf;
 
     assert(info != NULL);
-    rsd = yasm_section_get_data(sect, &rdf_section_data_cb);
+    rsd = yasm_section_get_slot_data(sect, rdf_section_data_slot);
     assert(rsd != NULL);
 
     if (rsd->type == RDF_SECT_BSS) {
@@ -447,10 +457,10 @@ rdf_objfmt_output_section_file(yasm_section *sect, /*@null@*/ void *d)
     YASM_WRITE_16_L(localbuf, rsd->scnum);      /* number */
     YASM_WRITE_16_L(localbuf, rsd->reserved);   /* reserved */
     YASM_WRITE_32_L(localbuf, rsd->size);       /* length */
-    fwrite(info->buf, 10, 1, info->f);
+    yasm_outbuf_write(info->ob, info->buf, 10);
 
     /* Section data */
-    fwrite(rsd->raw_data, rsd->size, 1, info->f);
+    yasm_outbuf_write(info->ob, rsd->raw_data, rsd->size);
 
     /* Free section data */
     yasm_xfree(rsd->raw_data);
@@ -544,7 +554,7 @@ rdf_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
             return 0;
 
         /* it's a label: get value and offset. */
-        csectd = yasm_section_get_data(sect, &rdf_section_data_cb);
+        csectd = yasm_section_get_slot_data(sect, rdf_section_data_slot);
         if (csectd)
             scnum = csectd->scnum;
         else
@@ -656,7 +666,7 @@ rdf_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
     YASM_WRITE_8(localbuf, 0);          /* 0-terminated name */
     yasm_xfree(name);
 
-    fwrite(info->buf, (unsigned long)(localbuf-info->buf), 1, info->f);
+    yasm_outbuf_write(info->ob, info->buf, (unsigned long)(localbuf-info->buf));
 
     yasm_errwarn_propagate(info->errwarns, yasm_symrec_get_decl_line(sym));
     return 0;
@@ -668,24 +678,21 @@ rdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 {
     yasm_objfmt_rdf *objfmt_rdf = (yasm_objfmt_rdf *)object->objfmt;
     rdf_objfmt_output_info info;
+    const yasm_symtab_index *symindex;
     unsigned char *localbuf;
-    long headerlen, filelen;
+    unsigned long headerlen, filelen;
     xdf_str *cur;
-    size_t len;
+    size_t len, i;
 
     info.object = object;
     info.objfmt_rdf = objfmt_rdf;
     info.errwarns = errwarns;
-    info.f = f;
+    info.ob = yasm_outbuf_create();
     info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
     info.bss_size = 0;
 
     /* Allocate space for file header by seeking forward */
-    if (fseek(f, (long)strlen(RDF_MAGIC)+8, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, (unsigned long)strlen(RDF_MAGIC)+8);
 
     /* Output custom header records (library and module, etc) */
     cur = STAILQ_FIRST(&objfmt_rdf->module_names);
@@ -694,8 +701,8 @@ rdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
         localbuf = info.buf;
         YASM_WRITE_8(localbuf, RDFREC_MODNAME);         /* record type */
         YASM_WRITE_8(localbuf, len);                    /* record length */
-        fwrite(info.buf, 2, 1, f);
-        fwrite(cur->str, len, 1, f);
+        yasm_outbuf_write(info.ob, info.buf, 2);
+        yasm_outbuf_write(info.ob, cur->str, len);
         cur = STAILQ_NEXT(cur, link);
     }
 
@@ -705,14 +712,16 @@ rdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
         localbuf = info.buf;
         YASM_WRITE_8(localbuf, RDFREC_DLL);             /* record type */
         YASM_WRITE_8(localbuf, len);                    /* record length */
-        fwrite(info.buf, 2, 1, f);
-        fwrite(cur->str, len, 1, f);
+        yasm_outbuf_write(info.ob, info.buf, 2);
+        yasm_outbuf_write(info.ob, cur->str, len);
         cur = STAILQ_NEXT(cur, link);
     }
 
     /* Output symbol table */
     info.indx = objfmt_rdf->parse_scnum;
-    yasm_symtab_traverse(object->symtab, &info, rdf_objfmt_output_sym);
+    symindex = yasm_symtab_get_index(object->symtab);
+    for (i=0; i<symindex->num_exported; i++)
+        rdf_objfmt_output_sym(symindex->exported[i], &info);
 
     /* UGH! Due to the fact the relocs go at the beginning of the file, and
      * we only know if we have relocs when we output the sections, we have
@@ -727,13 +736,17 @@ rdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
      * We also calculate the total size of all BSS sections here.
      */
     if (yasm_object_sections_traverse(object, &info,
-                                      rdf_objfmt_output_section_mem))
+                                      rdf_objfmt_output_section_mem)) {
+        yasm_outbuf_destroy(info.ob);
         return;
+    }
 
     /* Output all relocs */
     if (yasm_object_sections_traverse(object, &info,
-                                      rdf_objfmt_output_section_reloc))
+                                      rdf_objfmt_output_section_reloc)) {
+        yasm_outbuf_destroy(info.ob);
         return;
+    }
 
     /* Output BSS record */
     if (info.bss_size > 0) {
@@ -741,47 +754,40 @@ rdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
         YASM_WRITE_8(localbuf, RDFREC_BSS);             /* record type */
         YASM_WRITE_8(localbuf, 4);                      /* record length */
         YASM_WRITE_32_L(localbuf, info.bss_size);       /* total BSS size */
-        fwrite(info.buf, 6, 1, f);
+        yasm_outbuf_write(info.ob, info.buf, 6);
     }
 
     /* Determine header length */
-    headerlen = ftell(f);
-    if (headerlen == -1) {
-        yasm__fatal(N_("could not get file position on output file"));
-        /*@notreached@*/
-        return;
-    }
+    headerlen = yasm_outbuf_tell(info.ob);
 
     /* Section data (to file) */
     if (yasm_object_sections_traverse(object, &info,
-                                      rdf_objfmt_output_section_file))
+                                      rdf_objfmt_output_section_file)) {
+        yasm_outbuf_destroy(info.ob);
         return;
+    }
 
     /* NULL section to end file */
     memset(info.buf, 0, 10);
-    fwrite(info.buf, 10, 1, f);
+    yasm_outbuf_write(info.ob, info.buf, 10);
 
     /* Determine object length */
-    filelen = ftell(f);
-    if (filelen == -1) {
-        yasm__fatal(N_("could not get file position on output file"));
-        /*@notreached@*/
-        return;
-    }
+    filelen = yasm_outbuf_tell(info.ob);
 
     /* Write file header */
-    if (fseek(f, 0, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, 0);
 
-    fwrite(RDF_MAGIC, strlen(RDF_MAGIC), 1, f);
+    yasm_outbuf_write(info.ob, RDF_MAGIC, strlen(RDF_MAGIC));
     localbuf = info.buf;
     YASM_WRITE_32_L(localbuf, filelen-10);              /* object size */
     YASM_WRITE_32_L(localbuf, headerlen-14);            /* header size */
-    fwrite(info.buf, 8, 1, f);
+    yasm_outbuf_write(info.ob, info.buf, 8);
 
+    if (!yasm_outbuf_flush(info.ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
+    yasm_outbuf_destroy(info.ob);
     yasm_xfree(info.buf);
 }
 
@@ -841,7 +847,7 @@ rdf_objfmt_add_default_section(yasm_object *object)
 
     retval = yasm_object_get_general(object, ".text", 0, 1, 0, &isnew, 0);
     if (isnew) {
-        rsd = yasm_section_get_data(retval, &rdf_section_data_cb);
+        rsd = yasm_section_get_slot_data(retval, rdf_section_data_slot);
         rsd->type = RDF_SECT_CODE;
         rsd->reserved = 0;
         yasm_section_set_default(retval, 1);
@@ -949,7 +955,7 @@ rdf_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
     retval = yasm_object_get_general(object, sectname, 0, 1,
                                      data.type == RDF_SECT_BSS, &isnew, line);
 
-    rsd = yasm_section_get_data(retval, &rdf_section_data_cb);
+    rsd = yasm_section_get_slot_data(retval, rdf_section_data_slot);
 
     if (isnew || yasm_section_is_default(retval)) {
         yasm_section_set_default(retval, 0);
@@ -89,7 +89,7 @@ typedef struct xdf_objfmt_output_info {
     yasm_object *object;
     yasm_objfmt_xdf *objfmt_xdf;
     yasm_errwarns *errwarns;
-    /*@dependent@*/ FILE *f;
+    /*@only@*/ yasm_outbuf *ob;
     /*@only@*/ unsigned char *buf;
     yasm_section *sect;
     /*@dependent@*/ xdf_section_data *xsd;
@@ -115,6 +115,9 @@ static const yasm_assoc_data_callback xdf_symrec_data_cb = {
     xdf_symrec_data_print
 };
 
+/* Slots of the above callbacks, for fast lookups */
+static unsigned int xdf_section_data_slot, xdf_symrec_data_slot;
+
 yasm_objfmt_module yasm_xdf_LTX_objfmt;
 
 
@@ -136,6 +139,9 @@ xdf_objfmt_create(yasm_object *object)
         return NULL;
     }
 
+    xdf_section_data_slot = yasm_assoc_data_register(&xdf_section_data_cb);
+    xdf_symrec_data_slot = yasm_assoc_data_register(&xdf_symrec_data_cb);
+
     objfmt_xdf->parse_scnum = 0;    /* section numbering starts at 0 */
 
     objfmt_xdf->objfmt.module = &yasm_xdf_LTX_objfmt;
@@ -237,13 +243,15 @@ xdf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
 {
     /*@null@*/ xdf_objfmt_output_info *info = (xdf_objfmt_output_info *)d;
     /*@null@*/ /*@only@*/ unsigned char *bigbuf;
+    const unsigned char *bytes;
     unsigned long size = REGULAR_OUTBUF_SIZE;
+    unsigned long mult;
     int gap;
 
     assert(info != NULL);
 
-    bigbuf = yasm_bc_tobytes(bc, info->buf, &size, &gap, info,
-                             xdf_objfmt_output_value, NULL);
+    bytes = yasm_bc_tobytes_rep(bc, info->buf, &size, &mult, &gap, &bigbuf,
+                                info, xdf_objfmt_output_value, NULL);
 
     /* Don't bother doing anything else if size ended up being 0. */
     if (size == 0) {
@@ -252,24 +260,16 @@ xdf_objfmt_output_bytecode(yasm_bytecode *bc, /*@null@*/ void *d)
         return 0;
     }
 
-    info->xsd->size += size;
+    info->xsd->size += size*mult;
 
     /* Warn that gaps are converted to 0 and write out the 0's. */
     if (gap) {
-        unsigned long left;
         yasm_warn_set(YASM_WARN_UNINIT_CONTENTS,
                       N_("uninitialized space: zeroing"));
-        /* Write out in chunks */
-        memset(info->buf, 0, REGULAR_OUTBUF_SIZE);
-        left = size;
-        while (left > REGULAR_OUTBUF_SIZE) {
-            fwrite(info->buf, REGULAR_OUTBUF_SIZE, 1, info->f);
-            left -= REGULAR_OUTBUF_SIZE;
-        }
-        fwrite(info->buf, left, 1, info->f);
+        yasm_outbuf_write_zeros(info->ob, size*mult);
     } else {
-        /* Output buf (or bigbuf if non-NULL) to file */
-        fwrite(bigbuf ? bigbuf : info->buf, (size_t)size, 1, info->f);
+        /* Output buf (or bigbuf if non-NULL) to file, once per copy */
+        yasm_outbuf_write_rep(info->ob, bytes, (size_t)size, mult);
     }
 
     /* If bigbuf was allocated, free it */
@@ -288,7 +288,7 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     xdf_reloc *reloc;
 
     assert(info != NULL);
-    xsd = yasm_section_get_data(sect, &xdf_section_data_cb);
+    xsd = yasm_section_get_slot_data(sect, xdf_section_data_slot);
     assert(xsd != NULL);
 
     if (xsd->flags & XDF_SECT_BSS) {
@@ -298,12 +298,7 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         pos = 0;    /* position = 0 because it's not in the file */
         xsd->size = yasm_bc_next_offset(yasm_section_bcs_last(sect));
     } else {
-        pos = ftell(info->f);
-        if (pos == -1) {
-            yasm__fatal(N_("could not get file position on output file"));
-            /*@notreached@*/
-            return 1;
-        }
+        pos = (long)yasm_outbuf_tell(info->ob);
 
         info->sect = sect;
         info->xsd = xsd;
@@ -326,20 +321,15 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
     if (xsd->nreloc == 0)
         return 0;
 
-    pos = ftell(info->f);
-    if (pos == -1) {
-        yasm__fatal(N_("could not get file position on output file"));
-        /*@notreached@*/
-        return 1;
-    }
-    xsd->relptr = (unsigned long)pos;
+    xsd->relptr = yasm_outbuf_tell(info->ob);
 
     reloc = (xdf_reloc *)yasm_section_relocs_first(sect);
     while (reloc) {
         unsigned char *localbuf = info->buf;
         /*@null@*/ xdf_symrec_data *xsymd;
 
-        xsymd = yasm_symrec_get_data(reloc->reloc.sym, &xdf_symrec_data_cb);
+        xsymd = yasm_symrec_get_slot_data(reloc->reloc.sym,
+                                          xdf_symrec_data_slot);
         if (!xsymd)
             yasm_internal_error(
                 N_("xdf: no symbol data for relocated symbol"));
@@ -348,7 +338,8 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         localbuf += 4;                          /* address of relocation */
         YASM_WRITE_32_L(localbuf, xsymd->index);    /* relocated symbol */
         if (reloc->base) {
-            xsymd = yasm_symrec_get_data(reloc->base, &xdf_symrec_data_cb);
+            xsymd = yasm_symrec_get_slot_data(reloc->base,
+                                              xdf_symrec_data_slot);
             if (!xsymd)
                 yasm_internal_error(
                     N_("xdf: no symbol data for relocated base symbol"));
@@ -363,7 +354,7 @@ xdf_objfmt_output_section(yasm_section *sect, /*@null@*/ void *d)
         YASM_WRITE_8(localbuf, reloc->size);        /* size of relocation */
         YASM_WRITE_8(localbuf, reloc->shift);       /* relocation shift */
         YASM_WRITE_8(localbuf, 0);                  /* flags */
-        fwrite(info->buf, 16, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 16);
 
         reloc = (xdf_reloc *)yasm_section_reloc_next((yasm_reloc *)reloc);
     }
@@ -382,11 +373,11 @@ xdf_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
 
     assert(info != NULL);
     objfmt_xdf = info->objfmt_xdf;
-    xsd = yasm_section_get_data(sect, &xdf_section_data_cb);
+    xsd = yasm_section_get_slot_data(sect, xdf_section_data_slot);
     assert(xsd != NULL);
 
     localbuf = info->buf;
-    xsymd = yasm_symrec_get_data(xsd->sym, &xdf_symrec_data_cb);
+    xsymd = yasm_symrec_get_slot_data(xsd->sym, xdf_symrec_data_slot);
     assert(xsymd != NULL);
 
     YASM_WRITE_32_L(localbuf, xsymd->index);    /* section name symbol */
@@ -413,7 +404,7 @@ xdf_objfmt_output_secthead(yasm_section *sect, /*@null@*/ void *d)
     YASM_WRITE_32_L(localbuf, xsd->size);       /* section size */
     YASM_WRITE_32_L(localbuf, xsd->relptr);     /* file ptr to relocs */
     YASM_WRITE_32_L(localbuf, xsd->nreloc); /* num of relocation entries */
-    fwrite(info->buf, 40, 1, info->f);
+    yasm_outbuf_write(info->ob, info->buf, 40);
 
     return 0;
 }
@@ -476,7 +467,8 @@ xdf_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
              */
             if (sect) {
                 /*@dependent@*/ /*@null@*/ xdf_section_data *csectd;
-                csectd = yasm_section_get_data(sect, &xdf_section_data_cb);
+                csectd = yasm_section_get_slot_data(sect,
+                                                    xdf_section_data_slot);
                 if (csectd)
                     scnum = csectd->scnum;
                 else
@@ -512,7 +504,7 @@ xdf_objfmt_output_sym(yasm_symrec *sym, /*@null@*/ void *d)
         YASM_WRITE_32_L(localbuf, info->strtab_offset);
         info->strtab_offset += (unsigned long)(len+1);
         YASM_WRITE_32_L(localbuf, flags);       /* flags */
-        fwrite(info->buf, 16, 1, info->f);
+        yasm_outbuf_write(info->ob, info->buf, 16);
         yasm_xfree(name);
     }
     return 0;
@@ -529,7 +521,7 @@ xdf_objfmt_output_str(yasm_symrec *sym, /*@null@*/ void *d)
     if (info->all_syms || vis != YASM_SYM_LOCAL) {
         /*@only@*/ char *name = yasm_symrec_get_global_name(sym, info->object);
         size_t len = strlen(name);
-        fwrite(name, len+1, 1, info->f);
+        yasm_outbuf_write(info->ob, name, len+1);
         yasm_xfree(name);
     }
     return 0;
@@ -541,48 +533,48 @@ xdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
 {
     yasm_objfmt_xdf *objfmt_xdf = (yasm_objfmt_xdf *)object->objfmt;
     xdf_objfmt_output_info info;
+    const yasm_symtab_index *symindex;
+    size_t i;
     unsigned char *localbuf;
     unsigned long symtab_count = 0;
 
     info.object = object;
     info.objfmt_xdf = objfmt_xdf;
     info.errwarns = errwarns;
-    info.f = f;
+    info.ob = yasm_outbuf_create();
     info.buf = yasm_xmalloc(REGULAR_OUTBUF_SIZE);
 
     /* Allocate space for headers by seeking forward */
-    if (fseek(f, (long)(16+40*(objfmt_xdf->parse_scnum)), SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, 16+40*(objfmt_xdf->parse_scnum));
 
     /* Get number of symbols */
     info.indx = 0;
     info.all_syms = 1;  /* force all syms into symbol table */
-    yasm_symtab_traverse(object->symtab, &info, xdf_objfmt_count_sym);
+    symindex = yasm_symtab_get_index(object->symtab);
+    for (i=0; i<symindex->num_syms; i++)
+        xdf_objfmt_count_sym(symindex->syms[i], &info);
     symtab_count = info.indx;
 
     /* Get file offset of start of string table */
     info.strtab_offset = 16+40*(objfmt_xdf->parse_scnum)+16*symtab_count;
 
     /* Output symbol table */
-    yasm_symtab_traverse(object->symtab, &info, xdf_objfmt_output_sym);
+    for (i=0; i<symindex->num_syms; i++)
+        xdf_objfmt_output_sym(symindex->syms[i], &info);
 
     /* Output string table */
-    yasm_symtab_traverse(object->symtab, &info, xdf_objfmt_output_str);
+    for (i=0; i<symindex->num_syms; i++)
+        xdf_objfmt_output_str(symindex->syms[i], &info);
 
     /* Section data/relocs */
     if (yasm_object_sections_traverse(object, &info,
-                                      xdf_objfmt_output_section))
+                                      xdf_objfmt_output_section)) {
+        yasm_outbuf_destroy(info.ob);
         return;
+    }
 
     /* Write headers */
-    if (fseek(f, 0, SEEK_SET) < 0) {
-        yasm__fatal(N_("could not seek on output file"));
-        /*@notreached@*/
-        return;
-    }
+    yasm_outbuf_seek(info.ob, 0);
 
     localbuf = info.buf;
     YASM_WRITE_32_L(localbuf, XDF_MAGIC);       /* magic number */
@@ -590,10 +582,15 @@ xdf_objfmt_output(yasm_object *object, FILE *f, int all_syms,
     YASM_WRITE_32_L(localbuf, symtab_count);            /* number of symtabs */
     /* size of sect headers + symbol table + strings */
     YASM_WRITE_32_L(localbuf, info.strtab_offset-16);
-    fwrite(info.buf, 16, 1, f);
+    yasm_outbuf_write(info.ob, info.buf, 16);
 
     yasm_object_sections_traverse(object, &info, xdf_objfmt_output_secthead);
 
+    if (!yasm_outbuf_flush(info.ob, f)) {
+        yasm_error_set(YASM_ERROR_IO, N_("could not write output file"));
+        yasm_errwarn_propagate(errwarns, 0);
+    }
+    yasm_outbuf_destroy(info.ob);
     yasm_xfree(info.buf);
 }
 
@@ -746,7 +743,7 @@ xdf_objfmt_section_switch(yasm_object *object, yasm_valparamhead *valparams,
     retval = yasm_object_get_general(object, sectname, align, 1, resonly,
                                      &isnew, line);
 
-    xsd = yasm_section_get_data(retval, &xdf_section_data_cb);
+    xsd = yasm_section_get_slot_data(retval, xdf_section_data_slot);
 
     if (isnew || yasm_section_is_default(retval)) {
         yasm_section_set_default(retval, 0);
@@ -28,6 +28,7 @@
 
 #include <libyasm.h>
 
+#include <ctype.h>
 #include <math.h>
 
 #include "modules/parsers/nasm/nasm-parser.h"
@@ -39,6 +40,7 @@ typedef enum {
     DV_EXPR         /* Can't have registers anywhere */
 } expr_type;
 
+static int parse_linechg(yasm_parser_nasm *parser_nasm, const char *line);
 static yasm_bytecode *parse_line(yasm_parser_nasm *parser_nasm);
 static int parse_directive_valparams(yasm_parser_nasm *parser_nasm,
                                      /*@out@*/ yasm_valparamhead *vps);
@@ -226,10 +228,12 @@ nasm_parser_parse(yasm_parser_nasm *parser_nasm)
         parser_nasm->s.lim = line + strlen((char *)line)+1;
         parser_nasm->s.top = parser_nasm->s.lim;
 
-        get_next_token();
-        if (!is_eol()) {
-            bc = parse_line(parser_nasm);
-            demand_eol();
+        if (!parse_linechg(parser_nasm, (const char *)line)) {
+            get_next_token();
+            if (!is_eol()) {
+                bc = parse_line(parser_nasm);
+                demand_eol();
+            }
         }
 
         if (parser_nasm->abspos) {
@@ -276,6 +280,47 @@ nasm_parser_parse(yasm_parser_nasm *parser_nasm)
     }
 }
 
+/* Handle a "%line linenum+lineinc filename" line as generated by the
+ * preprocessor without going through the token stream.  Macro-heavy input
+ * produces one of these around every expansion, and lexing them (with
+ * full-width intnums for the numbers) costs as much as the lines they
+ * describe.  Returns 0, without doing anything, if the line isn't in
+ * exactly that form; the general parser then handles (and diagnoses) it.
+ */
+static int
+parse_linechg(yasm_parser_nasm *parser_nasm, const char *line)
+{
+    unsigned long linnum = 0, lineinc = 0;
+    int digits;
+
+    if (strncmp(line, "%line", 5) != 0 || (line[5] != ' ' && line[5] != '\t'))
+        return 0;
+    line += 5;
+    while (*line == ' ' || *line == '\t')
+        line++;
+
+    /* Larger numbers are left to the intnum path for its overflow handling */
+    for (digits = 0; isdigit((unsigned char)*line) && digits < 9; digits++)
+        linnum = linnum*10 + (unsigned long)(*line++ - '0');
+    if (digits == 0 || *line++ != '+')
+        return 0;
+    for (digits = 0; isdigit((unsigned char)*line) && digits < 9; digits++)
+        lineinc = lineinc*10 + (unsigned long)(*line++ - '0');
+    if (digits == 0 || (*line != ' ' && *line != '\t'))
+        return 0;
+    while (*line == ' ' || *line == '\t')
+        line++;
+    if (*line == '\0' || *line == '\r')
+        return 0;
+
+    /* %line indicates the line number of the *next* line, so subtract
+     * out the increment when setting the line number.
+     */
+    yasm_linemap_set(parser_nasm->linemap, line, 0, linnum - lineinc,
+                     lineinc);
+    return 1;
+}
+
 /* All parse_* functions expect to be called with curtok being their first
  * token.  They should return with curtok being the token *after* their
  * information.
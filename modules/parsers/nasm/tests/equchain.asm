@@ -0,0 +1,14 @@
+; EQUs referencing other EQUs, including forward references and values
+; that only become constant once labels are placed.
+a equ 1
+b equ a+a
+c equ b*b+a
+dd a, b, c, c+b
+dd fwd, fwd*2
+fwd equ c+later
+later equ 0x10
+lab1:
+dist equ lab2-lab1
+dd dist, dist+c
+lab2:
+dd c<<28
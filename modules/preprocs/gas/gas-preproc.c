@@ -32,8 +32,6 @@
 
 #define FALSE 0
 #define TRUE  1
-#define BSIZE 512
-
 #ifndef MAXPATHLEN
 #define MAXPATHLEN 1024
 #endif
@@ -74,7 +72,8 @@ typedef struct expr_state {
 typedef struct yasm_preproc_gas {
     yasm_preproc_base preproc;   /* base structure */
 
-    FILE *in;
+    yasm_mapfile *in;
+    unsigned long in_pos;       /* offset of next line in input */
     char *in_filename;
 
     yasm_symtab *defines;
@@ -192,45 +191,26 @@ static int unquote(const char *arg, char *to, size_t to_size, char q, char expec
 
 /* Line-reading. */
 
-static char *read_line_from_file(yasm_preproc_gas *pp, FILE *file)
+static char *read_line_from_file(yasm_mapfile *file, unsigned long *pos)
 {
-    int bufsize = BSIZE;
+    const char *line, *cr;
+    size_t len;
     char *buf;
-    char *p;
-
-    buf = yasm_xmalloc((size_t)bufsize);
-
-    /* Loop to ensure entire line is read (don't want to limit line length). */
-    p = buf;
-    for (;;) {
-        if (!fgets(p, bufsize - (p - buf), file)) {
-            if (ferror(file)) {
-                yasm_error_set(YASM_ERROR_IO, N_("error when reading from file"));
-                yasm_errwarn_propagate(pp->errwarns, pp->current_line_number);
-            }
-            break;
-        }
-        p += strlen(p);
-        if (p > buf && p[-1] == '\n') {
-            break;
-        }
-        if ((p - buf) + 1 >= bufsize) {
-            /* Increase size of buffer */
-            char *oldbuf = buf;
-            bufsize *= 2;
-            buf = yasm_xrealloc(buf, (size_t) bufsize);
-            p = buf + (p - oldbuf);
-        }
-    }
 
-    if (p == buf) {
-        /* No data; must be at EOF */
-        yasm_xfree(buf);
+    line = yasm_mapfile_get_line(file, pos, &len);
+    if (!line) {
         return NULL;
     }
 
     /* Strip the line ending */
-    buf[strcspn(buf, "\r\n")] = '\0';
+    cr = memchr(line, '\r', len);
+    if (cr) {
+        len = (size_t) (cr - line);
+    }
+
+    buf = yasm_xmalloc(len + 1);
+    memcpy(buf, line, len);
+    buf[len] = '\0';
     return buf;
 }
 
@@ -261,7 +241,7 @@ static char *read_line(yasm_preproc_gas *pp)
         return line;
     }
 
-    line = read_line_from_file(pp, pp->in);
+    line = read_line_from_file(pp->in, &pp->in_pos);
     if (line) {
         pp->in_line_number++;
         pp->next_line_number = pp->in_line_number;
@@ -638,7 +618,8 @@ static int eval_include(yasm_preproc_gas *pp, int unused, const char *arg1)
     char filename[MAXPATHLEN];
     char *line;
     int num_lines;
-    FILE *file;
+    yasm_mapfile *file;
+    unsigned long pos;
     buffered_line *prev_bline;
     included_file *inc_file;
 
@@ -653,7 +634,7 @@ static int eval_include(yasm_preproc_gas *pp, int unused, const char *arg1)
     } else {
         current_filename = SLIST_FIRST(&pp->included_files)->filename;
     }
-    file = yasm_fopen_include(filename, current_filename, "r", NULL);
+    file = yasm_mapfile_create_include(filename, current_filename, NULL);
     if (!file) {
         yasm_error_set(YASM_ERROR_SYNTAX, N_("unable to open included file \"%s\""), filename);
         yasm_errwarn_propagate(pp->errwarns, pp->current_line_number);
@@ -662,7 +643,8 @@ static int eval_include(yasm_preproc_gas *pp, int unused, const char *arg1)
 
     num_lines = 0;
     prev_bline = NULL;
-    line = read_line_from_file(pp, file);
+    pos = 0;
+    line = read_line_from_file(file, &pos);
     while (line) {
         buffered_line *bline = yasm_xmalloc(sizeof(buffered_line));
         bline->line = line;
@@ -673,9 +655,10 @@ static int eval_include(yasm_preproc_gas *pp, int unused, const char *arg1)
             SLIST_INSERT_HEAD(&pp->buffered_lines, bline, next);
         }
         prev_bline = bline;
-        line = read_line_from_file(pp, file);
+        line = read_line_from_file(file, &pos);
         num_lines++;
     }
+    yasm_mapfile_destroy(file);
 
     inc_file = yasm_xmalloc(sizeof(included_file));
     inc_file->filename = yasm__xstrdup(filename);
@@ -1229,20 +1212,21 @@ static yasm_preproc *
 gas_preproc_create(const char *in_filename, yasm_symtab *symtab,
                    yasm_linemap *lm, yasm_errwarns *errwarns)
 {
-    FILE *f;
+    yasm_mapfile *in;
     yasm_preproc_gas *pp = yasm_xmalloc(sizeof(yasm_preproc_gas));
 
     if (strcmp(in_filename, "-") != 0) {
-        f = fopen(in_filename, "r");
-        if (!f) {
-            yasm__fatal(N_("Could not open input file"));
-        }
+        in = yasm_mapfile_create(in_filename);
     } else {
-        f = stdin;
+        in = yasm_mapfile_read(stdin);
+    }
+    if (!in) {
+        yasm__fatal(N_("Could not open input file"));
     }
 
     pp->preproc.module = &yasm_gas_LTX_preproc;
-    pp->in = f;
+    pp->in = in;
+    pp->in_pos = 0;
     pp->in_filename = yasm__xstrdup(in_filename);
     pp->defines = yasm_symtab_create();
     SLIST_INIT(&pp->deferred_defines);
@@ -1268,6 +1252,7 @@ static void
 gas_preproc_destroy(yasm_preproc *preproc)
 {
     yasm_preproc_gas *pp = (yasm_preproc_gas *) preproc;
+    yasm_mapfile_destroy(pp->in);
     yasm_xfree(pp->in_filename);
     yasm_symtab_destroy(pp->defines);
     while (!SLIST_EMPTY(&pp->deferred_defines)) {
@@ -49,6 +49,8 @@
 
 typedef struct SMacro SMacro;
 typedef struct MMacro MMacro;
+typedef struct SMacroTable SMacroTable;
+typedef struct MMacroTable MMacroTable;
 typedef struct Context Context;
 typedef struct Token Token;
 typedef struct Blocks Blocks;
@@ -62,6 +64,7 @@ typedef struct Cond Cond;
 struct SMacro
 {
     SMacro *next;
+    unsigned long hash;         /* hash(name) */
     char *name;
     int level;
     int casesense;
@@ -90,6 +93,7 @@ struct SMacro
 struct MMacro
 {
     MMacro *next;
+    unsigned long hash;         /* hash(name) */
     char *name;
     int casesense;
     long nparam_min, nparam_max;
@@ -110,13 +114,42 @@ struct MMacro
     int lineno;                 /* Current line number on expansion */
 };
 
+/*
+ * Macros are kept in hash tables chained through their `next'
+ * fields. A table is allocated with MACRO_HASH_INITIAL buckets when
+ * its first macro is added, and doubles in size whenever it holds
+ * more macros than buckets, so lookups don't slow down however many
+ * macros a library defines. Each macro stores the full hash of its
+ * name, so chain entries for other names are mostly skipped without
+ * a string compare.
+ *
+ * Macros with the same name always share a chain, most recent
+ * definition first; lookups depend on that order, and growing a
+ * table preserves it.
+ */
+#define MACRO_HASH_INITIAL 16
+
+struct SMacroTable
+{
+    SMacro **buckets;
+    unsigned long size;         /* number of buckets, 0 if unallocated */
+    unsigned long count;        /* number of macros */
+};
+
+struct MMacroTable
+{
+    MMacro **buckets;
+    unsigned long size;
+    unsigned long count;
+};
+
 /*
  * The context stack is composed of a linked list of these.
  */
 struct Context
 {
     Context *next;
-    SMacro *localmac;
+    SMacroTable localmac;
     char *name;
     unsigned long number;
 };
@@ -175,12 +208,20 @@ enum
  * Such structures have `finishes' non-NULL, and `first' NULL. All
  * others have `finishes' NULL, but `first' may still be NULL if
  * the line is blank.
+ *
+ * Lines of a macro or %rep body are scanned once as they are
+ * stored, and `params' records whether the line refers to any
+ * macro parameters or macro-local labels. Expansions of lines
+ * without any are copied straight out of the body and skip the
+ * parameter substitution pass. Lines not from a body always have
+ * `params' set.
  */
 struct Line
 {
     Line *next;
     MMacro *finishes;
     Token *first;
+    int params;
 };
 
 /*
@@ -190,7 +231,8 @@ struct Line
 struct Include
 {
     Include *next;
-    FILE *fp;
+    yasm_mapfile *src;          /* file contents */
+    unsigned long srcpos;       /* offset of next line in src */
     Cond *conds;
     Line *expansion;
     char *fname;
@@ -345,7 +387,7 @@ static int Level = 0;
 static Context *cstk;
 static Include *istk;
 
-static FILE *first_fp = NULL;
+static yasm_mapfile *first_src = NULL;
 
 static efunc _error;            /* Pointer to client-provided error reporting function */
 static evalfunc evaluate;
@@ -361,22 +403,16 @@ static int first_line = 1;
 
 static ListGen *list;
 
-/*
- * The number of hash values we use for the macro lookup tables.
- * FIXME: We should *really* be able to configure this at run time,
- * or even have the hash table automatically expanding when necessary.
- */
-#define NHASH 31
-
 /*
  * The current set of multi-line macros we have defined.
  */
-static MMacro *mmacros[NHASH];
+static MMacroTable mmacros;
 
 /*
- * The current set of single-line macros we have defined.
+ * The current set of single-line macros we have defined. Macros
+ * local to a context are kept in that context's own table instead.
  */
-static SMacro *smacros[NHASH];
+static SMacroTable smacros;
 
 /*
  * The multi-line macro we are currently defining, or the %rep
@@ -1095,30 +1131,20 @@ prepreproc(char *line)
  * The hash function for macro lookups. Note that due to some
  * macros having case-insensitive names, the hash function must be
  * invariant under case changes. We implement this by applying a
- * perfectly normal hash function to the uppercase of the string.
+ * perfectly normal hash function (FNV-1a) to the uppercase of the
+ * string.
  */
-static int
-hash(char *s)
+static unsigned long
+hash(const char *s)
 {
-    unsigned int h = 0;
-    unsigned int i = 0;
-    /*
-     * Powers of three, mod 31.
-     */
-    static const int multipliers[] = {
-        1, 3, 9, 27, 19, 26, 16, 17, 20, 29, 25, 13, 8, 24, 10,
-        30, 28, 22, 4, 12, 5, 15, 14, 11, 2, 6, 18, 23, 7, 21
-    };
-
+    unsigned long h = 2166136261UL;
 
     while (*s)
     {
-        h += multipliers[i] * (unsigned char) (toupper(*s));
+        h ^= (unsigned char) toupper((unsigned char) *s);
+        h *= 16777619UL;
         s++;
-        if (++i >= elements(multipliers))
-            i = 0;
     }
-    h %= NHASH;
     return h;
 }
 
@@ -1163,6 +1189,238 @@ free_mmacro(MMacro * m)
     nasm_free(m);
 }
 
+/*
+ * Free an SMacro
+ */
+static void
+free_smacro(SMacro * s)
+{
+    nasm_free(s->name);
+    free_tlist(s->expansion);
+    nasm_free(s);
+}
+
+/*
+ * Return the chain of single-line macros that a name with hash `h'
+ * would be found in.
+ */
+static SMacro *
+smtable_chain(const SMacroTable * t, unsigned long h)
+{
+    return t->size ? t->buckets[h & (t->size - 1)] : NULL;
+}
+
+static void
+smtable_grow(SMacroTable * t)
+{
+    unsigned long newsize = t->size ? t->size * 2 : MACRO_HASH_INITIAL;
+    SMacro **buckets = nasm_malloc(newsize * sizeof(SMacro *));
+    unsigned long i;
+
+    for (i = 0; i < newsize; i++)
+        buckets[i] = NULL;
+
+    /*
+     * Doubling splits each chain between buckets i and i + size.
+     * Append to the new chains so their order is kept.
+     */
+    for (i = 0; i < t->size; i++)
+    {
+        SMacro **lo = &buckets[i], **hi = &buckets[i + t->size];
+        SMacro *m = t->buckets[i], *next;
+        while (m)
+        {
+            next = m->next;
+            if (m->hash & t->size)
+            {
+                *hi = m;
+                hi = &m->next;
+            }
+            else
+            {
+                *lo = m;
+                lo = &m->next;
+            }
+            m->next = NULL;
+            m = next;
+        }
+    }
+    nasm_free(t->buckets);
+    t->buckets = buckets;
+    t->size = newsize;
+}
+
+/*
+ * Add a single-line macro with hash `h' to the front of its chain.
+ */
+static void
+smtable_insert(SMacroTable * t, SMacro * m, unsigned long h)
+{
+    SMacro **chain;
+
+    if (t->count >= t->size)
+        smtable_grow(t);
+    chain = &t->buckets[h & (t->size - 1)];
+    m->hash = h;
+    m->next = *chain;
+    *chain = m;
+    t->count++;
+}
+
+/*
+ * Unlink a single-line macro from a table. Returns FALSE if it isn't
+ * there.
+ */
+static int
+smtable_remove(SMacroTable * t, SMacro * m)
+{
+    SMacro **s;
+
+    if (!t->size)
+        return FALSE;
+    for (s = &t->buckets[m->hash & (t->size - 1)]; *s && *s != m;
+            s = &(*s)->next);
+    if (!*s)
+        return FALSE;
+    *s = m->next;
+    t->count--;
+    return TRUE;
+}
+
+/*
+ * Free every single-line macro in a table defined at `level' or
+ * deeper.
+ */
+static void
+smtable_free_level(SMacroTable * t, int level)
+{
+    unsigned long i;
+
+    for (i = 0; i < t->size; i++)
+    {
+        SMacro **smlast = &t->buckets[i];
+        SMacro *smac = *smlast;
+        while (smac)
+        {
+            if (smac->level < level)
+            {
+                smlast = &smac->next;
+                smac = smac->next;
+            }
+            else
+            {
+                *smlast = smac->next;
+                free_smacro(smac);
+                t->count--;
+                smac = *smlast;
+            }
+        }
+    }
+}
+
+/*
+ * Free a table and all the single-line macros in it, leaving it
+ * empty.
+ */
+static void
+smtable_free(SMacroTable * t)
+{
+    unsigned long i;
+
+    for (i = 0; i < t->size; i++)
+    {
+        while (t->buckets[i])
+        {
+            SMacro *s = t->buckets[i];
+            t->buckets[i] = s->next;
+            free_smacro(s);
+        }
+    }
+    nasm_free(t->buckets);
+    t->buckets = NULL;
+    t->size = 0;
+    t->count = 0;
+}
+
+/*
+ * The same for multi-line macros.
+ */
+static MMacro *
+mmtable_chain(const MMacroTable * t, unsigned long h)
+{
+    return t->size ? t->buckets[h & (t->size - 1)] : NULL;
+}
+
+static void
+mmtable_grow(MMacroTable * t)
+{
+    unsigned long newsize = t->size ? t->size * 2 : MACRO_HASH_INITIAL;
+    MMacro **buckets = nasm_malloc(newsize * sizeof(MMacro *));
+    unsigned long i;
+
+    for (i = 0; i < newsize; i++)
+        buckets[i] = NULL;
+
+    for (i = 0; i < t->size; i++)
+    {
+        MMacro **lo = &buckets[i], **hi = &buckets[i + t->size];
+        MMacro *m = t->buckets[i], *next;
+        while (m)
+        {
+            next = m->next;
+            if (m->hash & t->size)
+            {
+                *hi = m;
+                hi = &m->next;
+            }
+            else
+            {
+                *lo = m;
+                lo = &m->next;
+            }
+            m->next = NULL;
+            m = next;
+        }
+    }
+    nasm_free(t->buckets);
+    t->buckets = buckets;
+    t->size = newsize;
+}
+
+static void
+mmtable_insert(MMacroTable * t, MMacro * m, unsigned long h)
+{
+    MMacro **chain;
+
+    if (t->count >= t->size)
+        mmtable_grow(t);
+    chain = &t->buckets[h & (t->size - 1)];
+    m->hash = h;
+    m->next = *chain;
+    *chain = m;
+    t->count++;
+}
+
+static void
+mmtable_free(MMacroTable * t)
+{
+    unsigned long i;
+
+    for (i = 0; i < t->size; i++)
+    {
+        while (t->buckets[i])
+        {
+            MMacro *m = t->buckets[i];
+            t->buckets[i] = m->next;
+            free_mmacro(m);
+        }
+    }
+    nasm_free(t->buckets);
+    t->buckets = NULL;
+    t->size = 0;
+    t->count = 0;
+}
+
 /*
  * Pop the context stack.
  */
@@ -1170,23 +1428,13 @@ static void
 ctx_pop(void)
 {
     Context *c = cstk;
-    SMacro *smac, *s;
 
     cstk = cstk->next;
-    smac = c->localmac;
-    while (smac)
-    {
-        s = smac;
-        smac = smac->next;
-        nasm_free(s->name);
-        free_tlist(s->expansion);
-        nasm_free(s);
-    }
+    smtable_free(&c->localmac);
     nasm_free(c->name);
     nasm_free(c);
 }
 
-#define BUF_DELTA 512
 /*
  * Read a line from the top file in istk, handling multiple CR/LFs
  * at the end of the line read, and handling spurious ^Zs. Will
@@ -1196,53 +1444,61 @@ ctx_pop(void)
 static char *
 read_line(void)
 {
-    char *buffer, *p, *q;
-    int bufsize, continued_count;
-
-    bufsize = BUF_DELTA;
-    buffer = nasm_malloc(BUF_DELTA);
-    p = buffer;
+    char *buffer, *p;
+    const char *q;
+    size_t len, buflen;
+    unsigned long oldpos;
+    int continued_count;
+
+    buffer = NULL;
+    buflen = 0;
     continued_count = 0;
     while (1)
     {
-        q = fgets(p, bufsize - (int)(p - buffer), istk->fp);
+        oldpos = istk->srcpos;
+        q = yasm_mapfile_get_line(istk->src, &istk->srcpos, &len);
         if (!q)
             break;
-        p += strlen(p);
-        if (p > buffer && p[-1] == '\n')
-        {
-           /* Convert backslash-CRLF line continuation sequences into
-              nothing at all (for DOS and Windows) */
-           if (((p - 2) > buffer) && (p[-3] == '\\') && (p[-2] == '\r')) {
-               p -= 3;
-               *p = 0;
-               continued_count++;
-           }
-           /* Also convert backslash-LF line continuation sequences into
-              nothing at all (for Unix) */
-           else if (((p - 1) > buffer) && (p[-2] == '\\')) {
-               p -= 2;
-               *p = 0;
-               continued_count++;
-           }
-           else {
-               break;
-           }
+
+        /* Lines are copied straight out of the file contents, with room
+         * for the NUL terminator. */
+        if (!buffer)
+            buffer = nasm_malloc(len + 1);
+        else
+            buffer = nasm_realloc(buffer, buflen + len + 1);
+        memcpy(buffer + buflen, q, len);
+        buflen += len;
+        buffer[buflen] = '\0';
+
+        if (istk->srcpos - oldpos == (unsigned long)len)
+            break;      /* last line of file, with no newline */
+
+        /* Convert backslash-CRLF line continuation sequences into
+           nothing at all (for DOS and Windows) */
+        if (buflen >= 2 && buffer[buflen-2] == '\\'
+            && buffer[buflen-1] == '\r') {
+            buflen -= 2;
+            buffer[buflen] = '\0';
+            continued_count++;
         }
-        if (p - buffer > bufsize - 10)
-        {
-            long offset = (long)(p - buffer);
-            bufsize += BUF_DELTA;
-            buffer = nasm_realloc(buffer, (size_t)bufsize);
-            p = buffer + offset;        /* prevent stale-pointer problems */
+        /* Also convert backslash-LF line continuation sequences into
+           nothing at all (for Unix) */
+        else if (buflen >= 1 && buffer[buflen-1] == '\\') {
+            buflen -= 1;
+            buffer[buflen] = '\0';
+            continued_count++;
         }
+        else
+            break;
     }
 
-    if (!q && p == buffer)
+    if (!q && buflen == 0)
     {
-        nasm_free(buffer);
+        if (buffer)
+            nasm_free(buffer);
         return NULL;
     }
+    p = buffer + buflen;
 
     nasm_src_set_linnum(nasm_src_get_linnum() + istk->lineinc + (continued_count * istk->lineinc));
 
@@ -1259,7 +1515,8 @@ read_line(void)
      */
     buffer[strcspn(buffer, "\032")] = '\0';
 
-    list->line(LIST_READ, buffer);
+    if (list->line)
+        list->line(LIST_READ, buffer);
 
     return buffer;
 }
@@ -1526,6 +1783,26 @@ delete_Token(Token * t)
     return next;
 }
 
+/*
+ * Replace an environment variable reference (%!name) by the
+ * variable's value. Returns TRUE if the token was one.
+ */
+static int
+expand_env(Token * t)
+{
+    if (t->type == TOK_PREPROC_ID && t->text[1] == '!')
+    {
+        char *p2 = getenv(t->text + 2);
+        nasm_free(t->text);
+        if (p2)
+            t->text = nasm_strdup(p2);
+        else
+            t->text = NULL;
+        return TRUE;
+    }
+    return FALSE;
+}
+
 /*
  * Convert a line of tokens back into text.
  * If expand_locals is not zero, identifiers of the form "%$*xxx"
@@ -1541,15 +1818,7 @@ detoken(Token * tlist, int expand_locals)
     len = 0;
     for (t = tlist; t; t = t->next)
     {
-        if (t->type == TOK_PREPROC_ID && t->text[1] == '!')
-        {
-            char *p2 = getenv(t->text + 2);
-            nasm_free(t->text);
-            if (p2)
-                t->text = nasm_strdup(p2);
-            else
-                t->text = NULL;
-        }
+        expand_env(t);
         /* Expand local macros here and not during preprocessing */
         if (expand_locals &&
                 t->type == TOK_PREPROC_ID && t->text &&
@@ -1734,6 +2003,7 @@ get_ctx(char *name, int all_contexts)
 {
     Context *ctx;
     SMacro *m;
+    unsigned long h;
     size_t i;
 
     if (!name || name[0] != '%' || name[1] != '$')
@@ -1759,13 +2029,14 @@ get_ctx(char *name, int all_contexts)
     if (!all_contexts)
         return ctx;
 
+    h = hash(name);
     do
     {
         /* Search for this smacro in found context */
-        m = ctx->localmac;
+        m = smtable_chain(&ctx->localmac, h);
         while (m)
         {
-            if (!mstrcmp(m->name, name, m->casesense))
+            if (m->hash == h && !mstrcmp(m->name, name, m->casesense))
                 return ctx;
             m = m->next;
         }
@@ -1776,16 +2047,16 @@ get_ctx(char *name, int all_contexts)
 }
 
 /*
- * Open an include file. This routine must always return a valid
- * file pointer if it returns - it's responsible for throwing an
+ * Open an include file. This routine must always return the valid
+ * file contents if it returns - it's responsible for throwing an
  * ERR_FATAL and bombing out completely if not. It should also try
  * the include path one by one until it finds the file or reaches
  * the end of the path.
  */
-static FILE *
+static yasm_mapfile *
 inc_fopen(char *file, char **newname)
 {
-    FILE *fp;
+    yasm_mapfile *src;
     char *combine = NULL, *c;
     char *pb, *p1, *p2, *file2 = NULL;
 
@@ -1834,30 +2105,34 @@ inc_fopen(char *file, char **newname)
     if (file2)
         strcat(file2, pb);
 
-    fp = yasm_fopen_include(file2 ? file2 : file, nasm_src_get_fname(), "r",
-                            &combine);
-    if (!fp && tasm_compatible_mode)
+    src = yasm_mapfile_create_include(file2 ? file2 : file,
+                                      nasm_src_get_fname(), &combine);
+    if (!src && tasm_compatible_mode)
     {
         char *thefile = file2 ? file2 : file;
         /* try a few case combinations */
         do {
             for (c = thefile; *c; c++)
                 *c = toupper(*c);
-            fp = yasm_fopen_include(thefile, nasm_src_get_fname(), "r", &combine);
-            if (fp) break;
+            src = yasm_mapfile_create_include(thefile, nasm_src_get_fname(),
+                                              &combine);
+            if (src) break;
             *thefile = tolower(*thefile);
-            fp = yasm_fopen_include(thefile, nasm_src_get_fname(), "r", &combine);
-            if (fp) break;
+            src = yasm_mapfile_create_include(thefile, nasm_src_get_fname(),
+                                              &combine);
+            if (src) break;
             for (c = thefile; *c; c++)
                 *c = tolower(*c);
-            fp = yasm_fopen_include(thefile, nasm_src_get_fname(), "r", &combine);
-            if (fp) break;
+            src = yasm_mapfile_create_include(thefile, nasm_src_get_fname(),
+                                              &combine);
+            if (src) break;
             *thefile = toupper(*thefile);
-            fp = yasm_fopen_include(thefile, nasm_src_get_fname(), "r", &combine);
-            if (fp) break;
+            src = yasm_mapfile_create_include(thefile, nasm_src_get_fname(),
+                                              &combine);
+            if (src) break;
         } while (0);
     }
-    if (!fp)
+    if (!src)
         error(ERR_FATAL, "unable to open include file `%s'",
               file2 ? file2 : file);
     nasm_preproc_add_dep(combine);
@@ -1866,7 +2141,7 @@ inc_fopen(char *file, char **newname)
         nasm_free(file2);
 
     *newname = combine;
-    return fp;
+    return src;
 }
 
 /*
@@ -1895,24 +2170,25 @@ smacro_defined(Context * ctx, char *name, int nparam, SMacro ** defn,
         int nocase)
 {
     SMacro *m;
+    unsigned long h = hash(name);
     int highest_level = -1;
 
     if (ctx)
-        m = ctx->localmac;
+        m = smtable_chain(&ctx->localmac, h);
     else if (name[0] == '%' && name[1] == '$')
     {
         if (cstk)
             ctx = get_ctx(name, FALSE);
         if (!ctx)
             return FALSE;       /* got to return _something_ */
-        m = ctx->localmac;
+        m = smtable_chain(&ctx->localmac, h);
     }
     else
-        m = smacros[hash(name)];
+        m = smtable_chain(&smacros, h);
 
     while (m)
     {
-        if (!mstrcmp(m->name, name, m->casesense && nocase) &&
+        if (m->hash == h && !mstrcmp(m->name, name, m->casesense && nocase) &&
                 (nparam <= 0 || m->nparam == 0 || nparam == m->nparam) && (highest_level < 0 || m->level > highest_level))
         {
             highest_level = m->level;
@@ -2198,7 +2474,7 @@ if_condition(Token * tline, int i)
                 tline = tline->next;
                 searching.plus = TRUE;
             }
-            mmac = mmacros[hash(searching.name)];
+            mmac = mmtable_chain(&mmacros, hash(searching.name));
             while (mmac)
             {
                 if (!strcmp(mmac->name, searching.name) &&
@@ -2333,7 +2609,8 @@ do_directive(Token * tline)
     Include *inc;
     Context *ctx;
     Cond *cond;
-    SMacro *smac, **smhead;
+    SMacro *smac;
+    SMacroTable *smtab;
     MMacro *mmac;
     Token *t, *tt, *param_start, *macro_start, *last, **tptr, *origline;
     Line *l;
@@ -2684,23 +2961,8 @@ do_directive(Token * tline)
             if (tline->next)
                 error(ERR_WARNING,
                         "trailing garbage after `%%clear' ignored");
-            for (j = 0; j < NHASH; j++)
-            {
-                while (mmacros[j])
-                {
-                    MMacro *m2 = mmacros[j];
-                    mmacros[j] = m2->next;
-                    free_mmacro(m2);
-                }
-                while (smacros[j])
-                {
-                    SMacro *s = smacros[j];
-                    smacros[j] = smacros[j]->next;
-                    nasm_free(s->name);
-                    free_tlist(s->expansion);
-                    nasm_free(s);
-                }
-            }
+            mmtable_free(&mmacros);
+            smtable_free(&smacros);
             free_tlist(origline);
             return DIRECTIVE_FOUND;
 
@@ -2728,7 +2990,8 @@ do_directive(Token * tline)
             inc = nasm_malloc(sizeof(Include));
             inc->next = istk;
             inc->conds = NULL;
-            inc->fp = inc_fopen(p, &newname);
+            inc->src = inc_fopen(p, &newname);
+            inc->srcpos = 0;
             inc->fname = nasm_src_set_fname(newname);
             inc->lineno = nasm_src_set_linnum(0);
             inc->lineinc = 1;
@@ -2753,7 +3016,9 @@ do_directive(Token * tline)
                 error(ERR_WARNING, "trailing garbage after `%%push' ignored");
             ctx = nasm_malloc(sizeof(Context));
             ctx->next = cstk;
-            ctx->localmac = NULL;
+            ctx->localmac.buckets = NULL;
+            ctx->localmac.size = 0;
+            ctx->localmac.count = 0;
             ctx->name = nasm_strdup(tline->text);
             ctx->number = unique++;
             cstk = ctx;
@@ -2808,48 +3073,9 @@ do_directive(Token * tline)
                         "`%%endscope': already popped all levels");
             else
             {
-                for (k = 0; k < NHASH; k++)
-                {
-                    SMacro **smlast = &smacros[k];
-                    smac = smacros[k];
-                    while (smac)
-                    {
-                        if (smac->level < Level)
-                        {
-                            smlast = &smac->next;
-                            smac = smac->next;
-                        }
-                        else
-                        {
-                            *smlast = smac->next;
-                            nasm_free(smac->name);
-                            free_tlist(smac->expansion);
-                            nasm_free(smac);
-                            smac = *smlast;
-                        }
-                    }
-                }
+                smtable_free_level(&smacros, Level);
                 for (ctx = cstk; ctx; ctx = ctx->next)
-                {
-                    SMacro **smlast = &ctx->localmac;
-                    smac = ctx->localmac;
-                    while (smac)
-                    {
-                        if (smac->level < Level)
-                        {
-                            smlast = &smac->next;
-                            smac = smac->next;
-                        }
-                        else
-                        {
-                            *smlast = smac->next;
-                            nasm_free(smac->name);
-                            free_tlist(smac->expansion);
-                            nasm_free(smac);
-                            smac = *smlast;
-                        }
-                    }
-                }
+                    smtable_free_level(&ctx->localmac, Level);
                 Level--;
             }
             free_tlist(origline);
@@ -3050,7 +3276,7 @@ do_directive(Token * tline)
                 tline = tline->next;
                 defining->nolist = TRUE;
             }
-            mmac = mmacros[hash(defining->name)];
+            mmac = mmtable_chain(&mmacros, hash(defining->name));
             while (mmac)
             {
                 if (!strcmp(mmac->name, defining->name) &&
@@ -3093,9 +3319,7 @@ do_directive(Token * tline)
                         tline->text);
                 return DIRECTIVE_FOUND;
             }
-            k = hash(defining->name);
-            defining->next = mmacros[k];
-            mmacros[k] = defining;
+            mmtable_insert(&mmacros, defining, hash(defining->name));
             defining = NULL;
             free_tlist(origline);
             return DIRECTIVE_FOUND;
@@ -3237,6 +3461,7 @@ do_directive(Token * tline)
             l->next = istk->expansion;
             l->finishes = defining;
             l->first = NULL;
+            l->params = TRUE;
             istk->expansion = l;
 
             istk->mstk = defining;
@@ -3285,9 +3510,9 @@ do_directive(Token * tline)
 
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smtab = &smacros;
             else
-                smhead = &ctx->localmac;
+                smtab = &ctx->localmac;
             mname = tline->text;
             last = tline;
             param_start = tline = tline->next;
@@ -3392,15 +3617,13 @@ do_directive(Token * tline)
                 else
                 {
                     smac = nasm_malloc(sizeof(SMacro));
-                    smac->next = *smhead;
-                    *smhead = smac;
+                    smtable_insert(smtab, smac, hash(mname));
                 }
             }
             else
             {
                 smac = nasm_malloc(sizeof(SMacro));
-                smac->next = *smhead;
-                *smhead = smac;
+                smtable_insert(smtab, smac, hash(mname));
             }
             smac->name = nasm_strdup(mname);
             smac->casesense = ((i == PP_DEFINE) || (i == PP_XDEFINE));
@@ -3432,9 +3655,9 @@ do_directive(Token * tline)
             /* Find the context that symbol belongs to */
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smtab = &smacros;
             else
-                smhead = &ctx->localmac;
+                smtab = &ctx->localmac;
 
             mname = tline->text;
 
@@ -3443,16 +3666,9 @@ do_directive(Token * tline)
              */
             while (smacro_defined(ctx, mname, -1, &smac, 1))
             {
-                /* Defined, so we need to find its predecessor and nuke it */
-                SMacro **s;
-                for (s = smhead; *s && *s != smac; s = &(*s)->next);
-                if (*s)
-                {
-                    *s = smac->next;
-                    nasm_free(smac->name);
-                    free_tlist(smac->expansion);
-                    nasm_free(smac);
-                }
+                /* Defined, so we need to unlink it and nuke it */
+                if (smtable_remove(smtab, smac))
+                    free_smacro(smac);
             }
             free_tlist(origline);
             return DIRECTIVE_FOUND;
@@ -3472,9 +3688,9 @@ do_directive(Token * tline)
             }
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smtab = &smacros;
             else
-                smhead = &ctx->localmac;
+                smtab = &ctx->localmac;
             mname = tline->text;
             last = tline;
             tline = expand_smacro(tline->next);
@@ -3524,8 +3740,7 @@ do_directive(Token * tline)
             else
             {
                 smac = nasm_malloc(sizeof(SMacro));
-                smac->next = *smhead;
-                *smhead = smac;
+                smtable_insert(smtab, smac, hash(mname));
             }
             smac->name = nasm_strdup(mname);
             smac->casesense = (i == PP_STRLEN);
@@ -3552,9 +3767,9 @@ do_directive(Token * tline)
             }
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smtab = &smacros;
             else
-                smhead = &ctx->localmac;
+                smtab = &ctx->localmac;
             mname = tline->text;
             last = tline;
             tline = expand_smacro(tline->next);
@@ -3635,8 +3850,7 @@ do_directive(Token * tline)
             else
             {
                 smac = nasm_malloc(sizeof(SMacro));
-                smac->next = *smhead;
-                *smhead = smac;
+                smtable_insert(smtab, smac, hash(mname));
             }
             smac->name = nasm_strdup(mname);
             smac->casesense = (i == PP_SUBSTR);
@@ -3666,9 +3880,9 @@ do_directive(Token * tline)
             }
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smtab = &smacros;
             else
-                smhead = &ctx->localmac;
+                smtab = &ctx->localmac;
             mname = tline->text;
             last = tline;
             tline = expand_smacro(tline->next);
@@ -3731,8 +3945,7 @@ do_directive(Token * tline)
             else
             {
                 smac = nasm_malloc(sizeof(SMacro));
-                smac->next = *smhead;
-                *smhead = smac;
+                smtable_insert(smtab, smac, hash(mname));
             }
             smac->name = nasm_strdup(mname);
             smac->casesense = (i == PP_ASSIGN);
@@ -3836,6 +4049,73 @@ find_cc(Token * t)
     return i;
 }
 
+/*
+ * Determine whether a token is one of the MMacro-local things
+ * expanded by expand_mmac_params.
+ */
+static int
+is_mmac_param(const Token * t)
+{
+    return t->type == TOK_PREPROC_ID && t->text &&
+            (((t->text[1] == '+' || t->text[1] == '-') && t->text[2])
+                    || t->text[1] == '%'
+                    || (t->text[1] >= '0' && t->text[1] <= '9'));
+}
+
+/*
+ * Determine whether any token in a line is one of the above.
+ */
+static int
+has_mmac_params(const Token * tline)
+{
+    for (; tline; tline = tline->next)
+        if (is_mmac_param(tline))
+            return TRUE;
+    return FALSE;
+}
+
+/*
+ * Paste together adjacent tokens that form a single identifier or
+ * number once MMacro-local things have been substituted, and
+ * collapse runs of whitespace.
+ */
+static Token *
+paste_tokens(Token * thead)
+{
+    Token *t, *tt;
+
+    for (t = thead; t && (tt = t->next) != NULL; t = t->next)
+        switch (t->type)
+        {
+            case TOK_WHITESPACE:
+                if (tt->type == TOK_WHITESPACE)
+                {
+                    t->next = delete_Token(tt);
+                }
+                break;
+            case TOK_ID:
+                if (tt->type == TOK_ID || tt->type == TOK_NUMBER)
+                {
+                    char *tmp = nasm_strcat(t->text, tt->text);
+                    nasm_free(t->text);
+                    t->text = tmp;
+                    t->next = delete_Token(tt);
+                }
+                break;
+            case TOK_NUMBER:
+                if (tt->type == TOK_NUMBER)
+                {
+                    char *tmp = nasm_strcat(t->text, tt->text);
+                    nasm_free(t->text);
+                    t->text = tmp;
+                    t->next = delete_Token(tt);
+                }
+                break;
+        }
+
+    return thead;
+}
+
 /*
  * Expand MMacro-local things: parameter references (%0, %n, %+n,
  * %-n) and MMacro-local identifiers (%%foo).
@@ -3850,10 +4130,7 @@ expand_mmac_params(Token * tline)
 
     while (tline)
     {
-        if (tline->type == TOK_PREPROC_ID &&
-                (((tline->text[1] == '+' || tline->text[1] == '-')
-                                && tline->text[2]) || tline->text[1] == '%'
-                        || (tline->text[1] >= '0' && tline->text[1] <= '9')))
+        if (is_mmac_param(tline))
         {
             char *text = NULL;
             int type = 0, cc;   /* type = 0 to placate optimisers */
@@ -4041,37 +4318,8 @@ expand_mmac_params(Token * tline)
         }
     }
     *tail = NULL;
-    t = thead;
-    for (; t && (tt = t->next) != NULL; t = t->next)
-        switch (t->type)
-        {
-            case TOK_WHITESPACE:
-                if (tt->type == TOK_WHITESPACE)
-                {
-                    t->next = delete_Token(tt);
-                }
-                break;
-            case TOK_ID:
-                if (tt->type == TOK_ID || tt->type == TOK_NUMBER)
-                {
-                    char *tmp = nasm_strcat(t->text, tt->text);
-                    nasm_free(t->text);
-                    t->text = tmp;
-                    t->next = delete_Token(tt);
-                }
-                break;
-            case TOK_NUMBER:
-                if (tt->type == TOK_NUMBER)
-                {
-                    char *tmp = nasm_strcat(t->text, tt->text);
-                    nasm_free(t->text);
-                    t->text = tmp;
-                    t->next = delete_Token(tt);
-                }
-                break;
-        }
 
-    return thead;
+    return paste_tokens(thead);
 }
 
 /*
@@ -4092,6 +4340,7 @@ expand_smacro(Token * tline)
     Token *org_tline = tline;
     Context *ctx;
     char *mname;
+    unsigned long mhash;
 
     /*
      * Trick: we should avoid changing the start token pointer since it can
@@ -4122,10 +4371,11 @@ expand_smacro(Token * tline)
                 ctx = get_ctx(mname, TRUE);
             else
                 ctx = NULL;
+            mhash = hash(mname);
             if (!ctx)
-                head = smacros[hash(mname)];
+                head = smtable_chain(&smacros, mhash);
             else
-                head = ctx->localmac;
+                head = smtable_chain(&ctx->localmac, mhash);
             /*
              * We've hit an identifier. As in is_mmacro below, we first
              * check whether the identifier is a single-line macro at
@@ -4133,7 +4383,7 @@ expand_smacro(Token * tline)
              * necessary.
              */
             for (m = head; m; m = m->next)
-                if (!mstrcmp(m->name, mname, m->casesense))
+                if (m->hash == mhash && !mstrcmp(m->name, mname, m->casesense))
                     break;
             if (m)
             {
@@ -4291,6 +4541,7 @@ expand_smacro(Token * tline)
                         }       /* parameter loop */
                         nparam++;
                         while (m && (m->nparam != nparam ||
+                                        m->hash != mhash ||
                                         mstrcmp(m->name, mname,
                                                 m->casesense)))
                             m = m->next;
@@ -4531,8 +4782,9 @@ is_mmacro(Token * tline, Token *** params_array)
     MMacro *head, *m;
     Token **params;
     int nparam;
+    unsigned long h = hash(tline->text);
 
-    head = mmacros[hash(tline->text)];
+    head = mmtable_chain(&mmacros, h);
 
     /*
      * Efficiency: first we see if any macro exists with the given
@@ -4541,7 +4793,7 @@ is_mmacro(Token * tline, Token *** params_array)
      * list if necessary to find the proper MMacro.
      */
     for (m = head; m; m = m->next)
-        if (!mstrcmp(m->name, tline->text, m->casesense))
+        if (m->hash == h && !mstrcmp(m->name, tline->text, m->casesense))
             break;
     if (!m)
         return NULL;
@@ -4612,7 +4864,7 @@ is_mmacro(Token * tline, Token *** params_array)
          * same name.
          */
         for (m = m->next; m; m = m->next)
-            if (!mstrcmp(m->name, tline->text, m->casesense))
+            if (m->hash == h && !mstrcmp(m->name, tline->text, m->casesense))
                 break;
     }
 
@@ -4726,6 +4978,7 @@ expand_mmacro(Token * tline)
     ll->next = istk->expansion;
     ll->finishes = m;
     ll->first = NULL;
+    ll->params = TRUE;
     istk->expansion = ll;
 
     m->in_progress = TRUE;
@@ -4746,10 +4999,22 @@ expand_mmacro(Token * tline)
 
         ll = nasm_malloc(sizeof(Line));
         ll->finishes = NULL;
+        ll->params = l->params;
         ll->next = istk->expansion;
         istk->expansion = ll;
         tail = &ll->first;
 
+        if (!l->params)
+        {
+            for (t = l->first; t; t = t->next)
+            {
+                tt = *tail = new_Token(NULL, t->type, t->text, 0);
+                tail = &tt->next;
+            }
+            *tail = NULL;
+            continue;
+        }
+
         for (t = l->first; t; t = t->next)
         {
             Token *x = t;
@@ -4779,6 +5044,7 @@ expand_mmacro(Token * tline)
         {
             ll = nasm_malloc(sizeof(Line));
             ll->finishes = NULL;
+            ll->params = TRUE;
             ll->next = istk->expansion;
             istk->expansion = ll;
             ll->first = startline;
@@ -4828,12 +5094,10 @@ error(int severity, const char *fmt, ...)
 }
 
 static void
-pp_reset(FILE *f, const char *file, int apass, efunc errfunc, evalfunc eval,
-        ListGen * listgen)
+pp_reset(yasm_mapfile *f, const char *file, int apass, efunc errfunc,
+         evalfunc eval, ListGen * listgen)
 {
-    int h;
-
-    first_fp = f;
+    first_src = f;
     _error = errfunc;
     cstk = NULL;
     istk = nasm_malloc(sizeof(Include));
@@ -4841,7 +5105,8 @@ pp_reset(FILE *f, const char *file, int apass, efunc errfunc, evalfunc eval,
     istk->conds = NULL;
     istk->expansion = NULL;
     istk->mstk = NULL;
-    istk->fp = f;
+    istk->src = f;
+    istk->srcpos = 0;
     istk->fname = NULL;
     nasm_free(nasm_src_set_fname(nasm_strdup(file)));
     nasm_src_set_linnum(0);
@@ -4849,11 +5114,12 @@ pp_reset(FILE *f, const char *file, int apass, efunc errfunc, evalfunc eval,
     defining = NULL;
     nested_mac_count = 0;
     nested_rep_count = 0;
-    for (h = 0; h < NHASH; h++)
-    {
-        mmacros[h] = NULL;
-        smacros[h] = NULL;
-    }
+    mmacros.buckets = NULL;
+    mmacros.size = 0;
+    mmacros.count = 0;
+    smacros.buckets = NULL;
+    smacros.size = 0;
+    smacros.count = 0;
     unique = 0;
     if (tasm_compatible_mode) {
         pp_extra_stdmac(tasm_compat_macros);
@@ -4889,6 +5155,7 @@ poke_predef(Line *predef_lines)
         l->next = istk->expansion;
         l->first = head;
         l->finishes = FALSE;
+        l->params = TRUE;
         istk->expansion = l;
     }
 }
@@ -4898,6 +5165,7 @@ pp_getline(void)
 {
     char *line;
     Token *tline;
+    int params;
 
     while (1)
     {
@@ -4947,6 +5215,7 @@ pp_getline(void)
                     ll->next = istk->expansion;
                     ll->finishes = NULL;
                     ll->first = NULL;
+                    ll->params = l->params;
                     tail = &ll->first;
 
                     for (t = l->first; t; t = t->next)
@@ -5012,17 +5281,30 @@ pp_getline(void)
             if (istk->expansion)
             {                   /* from a macro expansion */
                 char *p;
+                Token *t;
                 Line *l = istk->expansion;
                 if (istk->mstk)
                     istk->mstk->lineno++;
                 tline = l->first;
+                params = l->params;
                 istk->expansion = l->next;
                 nasm_free(l);
-                p = detoken(tline, FALSE);
-                list->line(LIST_MACRO, p);
-                nasm_free(p);
+                if (list->line)
+                {
+                    p = detoken(tline, FALSE);
+                    list->line(LIST_MACRO, p);
+                    nasm_free(p);
+                }
+                else
+                {
+                    /* Same environment substitution detoken would do */
+                    for (t = tline; t; t = t->next)
+                        if (expand_env(t))
+                            params = TRUE;
+                }
                 break;
             }
+            params = TRUE;
             line = read_line();
             if (line)
             {                   /* from the current input file */
@@ -5036,8 +5318,8 @@ pp_getline(void)
              */
             {
                 Include *i = istk;
-                if (i->fp != first_fp)
-                    fclose(i->fp);
+                if (i->src != first_src)
+                    yasm_mapfile_destroy(i->src);
                 if (i->conds)
                     error(ERR_FATAL, "expected `%%endif' before end of file");
                 /* only set line and file name if there's a next node */
@@ -5067,7 +5349,12 @@ pp_getline(void)
          * anything.
          */
         if (!defining && !(istk->conds && !emitting(istk->conds->state)))
-            tline = expand_mmac_params(tline);
+        {
+            if (params)
+                tline = expand_mmac_params(tline);
+            else
+                tline = paste_tokens(tline);
+        }
 
         /*
          * Check the line to see if it's a preprocessor directive.
@@ -5087,6 +5374,7 @@ pp_getline(void)
             l->next = defining->expansion;
             l->first = tline;
             l->finishes = FALSE;
+            l->params = has_mmac_params(tline);
             defining->expansion = l;
             continue;
         }
@@ -5142,8 +5430,6 @@ pp_getline(void)
 static void
 pp_cleanup(int pass_)
 {
-    int h;
-
     if (pass_ == 1)
     {
         if (defining)
@@ -5156,29 +5442,14 @@ pp_cleanup(int pass_)
     }
     while (cstk)
         ctx_pop();
-    for (h = 0; h < NHASH; h++)
-    {
-        while (mmacros[h])
-        {
-            MMacro *m = mmacros[h];
-            mmacros[h] = mmacros[h]->next;
-            free_mmacro(m);
-        }
-        while (smacros[h])
-        {
-            SMacro *s = smacros[h];
-            smacros[h] = smacros[h]->next;
-            nasm_free(s->name);
-            free_tlist(s->expansion);
-            nasm_free(s);
-        }
-    }
+    mmtable_free(&mmacros);
+    smtable_free(&smacros);
     while (istk)
     {
         Include *i = istk;
         istk = istk->next;
-        if (i->fp != first_fp)
-            fclose(i->fp);
+        if (i->src != first_src)
+            yasm_mapfile_destroy(i->src);
         nasm_free(i->fname);
         nasm_free(i);
     }
@@ -5213,6 +5484,7 @@ pp_pre_include(const char *fname)
     l->next = predef;
     l->first = inc;
     l->finishes = FALSE;
+    l->params = TRUE;
     predef = l;
 }
 
@@ -5236,6 +5508,7 @@ pp_pre_define(char *definition)
     l->next = predef;
     l->first = def;
     l->finishes = FALSE;
+    l->params = TRUE;
     predef = l;
 }
 
@@ -5253,6 +5526,7 @@ pp_pre_undefine(char *definition)
     l->next = predef;
     l->first = def;
     l->finishes = FALSE;
+    l->params = TRUE;
     predef = l;
 }
 
@@ -5276,6 +5550,7 @@ pp_builtin_define(char *definition)
     l->next = builtindef;
     l->first = def;
     l->finishes = FALSE;
+    l->params = TRUE;
     builtindef = l;
 }
 
@@ -5298,6 +5573,7 @@ pp_extra_stdmac(const char **macros)
         l->next = stddef;
         l->first = t;
         l->finishes = FALSE;
+        l->params = TRUE;
         stddef = l;
     }
 }
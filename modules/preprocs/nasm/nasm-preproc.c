@@ -36,7 +36,7 @@
 typedef struct yasm_preproc_nasm {
     yasm_preproc_base preproc;   /* Base structure */
 
-    FILE *in;
+    yasm_mapfile *in;
     char *line;
     char *file_name;
     long prior_linnum;
@@ -76,11 +76,6 @@ nil_listgen_output(long v, const void *d, unsigned long v2)
 {
 }
 
-static void
-nil_listgen_line(int v, char *p)
-{
-}
-
 static void
 nil_listgen_uplevel(int v)
 {
@@ -95,7 +90,7 @@ static ListGen nil_list = {
     nil_listgen_init,
     nil_listgen_cleanup,
     nil_listgen_output,
-    nil_listgen_line,
+    NULL,
     nil_listgen_uplevel,
     nil_listgen_downlevel
 };
@@ -134,18 +129,17 @@ static yasm_preproc *
 nasm_preproc_create(const char *in_filename, yasm_symtab *symtab,
                     yasm_linemap *lm, yasm_errwarns *errwarns)
 {
-    FILE *f;
+    yasm_mapfile *f;
     yasm_preproc_nasm *preproc_nasm = yasm_xmalloc(sizeof(yasm_preproc_nasm));
 
     preproc_nasm->preproc.module = &yasm_nasm_LTX_preproc;
 
-    if (strcmp(in_filename, "-") != 0) {
-        f = fopen(in_filename, "r");
-        if (!f)
-            yasm__fatal( N_("Could not open input file") );
-    }
+    if (strcmp(in_filename, "-") != 0)
+        f = yasm_mapfile_create(in_filename);
     else
-        f = stdin;
+        f = yasm_mapfile_read(stdin);
+    if (!f)
+        yasm__fatal( N_("Could not open input file") );
 
     preproc_nasm->in = f;
     nasm_symtab = symtab;
@@ -169,6 +163,7 @@ nasm_preproc_destroy(yasm_preproc *preproc)
 {
     yasm_preproc_nasm *preproc_nasm = (yasm_preproc_nasm *)preproc;
     nasmpp.cleanup(0);
+    yasm_mapfile_destroy(preproc_nasm->in);
     if (preproc_nasm->line)
         yasm_xfree(preproc_nasm->line);
     if (preproc_nasm->file_name)
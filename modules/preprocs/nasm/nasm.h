@@ -117,7 +117,9 @@ typedef struct {
      * Called to send a text line to the listing generator. The
      * `int' parameter is LIST_READ or LIST_MACRO depending on
      * whether the line came directly from an input file or is the
-     * result of a multi-line macro expansion.
+     * result of a multi-line macro expansion. May be NULL if the
+     * listing generator doesn't list source lines, in which case the
+     * preprocessor doesn't build the text for them.
      */
     void (*line) (int, char *);
 
@@ -206,11 +208,12 @@ typedef yasm_expr *(*evalfunc) (scanner sc, void *scprivate, struct tokenval *tv
  */
 typedef struct {
     /*
-     * Called at the start of a pass; given a file name, the number
-     * of the pass, an error reporting function, an evaluator
-     * function, and a listing generator to talk to.
+     * Called at the start of a pass; given the file contents, a file
+     * name, the number of the pass, an error reporting function, an
+     * evaluator function, and a listing generator to talk to.
      */
-    void (*reset) (FILE *, const char *, int, efunc, evalfunc, ListGen *);
+    void (*reset) (yasm_mapfile *, const char *, int, efunc, evalfunc,
+                   ListGen *);
 
     /*
      * Called to fetch a line of preprocessed source. The line
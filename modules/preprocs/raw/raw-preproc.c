@@ -29,14 +29,12 @@
 #include <libyasm.h>
 
 
-#define BSIZE 512
-
 typedef struct yasm_preproc_raw {
     yasm_preproc_base preproc;   /* base structure */
 
-    FILE *in;
+    /*@only@*/ yasm_mapfile *in;
+    unsigned long in_pos;       /* offset of next line in input */
     yasm_linemap *cur_lm;
-    yasm_errwarns *errwarns;
 } yasm_preproc_raw;
 
 yasm_preproc_module yasm_raw_LTX_preproc;
@@ -45,21 +43,20 @@ static yasm_preproc *
 raw_preproc_create(const char *in_filename, yasm_symtab *symtab,
                    yasm_linemap *lm, yasm_errwarns *errwarns)
 {
-    FILE *f;
+    yasm_mapfile *in;
     yasm_preproc_raw *preproc_raw = yasm_xmalloc(sizeof(yasm_preproc_raw));
 
-    if (strcmp(in_filename, "-") != 0) {
-        f = fopen(in_filename, "r");
-        if (!f)
-            yasm__fatal( N_("Could not open input file") );
-    }
+    if (strcmp(in_filename, "-") != 0)
+        in = yasm_mapfile_create(in_filename);
     else
-        f = stdin;
+        in = yasm_mapfile_read(stdin);
+    if (!in)
+        yasm__fatal( N_("Could not open input file") );
 
     preproc_raw->preproc.module = &yasm_raw_LTX_preproc;
-    preproc_raw->in = f;
+    preproc_raw->in = in;
+    preproc_raw->in_pos = 0;
     preproc_raw->cur_lm = lm;
-    preproc_raw->errwarns = errwarns;
 
     return (yasm_preproc *)preproc_raw;
 }
@@ -67,6 +64,8 @@ raw_preproc_create(const char *in_filename, yasm_symtab *symtab,
 static void
 raw_preproc_destroy(yasm_preproc *preproc)
 {
+    yasm_preproc_raw *preproc_raw = (yasm_preproc_raw *)preproc;
+    yasm_mapfile_destroy(preproc_raw->in);
     yasm_xfree(preproc);
 }
 
@@ -74,43 +73,22 @@ static char *
 raw_preproc_get_line(yasm_preproc *preproc)
 {
     yasm_preproc_raw *preproc_raw = (yasm_preproc_raw *)preproc;
-    int bufsize = BSIZE;
-    char *buf = yasm_xmalloc((size_t)bufsize);
-    char *p;
-
-    /* Loop to ensure entire line is read (don't want to limit line length). */
-    p = buf;
-    for (;;) {
-        if (!fgets(p, bufsize-(p-buf), preproc_raw->in)) {
-            if (ferror(preproc_raw->in)) {
-                yasm_error_set(YASM_ERROR_IO,
-                               N_("error when reading from file"));
-                yasm_errwarn_propagate(preproc_raw->errwarns,
-                    yasm_linemap_get_current(preproc_raw->cur_lm));
-            }
-            break;
-        }
-        p += strlen(p);
-        if (p > buf && p[-1] == '\n')
-            break;
-        if ((p-buf)+1 >= bufsize) {
-            /* Increase size of buffer */
-            char *oldbuf = buf;
-            bufsize *= 2;
-            buf = yasm_xrealloc(buf, (size_t)bufsize);
-            p = buf + (p-oldbuf);
-        }
-    }
-
-    if (p == buf) {
-        /* No data; must be at EOF */
-        yasm_xfree(buf);
-        return NULL;
-    }
+    const char *line, *cr;
+    size_t len;
+    char *buf;
+
+    line = yasm_mapfile_get_line(preproc_raw->in, &preproc_raw->in_pos, &len);
+    if (!line)
+        return NULL;    /* EOF */
 
     /* Strip the line ending */
-    buf[strcspn(buf, "\r\n")] = '\0';
+    cr = memchr(line, '\r', len);
+    if (cr)
+        len = (size_t)(cr - line);
 
+    buf = yasm_xmalloc(len+1);
+    memcpy(buf, line, len);
+    buf[len] = '\0';
     return buf;
 }
 
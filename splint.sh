@@ -36,6 +36,7 @@ splint \
  libyasm/file.c \
  libyasm/floatnum.c \
  libyasm/hamt.c \
+ libyasm/intern.c \
  libyasm/intnum.c \
  libyasm/inttree.c \
  libyasm/linemap.c \
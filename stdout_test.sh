@@ -0,0 +1,73 @@
+#! /bin/sh
+
+YASM_TEST_SUITE=1
+export YASM_TEST_SUITE
+
+case `echo "testing\c"; echo 1,2,3`,`echo -n testing; echo 1,2,3` in
+  *c*,-n*) ECHO_N= ECHO_C='
+' ECHO_T='	' ;;
+  *c*,*  ) ECHO_N=-n ECHO_C= ECHO_T= ;;
+  *)       ECHO_N= ECHO_C='\c' ECHO_T= ;;
+esac
+
+mkdir results >/dev/null 2>&1
+
+#
+# Verify that output written to a pipe ("-o -") matches output written to
+# a file
+#
+
+passedct=0
+failedct=0
+
+echo $ECHO_N "Test $1: $ECHO_C"
+for asm in ${srcdir}/$2/*.asm
+do
+    a=`echo ${asm} | sed 's,^.*/,,;s,.asm$,,'`
+    o=${a}$5
+    p=${a}.pipe$5
+
+    # Sources with errors don't produce output to compare.
+    echo ${a} | grep err >/dev/null
+    if test $? -eq 0; then
+        continue
+    fi
+
+    # Run within a subshell to prevent signal messages from displaying.
+    sh -c "cat ${asm} | ./yasm $4 -o results/${o} - 2>/dev/null" >/dev/null 2>/dev/null
+    status=$?
+    if test $status -gt 128; then
+        # We should never get a coredump!
+        echo $ECHO_N "C$ECHO_C"
+        eval "failed$failedct='C: ${a} crashed!'"
+        failedct=`expr $failedct + 1`
+    elif test $status -gt 0; then
+        echo $ECHO_N "E$ECHO_C"
+        eval "failed$failedct='E: ${a} returned an error code!'"
+        failedct=`expr $failedct + 1`
+    else
+        sh -c "cat ${asm} | ./yasm $4 -o - - 2>/dev/null | cat >results/${p}" >/dev/null 2>/dev/null
+        if cmp -s results/${o} results/${p}; then
+            echo $ECHO_N ".$ECHO_C"
+            passedct=`expr $passedct + 1`
+        else
+            # Piped output doesn't match file output.
+            echo $ECHO_N "O$ECHO_C"
+            eval "failed$failedct='O: ${a} piped output did not match file output!'"
+            failedct=`expr $failedct + 1`
+        fi
+    fi
+done
+
+ct=`expr $failedct + $passedct`
+per=`expr 100 \* $passedct / $ct`
+
+echo " +$passedct-$failedct/$ct $per%"
+i=0
+while test $i -lt $failedct; do
+    eval "failure=\$failed$i"
+    echo " ** $failure"
+    i=`expr $i + 1`
+done
+
+exit $failedct
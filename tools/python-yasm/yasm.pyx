@@ -102,6 +102,7 @@ cdef class __assoc_data_callback:
         self.cb.destroy = <void (*) (void *)>PyCObject_AsVoidPtr(destroy)
         #self.cb.print_ = <void (*) (void *, FILE *, int)>PyCObject_AsVoidPtr(print_)
     def __dealloc__(self):
+        yasm__assoc_data_unregister(self.cb)
         free(self.cb)
 
 